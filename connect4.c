@@ -6,34 +6,134 @@
  *
  *  <<Relation between cells and bits>>
  *
- *  LSB has information of the top-left cell state
+ *  Column-major from the bottom-left cell, with one sentinel bit on
+ *  top of every column that always stays 0
  *
- *  example with 7x2 board
- *  O------
- *  ------X
+ *  example with 7x2 board (bit index, S = sentinel)
+ *  S  S  S  S  S  S  S         2  5  8 11 14 17 20
+ *  O------                     1  4  7 10 13 16 19
+ *  ------X                     0  3  6  9 12 15 18
  *
  *  when extract 'O' (@ row=0, col=0) pos bit
- *  board_bits & (1<<0*7+0)
+ *  board_bits & (1<<0*(2+1)+(2-1-0))
  *
  *  when extract 'X' (@ row=1, col=6) pos bit
- *  board_bits & (1<<1*7+6)
+ *  board_bits & (1<<6*(2+1)+(2-1-1))
+ *
+ *  (row 0 is the top row as before; the public API still takes row/col)
+ *
+ *  Adding the bottom bit of a column to the filled cells carries up to
+ *  the lowest empty cell of the column (or into the sentinel when the
+ *  column is full), so
+ *      (filled + bottom_mask) & board_mask
+ *  is the set of every placable cell.
+ *
+ *  col_num*(row_num+1) must not exceed CONNECT4_BITS_MAX. Up to 64, e.g.
+ *  7x6, 8x7 or 9x6, every operation is on one word; larger boards such
+ *  as 9x7 or 10x8 set wide and take the 128-bit path, where the carry
+ *  above crosses from the lower word into the upper one by itself.
+ *
+ *
+ *  <<Win detection>>
+ *
+ *  Shifting the board right by the step of a direction moves every
+ *  cell onto its neighbour in that direction, so
+ *      disks & disks>>s & disks>>2s & disks>>3s
+ *  marks the first cell of every four in a row. Any line that would
+ *  wrap into the next column crosses a sentinel, so no edge masks are
+ *  needed.
+ *
+ *  For win_len in a row the runs are grown instead: r & r>>k*s marks
+ *  runs of len + k when r marks runs of len and k <= len, so doubling
+ *  takes log2(win_len) steps (two for four in a row). The shift of
+ *  every step and direction only depends on the geometry and is worked
+ *  out once by connect4_new_game().
  *
  */
 
 #include "connect4.h"
 #include <assert.h>
-#include <limits.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-static uint64_t connect4_generate_disk_placable_pos_mask (Connect4_t *game);
-static bool connect4_check_win (Connect4_t *game, int row, int col);
+static Connect4_bits_t connect4_generate_disk_placable_pos_mask (Connect4_t *game);
 static void switch_player_turn (Connect4_t *game);
 
+static int
+direction_shift (Connect4_t *game, Direction_t dir)
+{
+    switch (dir)
+    {
+    case DIR_HORIZONTAL:
+        return game->row_num + 1;
+    case DIR_VERTICAL:
+        return 1;
+    case DIR_DIAGONAL_DOWN:
+        return game->row_num;
+    case DIR_DIAGONAL_UP:
+    default:
+        return game->row_num + 2;
+    }
+}
+
+static int
+cell_index (Connect4_t *game, int row, int col)
+{
+    return col*(game->row_num + 1) + game->row_num - 1 - row;
+}
+
+static Connect4_bits_t
+cell_bit (Connect4_t *game, int row, int col)
+{
+    return (Connect4_bits_t)1<<cell_index(game, row, col);
+}
+
+/*
+ *  index of the lowest disk of a non-empty board
+ */
+static int
+bits_ctz (Connect4_bits_t bits)
+{
+#if CONNECT4_BITS_MAX > 64
+    if ((uint64_t)bits == 0)
+        return 64 + __builtin_ctzll((uint64_t)(bits>>64));
+#endif
+    return __builtin_ctzll((uint64_t)bits);
+}
+
+/*
+ *  true when the board fits the bitboards and win_len the records
+ */
+bool
+connect4_valid_geometry (int col_num, int row_num, int win_len)
+{
+    return 0 < col_num && 0 < row_num && row_num < CONNECT4_BITS_MAX
+            && col_num <= CONNECT4_BITS_MAX/(row_num + 1)
+            && 1 < win_len && win_len <= CONNECT4_WIN_LEN_MAX;
+}
+
 void new_game (Connect4_t *game, int col_num, int row_num)
 {
-    assert(0<col_num && 0<row_num);
-    assert(col_num*row_num <= sizeof(uint64_t)*CHAR_BIT);
+    connect4_new_game(game, col_num, row_num, CONNECT4_WIN_LEN);
+}
+
+/*
+ *  Function name:
+ *      connect4_new_game
+ *
+ *  Description:
+ *      set up an empty board of any geometry for win_len in a row
+ *
+ *  Input:
+ *      game    :   game information
+ *      col_num :   columns
+ *      row_num :   rows
+ *      win_len :   disks in a row that win
+ */
+void
+connect4_new_game (Connect4_t *game, int col_num, int row_num, int win_len)
+{
+    assert(connect4_valid_geometry(col_num, row_num, win_len));
 
     game->black = 0;
     game->white = 0;
@@ -41,6 +141,42 @@ void new_game (Connect4_t *game, int col_num, int row_num)
 
     game->col_num = col_num;
     game->row_num = row_num;
+    game->move_num = 0;
+
+    game->wide = col_num*(row_num + 1) > 64;
+
+    if (!game->wide) {
+        uint64_t column = ((uint64_t)1<<row_num) - 1;
+        uint64_t bottom_mask = 0, board_mask = 0;
+        for (int col = 0; col < col_num; col++) {
+            bottom_mask |= (uint64_t)1<<col*(row_num + 1);
+            board_mask |= column<<col*(row_num + 1);
+        }
+        game->bottom_mask = bottom_mask;
+        game->board_mask = board_mask;
+    }
+    else {
+        Connect4_bits_t column = ((Connect4_bits_t)1<<row_num) - 1;
+        game->bottom_mask = 0;
+        game->board_mask = 0;
+        for (int col = 0; col < col_num; col++) {
+            game->bottom_mask |= (Connect4_bits_t)1<<col*(row_num + 1);
+            game->board_mask |= column<<col*(row_num + 1);
+        }
+    }
+
+    game->win_len = win_len;
+    game->win_step_num = 0;
+    int bit_num = game->wide ? CONNECT4_BITS_MAX : 64;
+    for (int len = 1; len < win_len; len += len) {
+        int k = (len < win_len - len) ? len : win_len - len;
+        for (int dir = 0; dir < DIR_NUM; dir++) {
+            // no line that long fits; the top bit is a sentinel or unused
+            int shift = k*direction_shift(game, dir);
+            game->win_shifts[dir][game->win_step_num] = (shift < bit_num) ? shift : bit_num - 1;
+        }
+        game->win_step_num++;
+    }
 }
 
 /*
@@ -56,21 +192,14 @@ void new_game (Connect4_t *game, int col_num, int row_num)
  *  Output:
  *      return  :   disk-placable cells position mask
  */
-static uint64_t
+static Connect4_bits_t
 connect4_generate_disk_placable_pos_mask (Connect4_t *game)
 {
-    int cell_num = game->col_num*game->row_num;
-
-    uint64_t valid_bits_mask = ~(uint64_t)0>>(sizeof(uint64_t)*CHAR_BIT - cell_num);
-    uint64_t bottom = valid_bits_mask ^ (valid_bits_mask>>game->col_num);
-    uint64_t filled = game->white | game->black;
-
-    // shift cells upward by 1 row and set the bottom cells filled
-    uint64_t shifted = filled>>game->col_num | bottom;
+    Connect4_bits_t filled = game->white | game->black;
 
-    uint64_t placable = (filled ^ shifted) & valid_bits_mask;
-
-    return placable;
+    if (!game->wide)
+        return ((uint64_t)filled + (uint64_t)game->bottom_mask) & (uint64_t)game->board_mask;
+    return (filled + game->bottom_mask) & game->board_mask;
 }
 
 bool
@@ -82,7 +211,7 @@ is_valid_move (Connect4_t *game, int row, int col)
     if (col < 0 || game->col_num <= col)
         return false;
 
-    uint64_t bit_mask = (uint64_t)1<<(row * game->col_num + col);
+    Connect4_bits_t bit_mask = cell_bit(game, row, col);
 
     if (bit_mask & connect4_generate_disk_placable_pos_mask(game))
         return true;
@@ -90,122 +219,249 @@ is_valid_move (Connect4_t *game, int row, int col)
         return false;
 }
 
-static bool
-connect4_check_win (Connect4_t *game, int row, int col)
+/*
+ *  connect4_check_win on a board over 64 bits, the same steps on both
+ *  words; kept out of line so that the 64-bit path does not save the
+ *  registers this one needs
+ */
+static __attribute__((noinline)) bool
+check_win_wide (Connect4_t *game, Connect4_bits_t disks)
 {
-    uint64_t disks = (game->state == BLACK_MOVE) ? game->black : game->white;
-    const int connection_num = 4;
-    uint64_t mask = (uint64_t)1<<(row * game->col_num + col);
-    int count;
-
-    count = 0;
-
-    // Horizontal (left)
-    uint64_t mask_temp = mask;
-    for (int col_l = col - 1;
-            0 <= col_l && (disks & (mask_temp >>= 1));
-            col_l--)
-        count++;
-
-    // Horizontal (right)
-    mask_temp = mask;
-    for (int col_r = col + 1;
-            col_r < game->col_num && (disks & (mask_temp <<= 1));
-            col_r++)
-        count++;
-
-    if (count >= connection_num)
-        return true;
-
-
-    // Vertical
-    uint64_t tmp = disks & disks>>(2 * game->col_num);
-    if (tmp & tmp>>game->col_num)
-        return true;
+    Connect4_bits_t lines = 0;
+
+    if (game->win_len == CONNECT4_WIN_LEN) {
+        for (int dir = 0; dir < DIR_NUM; dir++) {
+            Connect4_bits_t pairs = disks & disks>>game->win_shifts[dir][0];
+            lines |= pairs & pairs>>game->win_shifts[dir][1];
+        }
+        return lines != 0;
+    }
 
+    for (int dir = 0; dir < DIR_NUM; dir++) {
+        Connect4_bits_t runs = disks;
+        for (int i = 0; i < game->win_step_num; i++)
+            runs &= runs>>game->win_shifts[dir][i];
+        lines |= runs;
+    }
 
-    count = 0;
+    return lines != 0;
+}
 
-    // diagonal (/)(up)
-    mask_temp = mask;
-    for (int row_u = row - 1, col_r = col + 1;
-            0 <= row_u && col_r < game->col_num
-                && (disks & (mask_temp >>= game->col_num - 1));
-            row_u--, col_r++)
-        count++;
+/*
+ *  Function name:
+ *      connect4_check_win
+ *
+ *  Description:
+ *      check if the disks of a color contain win_len in a row, in
+ *      constant time
+ *
+ *  Input:
+ *      game    :   game information
+ *      color   :   CELL_BLACK or CELL_WHITE
+ *
+ *  Output:
+ *      return  :   true when the color has win_len in a row
+ */
+bool
+connect4_check_win (Connect4_t *game, Cell_state_t color)
+{
+    if (game->wide)
+        return check_win_wide(game, (color == CELL_BLACK) ? game->black : game->white);
+
+    uint64_t disks = (color == CELL_BLACK) ? (uint64_t)game->black : (uint64_t)game->white;
+    uint64_t lines = 0;
+
+    // four in a row, as on the fixed 7x6 board: two steps, unrolled;
+    // the shifts are the capped ones of connect4_new_game(), as s or 2s
+    // may not fit the word on a board one or two columns wide
+    if (game->win_len == CONNECT4_WIN_LEN) {
+        for (int dir = 0; dir < DIR_NUM; dir++) {
+            uint64_t pairs = disks & disks>>game->win_shifts[dir][0];
+            lines |= pairs & pairs>>game->win_shifts[dir][1];
+        }
+        return lines != 0;
+    }
 
-    // diagonal (/)(down)
-    mask_temp = mask;
-    for (int row_d = row + 1, col_l = col - 1;
-            row_d < game->row_num && 0 <= col_l
-                && (disks & (mask_temp <<= game->col_num - 1));
-            row_d++, col_l++)
-        count++;
+    for (int dir = 0; dir < DIR_NUM; dir++) {
+        uint64_t runs = disks;
+        for (int i = 0; i < game->win_step_num; i++)
+            runs &= runs>>game->win_shifts[dir][i];
+        lines |= runs;
+    }
 
-    if (count >= connection_num)
-        return true;
+    return lines != 0;
+}
 
+/*
+ *  put the disk of the side to move on the cell of a bit index (already
+ *  validated), then settle the game result and the turn
+ */
+static void
+place_disk (Connect4_t *game, int bit)
+{
+    Connect4_bits_t *disks = (game->state == BLACK_MOVE) ? &game->black : &game->white;
 
-    count = 0;
+    game->history[game->move_num++] = bit;
 
-    // Diagonal (\)(up)
-    mask_temp = mask;
-    for (int row_u = row - 1, col_l = col - 1;
-            0 <= row_u && 0 <= col_l && (disks & (mask_temp >>= game->col_num + 1));
-            row_u--, col_l--)
-        count++;
+    if (!game->wide)
+        *disks |= (uint64_t)1<<bit;
+    else
+        *disks |= (Connect4_bits_t)1<<bit;
 
-    // Diagonal (\)(down)
-    mask_temp = mask;
-    for (int row_d = row + 1, col_r = col + 1;
-            row_d < game->row_num && col_r < game->col_num
-                && (disks & (mask_temp <<= game->col_num + 1));
-            row_d++, col_r++)
-        count++;
+    // Check for win
+    if (connect4_check_win(game, game->state == BLACK_MOVE ? CELL_BLACK : CELL_WHITE)) {
+        game->result = (game->state == BLACK_MOVE) ? BLACK_WIN : WHITE_WIN;
+        game->state = GAME_OVER;
+    }
 
-    if (count >= connection_num)
-        return true;
+    //  When there is no more placable cell (a drawn game)
+    if (game->state != GAME_OVER && !connect4_generate_disk_placable_pos_mask(game)) {
+        game->result = GAME_DRAW;
+        game->state = GAME_OVER;
+    }
 
-    return false;
+    switch_player_turn(game);
 }
 
 int
 connect4_make_move (Connect4_t *game, int row, int col)
 {
+    if (game->state == GAME_OVER)
+        return -1;
+
     if (!is_valid_move(game, row, col))
         return -1; 
-    
-    uint64_t new_cell = (uint64_t)1<<row*game->col_num+col;
 
-    uint64_t *cell_bits;
-    switch (game->state)
-    {
-    case BLACK_MOVE:
-        game->black |= new_cell;
-        break;
-    case WHITE_MOVE:
-        game->white |= new_cell;
-    default:
-        break;
-    }
+    place_disk(game, cell_index(game, row, col));
 
-    // Check for win
-    if (connect4_check_win(game, row, col)) {
-        game->result = (game->state == BLACK_MOVE) ? BLACK_WIN : WHITE_WIN;
-        game->state = GAME_OVER;
-    }
+    return 0;
+}
 
-    //  When there is no more placable cell (a drawn game)
-    if (!connect4_generate_disk_placable_pos_mask(game)) {
-        game->result = GAME_DRAW;
-        game->state = GAME_OVER;
-    }
+/*
+ *  Function name:
+ *      connect4_landing_row
+ *
+ *  Description:
+ *      return the row a disk dropped into the column lands on
+ *
+ *  Input:
+ *      game    :   game information
+ *      col     :   column
+ *
+ *  Output:
+ *      return  :   row, -1 when the column is full or out of range
+ */
+int
+connect4_landing_row (Connect4_t *game, int col)
+{
+    if (col < 0 || game->col_num <= col)
+        return -1;
+
+    // a column fills from the bottom and its sentinel is never set, so
+    // the first empty bit from the bottom is where the disk lands
+    int bottom = col*(game->row_num + 1);
+    Connect4_bits_t filled = game->white | game->black;
+    int height = game->wide ? bits_ctz(~(filled>>bottom))
+                            : __builtin_ctzll(~((uint64_t)filled>>bottom));
+    if (height == game->row_num)
+        return -1;
+
+    return game->row_num - 1 - height;
+}
 
-    switch_player_turn(game);
+/*
+ *  Function name:
+ *      connect4_drop
+ *
+ *  Description:
+ *      drop a disk of the side to move into a column
+ *
+ *  Input:
+ *      game    :   game information
+ *      col     :   column
+ *
+ *  Output:
+ *      return  :   row the disk landed on, -1 when the move is invalid
+ */
+int
+connect4_drop (Connect4_t *game, int col)
+{
+    if (game->state == GAME_OVER)
+        return -1;
+
+    int row = connect4_landing_row(game, col);
+    if (row < 0)
+        return -1;
+
+    place_disk(game, cell_index(game, row, col));
+
+    return row;
+}
+
+/*
+ *  Function name:
+ *      connect4_unmake_move
+ *
+ *  Description:
+ *      take back the last disk in O(1); the bitboards, the turn and
+ *      the game state are restored (result is meaningless again until
+ *      the game is over)
+ *
+ *  Input:
+ *      game    :   game information
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when no disk is on the board
+ */
+int
+connect4_unmake_move (Connect4_t *game)
+{
+    if (game->move_num == 0)
+        return -1;
+
+    Connect4_bits_t cell = (Connect4_bits_t)1<<game->history[--game->move_num];
+
+    // black moves first, so black made every even-numbered move
+    if (game->move_num % 2 == 0) {
+        game->black &= ~cell;
+        game->state = BLACK_MOVE;
+    }
+    else {
+        game->white &= ~cell;
+        game->state = WHITE_MOVE;
+    }
 
     return 0;
 }
 
+int
+connect4_get_move_num (Connect4_t *game)
+{
+    return game->move_num;
+}
+
+/*
+ *  column of the index-th disk (0 is the first move), -1 when out of range
+ */
+int
+connect4_get_move_col (Connect4_t *game, int index)
+{
+    if (index < 0 || game->move_num <= index)
+        return -1;
+    return game->history[index]/(game->row_num + 1);
+}
+
+/*
+ *  row of the index-th disk, -1 when out of range
+ */
+int
+connect4_get_move_row (Connect4_t *game, int index)
+{
+    if (index < 0 || game->move_num <= index)
+        return -1;
+    return game->row_num - 1 - game->history[index]%(game->row_num + 1);
+}
+
 static void
 switch_player_turn (Connect4_t *game)
 {
@@ -227,7 +483,7 @@ switch_player_turn (Connect4_t *game)
 Cell_state_t
 connect4_get_cell_state (Connect4_t *game, int row, int col)
 {
-    uint64_t mask = (uint64_t)1<<row*game->col_num + col;
+    Connect4_bits_t mask = cell_bit(game, row, col);
 
     if (mask&game->black)
         return CELL_BLACK;
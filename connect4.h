@@ -3,6 +3,29 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/*
+ *  A side's disks on boards up to 64 cells with sentinels are one word;
+ *  larger boards (9x7, 10x8, ...) take the upper word as well, where the
+ *  compiler has 128-bit integers. connect4_new_game() picks the width by
+ *  the board size, so the common boards keep the 64-bit arithmetic.
+ */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 Connect4_bits_t;
+#define CONNECT4_BITS_MAX 128
+#else
+typedef uint64_t Connect4_bits_t;
+#define CONNECT4_BITS_MAX 64
+#endif
+
+// every cell of the largest board (col_num*(row_num+1) <= CONNECT4_BITS_MAX) fits
+#define CONNECT4_HISTORY_MAX CONNECT4_BITS_MAX
+// disks in a row that win, unless the game is set up for another length
+#define CONNECT4_WIN_LEN 4
+// longest winning line; it fits a nibble of the game records
+#define CONNECT4_WIN_LEN_MAX 15
+// runs of 1 double until they are win_len long, 15 takes 1+1+2+4+7
+#define CONNECT4_WIN_STEP_MAX 4
+
 typedef enum {
     BLACK_WIN,
     WHITE_WIN,
@@ -21,17 +44,43 @@ typedef enum {
     CELL_EMPTY
 } Cell_state_t;
 
+typedef enum {
+    DIR_HORIZONTAL,
+    DIR_VERTICAL,
+    DIR_DIAGONAL_DOWN,  // top-left to bottom-right
+    DIR_DIAGONAL_UP,    // bottom-left to top-right
+    DIR_NUM
+} Direction_t;
+
 typedef struct othello {
-    uint64_t black;
-    uint64_t white;
+    Connect4_bits_t black;
+    Connect4_bits_t white;
     Game_state_t state;
     Game_result_t result;
     int col_num, row_num;
+    bool wide;              // over 64 bits, the upper word is in use
+    int win_len;
+    int win_step_num;
+    int move_num;
+    Connect4_bits_t bottom_mask;    // bottom cell of every column
+    Connect4_bits_t board_mask;     // every cell, sentinels excluded
+    uint8_t win_shifts[DIR_NUM][CONNECT4_WIN_STEP_MAX]; // see connect4_check_win
+    // last, what is read on every move stays in the first cache lines
+    uint8_t history[CONNECT4_HISTORY_MAX];  // bit index of every disk, in order
 } Connect4_t;
 
 void new_game (Connect4_t *game, int col_num, int row_num);
+void connect4_new_game (Connect4_t *game, int col_num, int row_num, int win_len);
+bool connect4_valid_geometry (int col_num, int row_num, int win_len);
 int connect4_make_move (Connect4_t *game, int row, int col);
+int connect4_drop (Connect4_t *game, int col);
+int connect4_landing_row (Connect4_t *game, int col);
+int connect4_unmake_move (Connect4_t *game);
+int connect4_get_move_num (Connect4_t *game);
+int connect4_get_move_col (Connect4_t *game, int index);
+int connect4_get_move_row (Connect4_t *game, int index);
 bool is_valid_move (Connect4_t *game, int row, int col);
+bool connect4_check_win (Connect4_t *game, Cell_state_t color);
 Cell_state_t connect4_get_cell_state (Connect4_t *game, int row, int col);
 Game_state_t connect4_get_game_state (Connect4_t *game);
 Game_result_t connect4_get_game_result (Connect4_t *game);
@@ -0,0 +1,354 @@
+/*
+ *  Connect four batched games (see connect4_batch.h)
+ *
+ *  Every move goes through the same steps as in the engine, on all the
+ *  games at once and without branches: the landing cell is
+ *      (filled + bottom bit of the column) & column
+ *  (0 when the column is full), then the mover's disks are checked with
+ *  the shifts of connect4_new_game() and a board with every cell filled
+ *  is a draw. The AVX2 kernel does four games per instruction with the
+ *  per-lane shifts that SSE lacks; the scalar kernel does the same one
+ *  game at a time and takes the games after the last multiple of four.
+ */
+
+#include "connect4_batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CONNECT4_BATCH_X86
+#include <immintrin.h>
+#endif
+
+#define BATCH_LANE_NUM 4        // games per AVX2 vector
+#define BATCH_ALIGN 32
+
+#define STATE_PHASE(word)       ((word) & 0xff)
+#define STATE_RESULT(word)      ((word)>>8 & 0xff)
+#define STATE_MOVE_NUM(word)    ((word)>>16 & 0xffff)
+#define STATE_MOVE_ONE          ((uint64_t)1<<16)
+
+/*
+ *  true when disks hold win_len in a row on the batch's geometry
+ */
+static bool
+has_line (const Connect4_t *empty, uint64_t disks)
+{
+    uint64_t lines = 0;
+
+    for (int dir = 0; dir < DIR_NUM; dir++) {
+        uint64_t runs = disks;
+        for (int i = 0; i < empty->win_step_num; i++)
+            runs &= runs>>empty->win_shifts[dir][i];
+        lines |= runs;
+    }
+    return lines != 0;
+}
+
+static int
+drop_scalar (Connect4_batch_t *batch, int begin, const uint8_t *cols, uint8_t *legal)
+{
+    const Connect4_t *empty = &batch->empty;
+    int height = empty->row_num + 1;
+    uint64_t column = ((uint64_t)1<<empty->row_num) - 1;
+    int applied = 0;
+
+    for (int i = begin; i < batch->game_num; i++) {
+        uint64_t state = batch->state[i];
+        int col = cols[i];
+        uint64_t cell = 0;
+
+        if (STATE_PHASE(state) != GAME_OVER && col < empty->col_num) {
+            uint64_t filled = batch->black[i] | batch->white[i];
+            cell = (filled + ((uint64_t)1<<col*height)) & column<<col*height;
+        }
+        if (legal != NULL)
+            legal[i] = cell != 0;
+        if (cell == 0)
+            continue;
+
+        bool white = STATE_PHASE(state) == WHITE_MOVE;
+        uint64_t *disks = white ? &batch->white[i] : &batch->black[i];
+        *disks |= cell;
+
+        uint64_t phase;
+        if (has_line(empty, *disks))
+            phase = GAME_OVER | (uint64_t)(white ? WHITE_WIN : BLACK_WIN)<<8;
+        else if ((batch->black[i] | batch->white[i]) == empty->board_mask)
+            phase = GAME_OVER | (uint64_t)GAME_DRAW<<8;
+        else
+            phase = white ? BLACK_MOVE : WHITE_MOVE;
+        batch->state[i] = ((state & ~(uint64_t)0xffff) + STATE_MOVE_ONE) | phase;
+        applied++;
+    }
+    return applied;
+}
+
+#ifdef CONNECT4_BATCH_X86
+
+/*
+ *  Function name:
+ *      drop_avx2
+ *
+ *  Description:
+ *      connect4_batch_drop for the games up to the last multiple of
+ *      four; lanes without a legal move keep their words as they are
+ *
+ *  Output:
+ *      return  :   number of moves made, *end set to the first game
+ *                  left for the scalar kernel
+ */
+static __attribute__((target("avx2"))) int
+drop_avx2 (Connect4_batch_t *batch, const uint8_t *cols, uint8_t *legal, int *end)
+{
+    const Connect4_t *empty = &batch->empty;
+    int lane_end = batch->game_num - batch->game_num%BATCH_LANE_NUM;
+    int applied = 0;
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i height = _mm256_set1_epi64x(empty->row_num + 1);
+    const __m256i column = _mm256_set1_epi64x(((uint64_t)1<<empty->row_num) - 1);
+    const __m256i col_num = _mm256_set1_epi64x(empty->col_num);
+    const __m256i board_mask = _mm256_set1_epi64x(empty->board_mask);
+    const __m256i phase_mask = _mm256_set1_epi64x(0xff);
+    const __m256i white_move = _mm256_set1_epi64x(WHITE_MOVE);
+    const __m256i game_over = _mm256_set1_epi64x(GAME_OVER);
+    const __m256i black_win = _mm256_set1_epi64x(GAME_OVER | (uint64_t)BLACK_WIN<<8);
+    const __m256i white_win = _mm256_set1_epi64x(GAME_OVER | (uint64_t)WHITE_WIN<<8);
+    const __m256i draw = _mm256_set1_epi64x(GAME_OVER | (uint64_t)GAME_DRAW<<8);
+    const __m256i move_keep = _mm256_set1_epi64x(~(uint64_t)0xffff);
+    const __m256i move_one = _mm256_set1_epi64x(STATE_MOVE_ONE);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m128i shifts[DIR_NUM][CONNECT4_WIN_STEP_MAX];
+    for (int dir = 0; dir < DIR_NUM; dir++)
+        for (int i = 0; i < empty->win_step_num; i++)
+            shifts[dir][i] = _mm_cvtsi32_si128(empty->win_shifts[dir][i]);
+
+    for (int i = 0; i < lane_end; i += BATCH_LANE_NUM) {
+        __m256i black = _mm256_load_si256((const __m256i *)&batch->black[i]);
+        __m256i white = _mm256_load_si256((const __m256i *)&batch->white[i]);
+        __m256i state = _mm256_load_si256((const __m256i *)&batch->state[i]);
+        uint32_t col4;
+        memcpy(&col4, cols + i, sizeof(col4));
+        __m256i col = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(col4));
+
+        // the landing cell, 0 in full columns and for columns off the board
+        __m256i phase = _mm256_and_si256(state, phase_mask);
+        __m256i is_white = _mm256_cmpeq_epi64(phase, white_move);
+        __m256i bottom = _mm256_mul_epu32(col, height);
+        __m256i filled = _mm256_or_si256(black, white);
+        __m256i cell = _mm256_and_si256(
+                            _mm256_add_epi64(filled, _mm256_sllv_epi64(one, bottom)),
+                            _mm256_sllv_epi64(column, bottom));
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi64(phase, game_over),
+                                            _mm256_cmpgt_epi64(col_num, col));
+        ok = _mm256_andnot_si256(_mm256_cmpeq_epi64(cell, zero), ok);
+        cell = _mm256_and_si256(cell, ok);
+
+        black = _mm256_or_si256(black, _mm256_andnot_si256(is_white, cell));
+        white = _mm256_or_si256(white, _mm256_and_si256(is_white, cell));
+
+        __m256i disks = _mm256_blendv_epi8(black, white, is_white);
+        __m256i lines = zero;
+        for (int dir = 0; dir < DIR_NUM; dir++) {
+            __m256i runs = disks;
+            for (int s = 0; s < empty->win_step_num; s++)
+                runs = _mm256_and_si256(runs, _mm256_srl_epi64(runs, shifts[dir][s]));
+            lines = _mm256_or_si256(lines, runs);
+        }
+        __m256i won = _mm256_andnot_si256(_mm256_cmpeq_epi64(lines, zero), ok);
+        __m256i full = _mm256_cmpeq_epi64(_mm256_or_si256(black, white), board_mask);
+
+        // the other side moves, unless the game just ended
+        __m256i next = _mm256_xor_si256(phase, one);
+        next = _mm256_blendv_epi8(next, draw, full);
+        next = _mm256_blendv_epi8(next, _mm256_blendv_epi8(black_win, white_win, is_white), won);
+        next = _mm256_or_si256(_mm256_add_epi64(_mm256_and_si256(state, move_keep), move_one),
+                                next);
+        state = _mm256_blendv_epi8(state, next, ok);
+
+        _mm256_store_si256((__m256i *)&batch->black[i], black);
+        _mm256_store_si256((__m256i *)&batch->white[i], white);
+        _mm256_store_si256((__m256i *)&batch->state[i], state);
+
+        int ok_bits = _mm256_movemask_pd(_mm256_castsi256_pd(ok));
+        if (legal != NULL)
+            for (int lane = 0; lane < BATCH_LANE_NUM; lane++)
+                legal[i + lane] = ok_bits>>lane & 1;
+        applied += __builtin_popcount(ok_bits);
+    }
+
+    *end = lane_end;
+    return applied;
+}
+
+#endif
+
+/*
+ *  true when the CPU runs the AVX2 kernel
+ */
+bool
+connect4_batch_has_avx2 (void)
+{
+#ifdef CONNECT4_BATCH_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+const char *
+connect4_batch_kernel_name (Connect4_batch_kernel_t kernel)
+{
+    return (kernel == CONNECT4_BATCH_AVX2) ? "avx2" : "scalar";
+}
+
+/*
+ *  Function name:
+ *      connect4_batch_init
+ *
+ *  Description:
+ *      allocate game_num games of one geometry, all on the empty board
+ *
+ *  Input:
+ *      batch       :   batch
+ *      game_num    :   number of games
+ *      col_num     :   columns
+ *      row_num     :   rows
+ *      win_len     :   disks in a row that win
+ *
+ *  Output:
+ *      return      :   0 on success, -1 when the board does not fit 64
+ *                      bits or the allocation fails
+ */
+int
+connect4_batch_init (Connect4_batch_t *batch, int game_num,
+                        int col_num, int row_num, int win_len)
+{
+    if (game_num <= 0 || !connect4_valid_geometry(col_num, row_num, win_len))
+        return -1;
+    connect4_new_game(&batch->empty, col_num, row_num, win_len);
+    if (batch->empty.wide)
+        return -1;
+
+    // every array starts on a vector boundary
+    size_t array_size = (size_t)game_num*sizeof(uint64_t);
+    array_size = (array_size + BATCH_ALIGN - 1)/BATCH_ALIGN*BATCH_ALIGN;
+    uint64_t *arrays = aligned_alloc(BATCH_ALIGN, 3*array_size);
+    if (arrays == NULL)
+        return -1;
+
+    batch->game_num = game_num;
+    batch->black = arrays;
+    batch->white = arrays + array_size/sizeof(uint64_t);
+    batch->state = arrays + 2*array_size/sizeof(uint64_t);
+    batch->kernel = connect4_batch_has_avx2() ? CONNECT4_BATCH_AVX2 : CONNECT4_BATCH_SCALAR;
+    connect4_batch_reset(batch);
+    return 0;
+}
+
+void
+connect4_batch_finalize (Connect4_batch_t *batch)
+{
+    free(batch->black);
+    batch->black = batch->white = batch->state = NULL;
+}
+
+/*
+ *  every game back to the empty board
+ */
+void
+connect4_batch_reset (Connect4_batch_t *batch)
+{
+    size_t size = (size_t)batch->game_num*sizeof(uint64_t);
+    memset(batch->black, 0, size);
+    memset(batch->white, 0, size);
+    for (int i = 0; i < batch->game_num; i++)
+        batch->state[i] = BLACK_MOVE;
+}
+
+/*
+ *  Function name:
+ *      connect4_batch_load
+ *
+ *  Description:
+ *      set a game of the batch to the position of an engine game
+ *
+ *  Input:
+ *      batch   :   batch
+ *      index   :   game of the batch
+ *      game    :   position, of the batch's geometry
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the geometry differs
+ */
+int
+connect4_batch_load (Connect4_batch_t *batch, int index, Connect4_t *game)
+{
+    if (game->col_num != batch->empty.col_num || game->row_num != batch->empty.row_num
+            || game->win_len != batch->empty.win_len)
+        return -1;
+
+    Game_state_t state = connect4_get_game_state(game);
+    uint64_t word = state | (uint64_t)connect4_get_move_num(game)<<16;
+    if (state == GAME_OVER)
+        word |= (uint64_t)connect4_get_game_result(game)<<8;
+
+    batch->black[index] = game->black;
+    batch->white[index] = game->white;
+    batch->state[index] = word;
+    return 0;
+}
+
+/*
+ *  Function name:
+ *      connect4_batch_drop
+ *
+ *  Description:
+ *      drop a disk of the side to move into cols[i] in every game i and
+ *      settle wins and draws; an illegal move (full column, column off
+ *      the board or CONNECT4_BATCH_PASS, game over) leaves its game as
+ *      it is
+ *
+ *  Input:
+ *      batch   :   batch
+ *      cols    :   column of every game
+ *      legal   :   1 where the move was made, 0 elsewhere (output,
+ *                  NULL when not needed)
+ *
+ *  Output:
+ *      return  :   number of moves made
+ */
+int
+connect4_batch_drop (Connect4_batch_t *batch, const uint8_t *cols, uint8_t *legal)
+{
+    int applied = 0, begin = 0;
+
+#ifdef CONNECT4_BATCH_X86
+    if (batch->kernel == CONNECT4_BATCH_AVX2)
+        applied = drop_avx2(batch, cols, legal, &begin);
+#endif
+    return applied + drop_scalar(batch, begin, cols, legal);
+}
+
+Game_state_t
+connect4_batch_get_game_state (const Connect4_batch_t *batch, int index)
+{
+    return STATE_PHASE(batch->state[index]);
+}
+
+/*
+ *  meaningful once the game is over
+ */
+Game_result_t
+connect4_batch_get_game_result (const Connect4_batch_t *batch, int index)
+{
+    return STATE_RESULT(batch->state[index]);
+}
+
+int
+connect4_batch_get_move_num (const Connect4_batch_t *batch, int index)
+{
+    return STATE_MOVE_NUM(batch->state[index]);
+}
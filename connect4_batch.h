@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "connect4.h"
+
+/*
+ *  <<Batched games>>
+ *
+ *  Many games of one geometry kept as parallel arrays (struct of
+ *  arrays) instead of one Connect4_t each: black[i], white[i] and
+ *  state[i] are game i. connect4_batch_drop() takes one column per game
+ *  and validates, places and checks every move for a win or a draw in
+ *  the same pass, four games per AVX2 instruction where the CPU has it.
+ *
+ *  The bitboards are the engine's (see connect4.c), so a batch holds
+ *  boards of up to 64 bits only. No move history is kept.
+ *
+ *  state word of a game:
+ *      bits 0-7    Game_state_t
+ *      bits 8-15   Game_result_t, once the state is GAME_OVER
+ *      bits 16-31  number of disks on the board
+ */
+
+// a column of CONNECT4_BATCH_PASS or above is no move for that game
+#define CONNECT4_BATCH_PASS 0xff
+
+typedef enum {
+    CONNECT4_BATCH_SCALAR,
+    CONNECT4_BATCH_AVX2
+} Connect4_batch_kernel_t;
+
+typedef struct Connect4_batch {
+    int game_num;
+    Connect4_t empty;           // geometry, masks and win shifts of every game
+    uint64_t *black, *white;
+    uint64_t *state;
+    Connect4_batch_kernel_t kernel;     // the fastest the CPU runs, may be lowered
+} Connect4_batch_t;
+
+int connect4_batch_init (Connect4_batch_t *batch, int game_num,
+                            int col_num, int row_num, int win_len);
+void connect4_batch_finalize (Connect4_batch_t *batch);
+void connect4_batch_reset (Connect4_batch_t *batch);
+int connect4_batch_load (Connect4_batch_t *batch, int index, Connect4_t *game);
+int connect4_batch_drop (Connect4_batch_t *batch, const uint8_t *cols, uint8_t *legal);
+bool connect4_batch_has_avx2 (void);
+const char *connect4_batch_kernel_name (Connect4_batch_kernel_t kernel);
+Game_state_t connect4_batch_get_game_state (const Connect4_batch_t *batch, int index);
+Game_result_t connect4_batch_get_game_result (const Connect4_batch_t *batch, int index);
+int connect4_batch_get_move_num (const Connect4_batch_t *batch, int index);
@@ -0,0 +1,1084 @@
+/*
+ *  Connect four benchmarks
+ *
+ *  usage: connect4_bench <name> [args ...]
+ *
+ *  Positions are written as the columns played from the empty 7x6
+ *  board, '1' being the leftmost column.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "connect4.h"
+#include "connect4_solve.h"
+#include "connect4_book.h"
+#include "connect4_proto.h"
+#include "connect4_fanout.h"
+#include "connect4_batch.h"
+#include "connect4_mcts.h"
+#include "connect4_util.h"
+
+#define BOARD_ROW_NUM 6
+#define BOARD_COL_NUM 7
+#define WIN_SAMPLE_GAMES 2000
+#define WIN_REPEAT_NUM 500
+#define PARALLEL_THREAD_MAX 16
+#define BOOK_LOOKUP_NUM 1000000
+#define GEOMETRY_GAMES 20000
+#define GEOMETRY_ROUNDS 20
+#define SPECTATOR_MAX 10000
+#define SPECTATOR_SEND_NUM 200000   // sends per measurement, spread over the moves
+#define SPECTATOR_CHUNK 64          // moves between drains, fits a socket buffer
+#define SPECTATOR_BATCH 8           // moves per flush in the batched run
+#define BATCH_GAMES 4096
+#define BATCH_STEPS 48              // moves tried per game, past the end of most
+#define BATCH_ROUNDS 20
+#define MCTS_BUDGET_MS 1000
+#define MCTS_THREAD_MAX 8
+
+typedef struct Bench {
+    const char *name;
+    const char *help;
+    int (*run)(int argc, char **argv);
+} Bench_t;
+
+// positions of the solver suite, from end game to opening
+static const char *SOLVE_SUITE[] = {
+    // end game (26-30 disks)
+    "113156767174654637775254221552",
+    "711115356477166576747262262133",
+    "476414247572432736766271623611",
+    "25667371256266156324477332",
+    "32351724454561135752712157",
+    "74644722641445163225725261",
+    // middle game (16-20 disks)
+    "53626766426427327534",
+    "17171753333565254113",
+    "55754427145277537176",
+    "4264277617257714",
+    "2166617361571774",
+    // opening (9-12 disks)
+    "745543676427",
+    "636326733532",
+    "532636766247",
+    "336425144",
+    "265561146",
+};
+
+#define SOLVE_SUITE_NUM (sizeof(SOLVE_SUITE)/sizeof(SOLVE_SUITE[0]))
+
+/*
+ *  play a sequence of columns; return -1 when a move is illegal
+ */
+static int
+setup_game (Connect4_t *game, const char *moves)
+{
+    new_game(game, BOARD_COL_NUM, BOARD_ROW_NUM);
+
+    for (const char *p = moves; *p != '\0'; p++) {
+        if (connect4_drop(game, *p - '1') < 0)
+            return -1;
+        if (connect4_get_game_state(game) == GAME_OVER)
+            return -1;
+    }
+    return 0;
+}
+
+// --------------------------------------------------
+// <Solver>
+
+static int
+bench_solve (int argc, char **argv)
+{
+    Connect4_solver_t solver;
+    uint64_t total_nodes = 0;
+    double total_sec = 0;
+    size_t tt_bytes = CONNECT4_SOLVER_TT_DEFAULT;
+
+    if (argc >= 2)
+        tt_bytes = strtoull(argv[1], NULL, 10)<<20;
+    if (connect4_solver_init(&solver, tt_bytes) < 0) {
+        perror("connect4_solver_init");
+        return 1;
+    }
+
+    printf("%-40s %6s %4s %12s %10s %12s\n",
+            "position", "score", "col", "nodes", "time[ms]", "pos/s");
+
+    for (size_t i = 0; i < SOLVE_SUITE_NUM; i++) {
+        Connect4_t game;
+        Connect4_solve_result_t result;
+
+        if (setup_game(&game, SOLVE_SUITE[i]) < 0) {
+            printf("%-40s invalid position\n", SOLVE_SUITE[i]);
+            continue;
+        }
+
+        uint64_t nodes = solver.node_count;
+        double start = connect4_now_sec();
+        connect4_solve(&solver, &game, &result);
+        double sec = connect4_now_sec() - start;
+        nodes = solver.node_count - nodes;
+
+        printf("%-40s %6d %4d %12llu %10.3f %12.0f\n",
+                SOLVE_SUITE[i], result.score, result.col + 1,
+                (unsigned long long)nodes, sec*1e3, nodes/sec);
+
+        total_nodes += nodes;
+        total_sec += sec;
+    }
+
+    printf("\n%zu positions, %.3f s total, %.3f ms mean, %.0f pos/s\n",
+            SOLVE_SUITE_NUM, total_sec, total_sec*1e3/SOLVE_SUITE_NUM,
+            total_nodes/total_sec);
+
+    Connect4_tt_stats_t *stats = &solver.tt_stats;
+    printf("tt %zu KiB: %llu probes, %.1f%% hit, %llu stores, %llu replacements\n",
+            connect4_tt_size(&solver.tt)>>10,
+            (unsigned long long)stats->probes,
+            stats->probes ? 100.0*stats->hits/stats->probes : 0.0,
+            (unsigned long long)stats->stores,
+            (unsigned long long)stats->replacements);
+
+    connect4_solver_finalize(&solver);
+    return 0;
+}
+
+/*
+ *  solve the whole suite with a fresh solver (empty table) using
+ *  thread_num threads; scores are written to scores[]
+ */
+static int
+solve_suite (int thread_num, size_t tt_bytes, int *scores,
+                double *sec, uint64_t *nodes)
+{
+    Connect4_solver_t solver;
+
+    if (connect4_solver_init(&solver, tt_bytes) < 0) {
+        perror("connect4_solver_init");
+        return -1;
+    }
+    connect4_solver_set_thread_num(&solver, thread_num);
+
+    *sec = 0;
+    for (size_t i = 0; i < SOLVE_SUITE_NUM; i++) {
+        Connect4_t game;
+        Connect4_solve_result_t result;
+
+        scores[i] = 0;
+        if (setup_game(&game, SOLVE_SUITE[i]) < 0)
+            continue;
+
+        double start = connect4_now_sec();
+        connect4_solve(&solver, &game, &result);
+        *sec += connect4_now_sec() - start;
+        scores[i] = result.score;
+    }
+
+    *nodes = solver.node_count;
+    connect4_solver_finalize(&solver);
+    return 0;
+}
+
+static int
+bench_parallel (int argc, char **argv)
+{
+    int thread_max = PARALLEL_THREAD_MAX;
+    size_t tt_bytes = CONNECT4_SOLVER_TT_DEFAULT;
+    int base_scores[SOLVE_SUITE_NUM], scores[SOLVE_SUITE_NUM];
+    double base_sec = 0;
+    int mismatch = 0;
+
+    if (argc >= 2)
+        thread_max = atoi(argv[1]);
+    if (argc >= 3)
+        tt_bytes = strtoull(argv[2], NULL, 10)<<20;
+
+    printf("%8s %10s %14s %12s %8s\n",
+            "threads", "time[s]", "nodes", "pos/s", "speedup");
+
+    for (int thread_num = 1; thread_num <= thread_max; thread_num *= 2) {
+        double sec;
+        uint64_t nodes;
+
+        if (solve_suite(thread_num, tt_bytes,
+                    thread_num == 1 ? base_scores : scores, &sec, &nodes) < 0)
+            return 1;
+
+        if (thread_num == 1)
+            base_sec = sec;
+        else
+            for (size_t i = 0; i < SOLVE_SUITE_NUM; i++)
+                mismatch += (scores[i] != base_scores[i]);
+
+        printf("%8d %10.3f %14llu %12.0f %7.2fx\n",
+                thread_num, sec, (unsigned long long)nodes,
+                nodes/sec, base_sec/sec);
+    }
+
+    printf("%d score mismatches against 1 thread\n", mismatch);
+    return mismatch != 0;
+}
+
+/*
+ *  play random moves up to ply plies; return -1 when the game ends first
+ */
+static int
+random_game (Connect4_t *game, int col_num, int row_num, int ply, uint64_t *seed)
+{
+    new_game(game, col_num, row_num);
+    while (connect4_get_move_num(game) < ply) {
+        if (connect4_get_game_state(game) == GAME_OVER)
+            return -1;
+        connect4_drop(game, connect4_rand_next(seed)%col_num);
+    }
+    return connect4_get_game_state(game) == GAME_OVER ? -1 : 0;
+}
+
+static int
+bench_book (int argc, char **argv)
+{
+    Connect4_book_t book;
+    int verify_num = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "book: path required\n");
+        return 1;
+    }
+    if (argc >= 3)
+        verify_num = atoi(argv[2]);
+
+    double start = connect4_now_sec();
+    if (connect4_book_open(&book, argv[1]) < 0)
+        return 1;
+    double open_sec = connect4_now_sec() - start;
+    printf("%s: %dx%d, %d plies, %llu entries, opened in %.1f us\n",
+            argv[1], book.col_num, book.row_num, book.depth,
+            (unsigned long long)book.entry_num, open_sec*1e6);
+
+    // random positions within the book; a lookup of every one must hit
+    enum { GAME_NUM = 4096 };
+    static Connect4_t games[GAME_NUM];
+    uint64_t seed = 88172645463325252ULL;
+    for (int i = 0; i < GAME_NUM; i++)
+        while (random_game(&games[i], book.col_num, book.row_num,
+                    connect4_rand_next(&seed)%(book.depth + 1), &seed) < 0)
+            ;
+
+    size_t miss = 0;
+    long checksum = 0;
+    start = connect4_now_sec();
+    for (int i = 0; i < BOOK_LOOKUP_NUM; i++) {
+        int col, score;
+        if (connect4_book_lookup(&book, &games[i%GAME_NUM], &col, &score))
+            checksum += score;
+        else
+            miss++;
+    }
+    double sec = connect4_now_sec() - start;
+    printf("%d lookups, %zu misses, %.1f ns/lookup (checksum %ld)\n",
+            BOOK_LOOKUP_NUM, miss, sec*1e9/BOOK_LOOKUP_NUM, checksum);
+
+    // the book must agree with the solver
+    int mismatch = 0;
+    if (verify_num > 0) {
+        Connect4_solver_t solver;
+        if (connect4_solver_init(&solver, CONNECT4_SOLVER_TT_DEFAULT) < 0) {
+            perror("connect4_solver_init");
+            connect4_book_close(&book);
+            return 1;
+        }
+
+        for (int i = 0; i < verify_num && i < GAME_NUM; i++) {
+            int col, score;
+            Connect4_solve_result_t result;
+            connect4_book_lookup(&book, &games[i], &col, &score);
+            connect4_solve(&solver, &games[i], &result);
+
+            // the column may differ, but it must keep the score
+            Connect4_t child = games[i];
+            connect4_drop(&child, col);
+            Connect4_solve_result_t reply = {.score = -score};
+            if (connect4_get_game_state(&child) != GAME_OVER)
+                connect4_solve(&solver, &child, &reply);
+            else if (connect4_get_game_result(&child) == GAME_DRAW)
+                reply.score = 0;
+            mismatch += (score != result.score || -reply.score != score);
+        }
+        printf("%d positions verified against the solver, %d mismatches\n",
+                verify_num < GAME_NUM ? verify_num : GAME_NUM, mismatch);
+        connect4_solver_finalize(&solver);
+    }
+
+    connect4_book_close(&book);
+    return miss != 0 || mismatch != 0;
+}
+
+// </Solver>
+// --------------------------------------------------
+// <Win detection>
+
+typedef struct Win_sample {
+    Connect4_t game;            // position right after the move
+    Cell_state_t color;         // color of the moved disk
+    int row, col;               // the moved disk
+    uint64_t disks;             // disks of the color, row-major
+} Win_sample_t;
+
+/*
+ *  the per-direction loops connect4_check_win() used before, with the
+ *  line length and the '/' column direction corrected so that both
+ *  implementations must agree on every sample
+ */
+static bool
+loop_check_win (uint64_t disks, int col_num, int row_num, int row, int col)
+{
+    const int connection_num = 4;
+    uint64_t mask = (uint64_t)1<<(row * col_num + col);
+    uint64_t mask_temp;
+    int count;
+
+    // Horizontal
+    count = 1;
+    mask_temp = mask;
+    for (int col_l = col - 1; 0 <= col_l && (disks & (mask_temp >>= 1)); col_l--)
+        count++;
+    mask_temp = mask;
+    for (int col_r = col + 1; col_r < col_num && (disks & (mask_temp <<= 1)); col_r++)
+        count++;
+    if (count >= connection_num)
+        return true;
+
+    // Vertical
+    uint64_t tmp = disks & disks>>(2 * col_num);
+    if (tmp & tmp>>col_num)
+        return true;
+
+    // Diagonal (/)
+    count = 1;
+    mask_temp = mask;
+    for (int row_u = row - 1, col_r = col + 1;
+            0 <= row_u && col_r < col_num && (disks & (mask_temp >>= col_num - 1));
+            row_u--, col_r++)
+        count++;
+    mask_temp = mask;
+    for (int row_d = row + 1, col_l = col - 1;
+            row_d < row_num && 0 <= col_l && (disks & (mask_temp <<= col_num - 1));
+            row_d++, col_l--)
+        count++;
+    if (count >= connection_num)
+        return true;
+
+    // Diagonal (\)
+    count = 1;
+    mask_temp = mask;
+    for (int row_u = row - 1, col_l = col - 1;
+            0 <= row_u && 0 <= col_l && (disks & (mask_temp >>= col_num + 1));
+            row_u--, col_l--)
+        count++;
+    mask_temp = mask;
+    for (int row_d = row + 1, col_r = col + 1;
+            row_d < row_num && col_r < col_num && (disks & (mask_temp <<= col_num + 1));
+            row_d++, col_r++)
+        count++;
+    if (count >= connection_num)
+        return true;
+
+    return false;
+}
+
+/*
+ *  record every move of random games until one side wins or the board
+ *  is full
+ */
+static size_t
+make_win_samples (Win_sample_t *samples, size_t max_num, uint64_t seed)
+{
+    size_t num = 0;
+
+    for (int g = 0; g < WIN_SAMPLE_GAMES && num < max_num; g++) {
+        Connect4_t game;
+        new_game(&game, BOARD_COL_NUM, BOARD_ROW_NUM);
+
+        while (connect4_get_game_state(&game) != GAME_OVER && num < max_num) {
+            int col = connect4_rand_next(&seed)%game.col_num;
+            Cell_state_t color =
+                (connect4_get_game_state(&game) == BLACK_MOVE) ? CELL_BLACK : CELL_WHITE;
+            int row = connect4_drop(&game, col);
+            if (row < 0)
+                continue;
+
+            Win_sample_t *sample = &samples[num++];
+            sample->game = game;
+            sample->color = color;
+            sample->row = row;
+            sample->col = col;
+            sample->disks = 0;
+            for (int r = 0; r < game.row_num; r++)
+                for (int c = 0; c < game.col_num; c++)
+                    if (connect4_get_cell_state(&game, r, c) == color)
+                        sample->disks |= (uint64_t)1<<(r*game.col_num + c);
+        }
+    }
+
+    return num;
+}
+
+static int
+bench_win (int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    size_t max_num = (size_t)WIN_SAMPLE_GAMES*BOARD_COL_NUM*BOARD_ROW_NUM;
+    Win_sample_t *samples = malloc(max_num*sizeof(Win_sample_t));
+    if (samples == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    size_t num = make_win_samples(samples, max_num, 88172645463325252ULL);
+
+    size_t mismatch = 0, wins = 0;
+    for (size_t i = 0; i < num; i++) {
+        Win_sample_t *sample = &samples[i];
+        bool a = loop_check_win(sample->disks, sample->game.col_num,
+                        sample->game.row_num, sample->row, sample->col);
+        bool b = connect4_check_win(&sample->game, sample->color);
+        wins += b;
+        mismatch += (a != b);
+    }
+
+    size_t count = 0;
+    double start = connect4_now_sec();
+    for (int rep = 0; rep < WIN_REPEAT_NUM; rep++)
+        for (size_t i = 0; i < num; i++)
+            count += loop_check_win(samples[i].disks, samples[i].game.col_num,
+                        samples[i].game.row_num, samples[i].row, samples[i].col);
+    double loop_sec = connect4_now_sec() - start;
+
+    start = connect4_now_sec();
+    for (int rep = 0; rep < WIN_REPEAT_NUM; rep++)
+        for (size_t i = 0; i < num; i++)
+            count += connect4_check_win(&samples[i].game, samples[i].color);
+    double mask_sec = connect4_now_sec() - start;
+
+    double checks = (double)num*WIN_REPEAT_NUM;
+    printf("%zu positions from random games, %zu wins, %zu mismatches\n",
+            num, wins, mismatch);
+    printf("%-16s %10.2f ns/check\n", "loops", loop_sec*1e9/checks);
+    printf("%-16s %10.2f ns/check\n", "shift and mask", mask_sec*1e9/checks);
+    printf("speedup %.2fx (checksum %zu)\n", loop_sec/mask_sec, count);
+
+    free(samples);
+    return mismatch != 0;
+}
+
+static const struct {
+    int col_num, row_num, win_len;
+} GEOMETRIES[] = {
+    {7, 6, 4}, {6, 5, 4}, {8, 7, 4}, {9, 6, 4}, {9, 6, 5}, {10, 5, 4},
+    {12, 4, 3}, {16, 3, 3}, {6, 9, 6}, {4, 15, 8}, {32, 1, 15},
+    // over 64 bits with the sentinels
+    {9, 7, 4}, {10, 8, 4}, {12, 9, 4}, {12, 9, 5}, {16, 7, 4}, {8, 15, 8}, {64, 1, 15},
+};
+
+#define GEOMETRY_NUM (sizeof(GEOMETRIES)/sizeof(GEOMETRIES[0]))
+
+/*
+ *  win_len in a row anywhere, cell by cell
+ */
+static bool
+scan_check_win (Connect4_t *game, Cell_state_t color)
+{
+    static const int STEPS[DIR_NUM][2] = {{0, 1}, {1, 0}, {1, 1}, {-1, 1}};
+
+    for (int row = 0; row < game->row_num; row++)
+        for (int col = 0; col < game->col_num; col++)
+            for (int dir = 0; dir < DIR_NUM; dir++) {
+                int len = 0;
+                int r = row, c = col;
+                while (0 <= r && r < game->row_num && c < game->col_num
+                        && connect4_get_cell_state(game, r, c) == color) {
+                    len++;
+                    r += STEPS[dir][0];
+                    c += STEPS[dir][1];
+                }
+                if (len >= game->win_len)
+                    return true;
+            }
+    return false;
+}
+
+/*
+ *  Function name:
+ *      bench_geometry
+ *
+ *  Description:
+ *      replay the same number of random games on boards of other sizes
+ *      and win lengths; every move is checked against a cell by cell
+ *      scan first, the replay is timed per move (best of
+ *      GEOMETRY_ROUNDS)
+ */
+static int
+bench_geometry (int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    uint8_t (*games)[CONNECT4_HISTORY_MAX] = malloc(GEOMETRY_GAMES*sizeof(*games));
+    int *lens = malloc(GEOMETRY_GAMES*sizeof(int));
+    uint64_t seed = 88172645463325252ULL;
+    size_t mismatch_total = 0;
+
+    if (games == NULL || lens == NULL) {
+        perror("malloc");
+        free(games);
+        free(lens);
+        return 1;
+    }
+
+    printf("%-10s %5s %8s %10s %12s\n", "geometry", "bits", "moves", "ns/move", "mismatches");
+    for (size_t g = 0; g < GEOMETRY_NUM; g++) {
+        int col_num = GEOMETRIES[g].col_num, row_num = GEOMETRIES[g].row_num;
+        int win_len = GEOMETRIES[g].win_len;
+        size_t move_total = 0, mismatch = 0;
+
+        for (int i = 0; i < GEOMETRY_GAMES; i++) {
+            Connect4_t game;
+            connect4_new_game(&game, col_num, row_num, win_len);
+            while (connect4_get_game_state(&game) != GAME_OVER) {
+                Cell_state_t color = (connect4_get_game_state(&game) == BLACK_MOVE)
+                                        ? CELL_BLACK : CELL_WHITE;
+                if (connect4_drop(&game, connect4_rand_next(&seed)%col_num) < 0)
+                    continue;
+                mismatch += connect4_check_win(&game, color) != scan_check_win(&game, color);
+            }
+            lens[i] = connect4_get_move_num(&game);
+            for (int m = 0; m < lens[i]; m++)
+                games[i][m] = connect4_get_move_col(&game, m);
+            move_total += lens[i];
+        }
+
+        // the best of a few rounds, the others caught a busy machine
+        int over = 0;
+        double sec = 0;
+        for (int round = 0; round < GEOMETRY_ROUNDS; round++) {
+            double start = connect4_now_sec();
+            for (int i = 0; i < GEOMETRY_GAMES; i++) {
+                Connect4_t game;
+                connect4_new_game(&game, col_num, row_num, win_len);
+                for (int m = 0; m < lens[i]; m++)
+                    connect4_drop(&game, games[i][m]);
+                over += connect4_get_game_state(&game) == GAME_OVER;
+            }
+            double round_sec = connect4_now_sec() - start;
+            if (round == 0 || round_sec < sec)
+                sec = round_sec;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "%dx%d/%d", col_num, row_num, win_len);
+        printf("%-10s %5d %8.1f %10.2f %12zu%s\n", name,
+                (col_num*(row_num + 1) > 64) ? CONNECT4_BITS_MAX : 64,
+                (double)move_total/GEOMETRY_GAMES,
+                sec*1e9/move_total, mismatch,
+                (over == GEOMETRY_ROUNDS*GEOMETRY_GAMES) ? "" : " (replay diverged)");
+        mismatch_total += mismatch + (over != GEOMETRY_ROUNDS*GEOMETRY_GAMES);
+    }
+
+    free(games);
+    free(lens);
+    return mismatch_total != 0;
+}
+
+// </Win detection>
+// --------------------------------------------------
+// <Spectator fan-out>
+
+static int
+spectator_fd_limit (int want)
+{
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) < 0) {
+        perror("getrlimit");
+        return 0;
+    }
+    if (lim.rlim_cur < (rlim_t)want) {
+        lim.rlim_cur = (lim.rlim_max < (rlim_t)want) ? lim.rlim_max : (rlim_t)want;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        getrlimit(RLIMIT_NOFILE, &lim);
+    }
+    return lim.rlim_cur;
+}
+
+static void
+drain_spectators (int num, const int *recv_fds)
+{
+    char buf[4096];
+    for (int i = 0; i < num; i++)
+        while (read(recv_fds[i], buf, sizeof(buf)) > 0)
+            ;
+}
+
+/*
+ *  Function name:
+ *      fan_out_run
+ *
+ *  Description:
+ *      send move_num DELTAs to every spectator socket and return the
+ *      seconds taken; batch 0 encodes and sends a copy per spectator,
+ *      otherwise each move is encoded once into a shared buffer and
+ *      the queues are flushed every batch moves
+ *
+ *  Input:
+ *      num         :   number of spectators
+ *      send_fds    :   server side of every spectator
+ *      queues      :   a queue per spectator
+ *      first_seq   :   seq of the first move
+ *      move_num    :   moves to send, at most SPECTATOR_CHUNK
+ *      batch       :   moves per flush, 0 for a copy per spectator
+ *
+ *  Output:
+ *      return      :   seconds, negative when a send failed
+ */
+static double
+fan_out_run (int num, const int *send_fds, Connect4_out_queue_t *queues,
+                int first_seq, int move_num, int batch)
+{
+    double start = connect4_now_sec();
+
+    for (int seq = first_seq; seq < first_seq + move_num; seq++) {
+        Connect4_msg_t msg = {
+            .type = CONNECT4_MSG_DELTA,
+            .seq = seq,
+            .bit = seq%(BOARD_COL_NUM*(BOARD_ROW_NUM + 1))
+        };
+
+        if (batch == 0) {
+            for (int i = 0; i < num; i++) {
+                uint8_t buf[CONNECT4_MSG_MAX];
+                int len = connect4_encode_msg(CONNECT4_PROTO_BINARY, &msg, buf, sizeof(buf));
+                if (send(send_fds[i], buf, len, MSG_NOSIGNAL) != len)
+                    return -1;
+            }
+            continue;
+        }
+
+        uint8_t buf[CONNECT4_MSG_MAX];
+        int len = connect4_encode_msg(CONNECT4_PROTO_BINARY, &msg, buf, sizeof(buf));
+        Connect4_shared_buf_t *delta = connect4_shared_buf_new(buf, len);
+        if (delta == NULL)
+            return -1;
+        for (int i = 0; i < num; i++)
+            connect4_out_queue_push(&queues[i], delta);
+        connect4_shared_buf_unref(delta);
+
+        if ((seq + 1 - first_seq)%batch != 0 && seq + 1 != first_seq + move_num)
+            continue;
+        for (int i = 0; i < num; i++)
+            if (connect4_out_queue_flush(&queues[i], send_fds[i]) < 0
+                    || !connect4_out_queue_empty(&queues[i]))
+                return -1;
+    }
+
+    return connect4_now_sec() - start;
+}
+
+static int
+bench_spectators (int argc, char **argv)
+{
+    int max_num = SPECTATOR_MAX;
+    if (argc >= 2)
+        max_num = strtol(argv[1], NULL, 10);
+
+    // both ends of every socket pair
+    int fd_limit = spectator_fd_limit(2*max_num + 16);
+    if (2*max_num + 16 > fd_limit) {
+        max_num = (fd_limit - 16)/2;
+        printf("limited to %d spectators by RLIMIT_NOFILE\n", max_num);
+    }
+
+    int *send_fds = malloc(max_num*sizeof(int));
+    int *recv_fds = malloc(max_num*sizeof(int));
+    Connect4_out_queue_t *queues = malloc(max_num*sizeof(Connect4_out_queue_t));
+    if (send_fds == NULL || recv_fds == NULL || queues == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("DELTA to every spectator over AF_UNIX socket pairs\n");
+    printf("%11s %6s %14s %14s %14s %12s\n", "spectators", "moves",
+            "copy[us/move]", "shared[us/mv]", "batched[us/mv]", "shared[ns/sp]");
+
+    int num = 0, ret = 0;
+    // 1, 10, 100 ... and max_num last
+    for (int target = 1; target <= max_num; ) {
+        for (; num < target; num++) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) {
+                perror("socketpair");
+                ret = 1;
+                break;
+            }
+            send_fds[num] = sv[0];
+            recv_fds[num] = sv[1];
+            connect4_out_queue_init(&queues[num]);
+        }
+        if (ret != 0)
+            break;
+
+        // the receivers are drained between runs; a run fits in their buffers
+        int move_num = SPECTATOR_SEND_NUM/num;
+        if (move_num > 1000)
+            move_num = 1000;
+        if (move_num < 20)
+            move_num = 20;
+
+        double sec[3] = {0};
+        int batches[3] = {0, 1, SPECTATOR_BATCH};
+        for (int b = 0; b < 3 && ret == 0; b++) {
+            for (int seq = 0; seq < move_num; seq += SPECTATOR_CHUNK) {
+                int chunk = (move_num - seq < SPECTATOR_CHUNK) ? move_num - seq : SPECTATOR_CHUNK;
+                double chunk_sec = fan_out_run(num, send_fds, queues, seq, chunk, batches[b]);
+                // not timed
+                drain_spectators(num, recv_fds);
+                if (chunk_sec < 0) {
+                    perror("send");
+                    ret = 1;
+                    break;
+                }
+                sec[b] += chunk_sec;
+            }
+        }
+        if (ret != 0)
+            break;
+
+        printf("%11d %6d %14.2f %14.2f %14.2f %12.1f\n", num, move_num,
+                sec[0]*1e6/move_num, sec[1]*1e6/move_num, sec[2]*1e6/move_num,
+                sec[1]*1e9/move_num/num);
+
+        if (target == max_num)
+            break;
+        target = (target*10 < max_num) ? target*10 : max_num;
+    }
+
+    for (int i = 0; i < num; i++) {
+        connect4_out_queue_clear(&queues[i]);
+        close(send_fds[i]);
+        close(recv_fds[i]);
+    }
+    free(send_fds);
+    free(recv_fds);
+    free(queues);
+    return ret;
+}
+
+// </Spectator fan-out>
+// --------------------------------------------------
+// <Batched games>
+
+/*
+ *  Function name:
+ *      batch_run
+ *
+ *  Description:
+ *      play every step of cols from the empty boards and return the
+ *      seconds taken; games is NULL for the batch, batch NULL for one
+ *      connect4_drop() per game
+ */
+static double
+batch_run (Connect4_batch_t *batch, Connect4_t *games, int game_num,
+            const uint8_t *cols, size_t *applied)
+{
+    double start = connect4_now_sec();
+    *applied = 0;
+
+    if (games == NULL) {
+        connect4_batch_reset(batch);
+        for (int step = 0; step < BATCH_STEPS; step++)
+            *applied += connect4_batch_drop(batch, cols + (size_t)step*game_num, NULL);
+    }
+    else {
+        for (int i = 0; i < game_num; i++)
+            new_game(&games[i], BOARD_COL_NUM, BOARD_ROW_NUM);
+        for (int step = 0; step < BATCH_STEPS; step++)
+            for (int i = 0; i < game_num; i++)
+                *applied += connect4_drop(&games[i], cols[(size_t)step*game_num + i]) >= 0;
+    }
+    return connect4_now_sec() - start;
+}
+
+/*
+ *  games of the batch that differ from the engine's
+ */
+static int
+batch_mismatches (const Connect4_batch_t *batch, Connect4_t *games)
+{
+    int mismatch = 0;
+
+    for (int i = 0; i < batch->game_num; i++) {
+        Game_state_t state = connect4_get_game_state(&games[i]);
+        mismatch += batch->black[i] != games[i].black || batch->white[i] != games[i].white
+                    || connect4_batch_get_game_state(batch, i) != state
+                    || connect4_batch_get_move_num(batch, i) != connect4_get_move_num(&games[i])
+                    || (state == GAME_OVER && connect4_batch_get_game_result(batch, i)
+                                                != connect4_get_game_result(&games[i]));
+    }
+    return mismatch;
+}
+
+/*
+ *  Function name:
+ *      bench_batch
+ *
+ *  Description:
+ *      try BATCH_STEPS random columns (one in eight off the board) in
+ *      every game, with connect4_drop() game by game and with the batch
+ *      kernels; every kernel must end with the engine's positions
+ */
+static int
+bench_batch (int argc, char **argv)
+{
+    int game_num = BATCH_GAMES;
+    if (argc >= 2)
+        game_num = strtol(argv[1], NULL, 10);
+    if (game_num <= 0)
+        return 1;
+
+    Connect4_batch_t batch;
+    if (connect4_batch_init(&batch, game_num, BOARD_COL_NUM, BOARD_ROW_NUM,
+                            CONNECT4_WIN_LEN) < 0) {
+        perror("connect4_batch_init");
+        return 1;
+    }
+    Connect4_t *games = malloc(game_num*sizeof(Connect4_t));
+    uint8_t *cols = malloc((size_t)BATCH_STEPS*game_num);
+    if (games == NULL || cols == NULL) {
+        perror("malloc");
+        connect4_batch_finalize(&batch);
+        free(games);
+        free(cols);
+        return 1;
+    }
+
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < (size_t)BATCH_STEPS*game_num; i++)
+        cols[i] = connect4_rand_next(&seed)%(BOARD_COL_NUM + 1);
+
+    Connect4_batch_kernel_t kernels[] = {CONNECT4_BATCH_SCALAR, CONNECT4_BATCH_AVX2};
+    int kernel_num = connect4_batch_has_avx2() ? 2 : 1;
+    double tries = (double)BATCH_STEPS*game_num;
+    double engine_sec = 0;
+    size_t engine_applied = 0;
+    int mismatch = 0;
+
+    printf("%d games, %d columns tried in each\n", game_num, BATCH_STEPS);
+    printf("%-14s %10s %14s %10s %12s\n", "", "ns/try", "Mtries/s", "speedup", "mismatches");
+    for (int round = 0; round < BATCH_ROUNDS; round++) {
+        double sec = batch_run(NULL, games, game_num, cols, &engine_applied);
+        if (round == 0 || sec < engine_sec)
+            engine_sec = sec;
+    }
+    printf("%-14s %10.2f %14.1f %10s %12s\n", "engine", engine_sec*1e9/tries,
+            tries/engine_sec*1e-6, "1.00x", "-");
+
+    for (int k = 0; k < kernel_num; k++) {
+        double sec = 0;
+        size_t applied = 0;
+        batch.kernel = kernels[k];
+        for (int round = 0; round < BATCH_ROUNDS; round++) {
+            double round_sec = batch_run(&batch, NULL, game_num, cols, &applied);
+            if (round == 0 || round_sec < sec)
+                sec = round_sec;
+        }
+        // the batch holds the positions of its last round
+        int kernel_mismatch = batch_mismatches(&batch, games) + (applied != engine_applied);
+        char name[32];
+        snprintf(name, sizeof(name), "batch %s", connect4_batch_kernel_name(kernels[k]));
+        printf("%-14s %10.2f %14.1f %9.2fx %12d\n", name, sec*1e9/tries,
+                tries/sec*1e-6, engine_sec/sec, kernel_mismatch);
+        mismatch += kernel_mismatch;
+    }
+    printf("%zu of %.0f moves legal\n", engine_applied, tries);
+
+    connect4_batch_finalize(&batch);
+    free(games);
+    free(cols);
+    return mismatch != 0;
+}
+
+// </Batched games>
+// --------------------------------------------------
+
+// --------------------------------------------------
+// <Monte Carlo tree search>
+
+static const struct {
+    int col_num, row_num, win_len;
+} MCTS_GEOMETRIES[] = {
+    {7, 6, 4}, {9, 6, 5}, {10, 8, 4}, {12, 9, 4},
+};
+
+#define MCTS_GEOMETRY_NUM (sizeof(MCTS_GEOMETRIES)/sizeof(MCTS_GEOMETRIES[0]))
+
+static int
+sign (int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+/*
+ *  Function name:
+ *      mcts_suite
+ *
+ *  Description:
+ *      search every position of the solver suite and count the columns
+ *      that keep the solver's result (win, draw or loss) of the position
+ *
+ *  Output:
+ *      return  :   positions where the search loses the result, -1 on error
+ */
+static int
+mcts_suite (Connect4_mcts_t *mcts, double budget_sec)
+{
+    Connect4_solver_t solver;
+    int lost = 0;
+
+    if (connect4_solver_init(&solver, CONNECT4_SOLVER_TT_DEFAULT) < 0) {
+        perror("connect4_solver_init");
+        return -1;
+    }
+
+    printf("%-32s %6s %6s %8s\n", "position", "solver", "mcts", "result");
+    for (size_t i = 0; i < SOLVE_SUITE_NUM; i++) {
+        Connect4_t game;
+        Connect4_solve_result_t best, reply;
+        Connect4_mcts_result_t result;
+
+        if (setup_game(&game, SOLVE_SUITE[i]) < 0)
+            continue;
+        connect4_solve(&solver, &game, &best);
+        connect4_mcts_search(mcts, &game, budget_sec, &result);
+
+        // the result of the search's column, from the side to move
+        connect4_drop(&game, result.col);
+        int outcome = 1;
+        if (connect4_get_game_state(&game) != GAME_OVER) {
+            connect4_solve(&solver, &game, &reply);
+            outcome = -sign(reply.score);
+        }
+        else if (connect4_get_game_result(&game) == GAME_DRAW)
+            outcome = 0;
+
+        bool kept = outcome == sign(best.score);
+        lost += !kept;
+        printf("%-32s %6d %6d %8s\n", SOLVE_SUITE[i], best.col + 1, result.col + 1,
+                kept ? "kept" : "lost");
+    }
+
+    connect4_solver_finalize(&solver);
+    return lost;
+}
+
+/*
+ *  Function name:
+ *      bench_mcts
+ *
+ *  Description:
+ *      playouts per second from the empty board of several geometries
+ *      with 1, 2, 4 ... threads on one tree, then the 7x6 suite against
+ *      the solver
+ */
+static int
+bench_mcts (int argc, char **argv)
+{
+    int budget_ms = MCTS_BUDGET_MS;
+    int thread_max = MCTS_THREAD_MAX;
+    if (argc >= 2)
+        budget_ms = atoi(argv[1]);
+    if (argc >= 3)
+        thread_max = atoi(argv[2]);
+    if (budget_ms <= 0 || thread_max <= 0)
+        return 1;
+
+    Connect4_mcts_t mcts;
+    if (connect4_mcts_init(&mcts, CONNECT4_MCTS_NODE_DEFAULT) < 0) {
+        perror("connect4_mcts_init");
+        return 1;
+    }
+
+    printf("%-10s %8s %12s %12s %10s %8s %6s %8s\n", "board", "threads", "playouts",
+            "playouts/s", "nodes", "speedup", "col", "win");
+    for (size_t g = 0; g < MCTS_GEOMETRY_NUM; g++) {
+        Connect4_t game;
+        char name[32];
+        double base_rate = 0;
+
+        connect4_new_game(&game, MCTS_GEOMETRIES[g].col_num, MCTS_GEOMETRIES[g].row_num,
+                            MCTS_GEOMETRIES[g].win_len);
+        snprintf(name, sizeof(name), "%dx%d/%d", MCTS_GEOMETRIES[g].col_num,
+                    MCTS_GEOMETRIES[g].row_num, MCTS_GEOMETRIES[g].win_len);
+
+        for (int thread_num = 1; thread_num <= thread_max; thread_num *= 2) {
+            Connect4_mcts_result_t result;
+
+            connect4_mcts_set_thread_num(&mcts, thread_num);
+            connect4_mcts_search(&mcts, &game, budget_ms*1e-3, &result);
+
+            double rate = result.playouts/result.sec;
+            if (thread_num == 1)
+                base_rate = rate;
+            printf("%-10s %8d %12llu %12.0f %10zu %7.2fx %6d %7.1f%%\n", name, thread_num,
+                    (unsigned long long)result.playouts, rate, result.node_num,
+                    rate/base_rate, result.col + 1, result.win_rate*100);
+        }
+    }
+
+    connect4_mcts_set_thread_num(&mcts, 1);
+    int lost = mcts_suite(&mcts, budget_ms*1e-3);
+    if (lost >= 0)
+        printf("%d of %zu positions lose the solver's result\n", lost, SOLVE_SUITE_NUM);
+
+    connect4_mcts_finalize(&mcts);
+    return lost < 0;
+}
+
+// </Monte Carlo tree search>
+// --------------------------------------------------
+
+static const Bench_t BENCHES[] = {
+    {"solve", "[tt_MiB] solve the position suite, report positions per second", bench_solve},
+    {"parallel", "[max_threads] [tt_MiB] solve the suite with 1, 2, 4 ... threads",
+        bench_parallel},
+    {"book", "<path> [verify_num] book open and lookup time, check against the solver",
+        bench_book},
+    {"win", "compare win detection with the old per-direction loops", bench_win},
+    {"geometry", "per-move cost on other board sizes and win lengths, 64 and 128-bit", bench_geometry},
+    {"spectators", "[max_num] per-move cost of sending a move to 1 .. 10000 spectators",
+        bench_spectators},
+    {"batch", "[games] moves tried per second, game by game and batched", bench_batch},
+    {"mcts", "[budget_ms] [max_threads] tree search playouts per second, suite vs the solver",
+        bench_mcts},
+};
+
+#define BENCH_NUM (sizeof(BENCHES)/sizeof(BENCHES[0]))
+
+int main (int argc, char *argv[])
+{
+    if (argc >= 2)
+        for (size_t i = 0; i < BENCH_NUM; i++)
+            if (strcmp(argv[1], BENCHES[i].name) == 0)
+                return BENCHES[i].run(argc - 1, argv + 1);
+
+    fprintf(stderr, "Usage: %s <benchmark> [args ...]\n", argv[0]);
+    for (size_t i = 0; i < BENCH_NUM; i++)
+        fprintf(stderr, "  %-10s %s\n", BENCHES[i].name, BENCHES[i].help);
+    return 1;
+}
@@ -0,0 +1,223 @@
+/*
+ *  Connect four opening book (see connect4_book.h)
+ */
+
+#define _DEFAULT_SOURCE
+#include "connect4_book.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+_Static_assert(sizeof(Connect4_book_header_t) == 32, "the header is 32 bytes");
+
+/*
+ *  mirror a key left to right; every column is row_num + 1 bits wide,
+ *  the bit above the top disk included
+ */
+static uint64_t
+mirror_key (uint64_t key, int col_num, int row_num)
+{
+    int width = row_num + 1;
+    uint64_t column = ((uint64_t)1<<width) - 1;
+    uint64_t mirror = 0;
+
+    for (int col = 0; col < col_num; col++)
+        mirror |= (key>>col*width & column)<<(col_num - 1 - col)*width;
+    return mirror;
+}
+
+/*
+ *  Function name:
+ *      connect4_book_key
+ *
+ *  Description:
+ *      book key of a position: the smaller of its key and the key of
+ *      its mirror image
+ *
+ *  Input:
+ *      game        :   position (not over), on a board of one word
+ *      mirrored    :   set when the key is the mirror image's (output)
+ *
+ *  Output:
+ *      return      :   key
+ */
+uint64_t
+connect4_book_key (Connect4_t *game, bool *mirrored)
+{
+    uint64_t mask = game->black | game->white;
+    uint64_t current = (connect4_get_game_state(game) == BLACK_MOVE)
+                        ? game->black : game->white;
+    uint64_t key = current + mask;
+    uint64_t mirror = mirror_key(key, game->col_num, game->row_num);
+
+    *mirrored = mirror < key;
+    return *mirrored ? mirror : key;
+}
+
+uint16_t
+connect4_book_value (int col, int score)
+{
+    return (uint8_t)(int8_t)score | (uint16_t)col<<8;
+}
+
+/*
+ *  Function name:
+ *      connect4_book_open
+ *
+ *  Description:
+ *      map a book file read-only
+ *
+ *  Input:
+ *      book    :   book
+ *      path    :   file written by connect4_book_write
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the file can not be mapped or
+ *                  is not a book
+ */
+int
+connect4_book_open (Connect4_book_t *book, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(Connect4_book_header_t)) {
+        fprintf(stderr, "%s: not a connect four book\n", path);
+        close(fd);
+        return -1;
+    }
+
+    book->map_size = st.st_size;
+    book->map = mmap(NULL, book->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (book->map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    // entry_num is checked against what the file holds, as a crafted one
+    // would overflow entry_num*entry_size past the end of the map
+    const Connect4_book_header_t *header = book->map;
+    size_t entry_size = sizeof(uint64_t) + sizeof(uint16_t);
+    size_t table_size = book->map_size - sizeof(*header);
+    if (memcmp(header->magic, CONNECT4_BOOK_MAGIC, sizeof(header->magic)) != 0
+            || table_size%entry_size != 0
+            || header->entry_num != table_size/entry_size) {
+        fprintf(stderr, "%s: not a connect four book\n", path);
+        munmap(book->map, book->map_size);
+        return -1;
+    }
+
+    book->entry_num = header->entry_num;
+    book->col_num = header->col_num;
+    book->row_num = header->row_num;
+    book->depth = header->depth;
+    book->keys = (const uint64_t *)(header + 1);
+    book->values = (const uint16_t *)(book->keys + book->entry_num);
+
+    // lookups jump around the file, read-ahead would only waste memory
+    madvise(book->map, book->map_size, MADV_RANDOM);
+    return 0;
+}
+
+void
+connect4_book_close (Connect4_book_t *book)
+{
+    munmap(book->map, book->map_size);
+    book->map = NULL;
+}
+
+/*
+ *  Function name:
+ *      connect4_book_lookup
+ *
+ *  Description:
+ *      binary search the position in the book
+ *
+ *  Input:
+ *      book    :   book
+ *      game    :   position
+ *      col     :   best column (output)
+ *      score   :   score, same scale as the solver (output)
+ *
+ *  Output:
+ *      return  :   true when the position is in the book
+ */
+bool
+connect4_book_lookup (const Connect4_book_t *book, Connect4_t *game,
+                        int *col, int *score)
+{
+    if (game->col_num != book->col_num || game->row_num != book->row_num
+            || game->wide || game->win_len != CONNECT4_WIN_LEN)
+        return false;
+    if (game->move_num > book->depth || connect4_get_game_state(game) == GAME_OVER)
+        return false;
+
+    bool mirrored;
+    uint64_t key = connect4_book_key(game, &mirrored);
+    uint64_t low = 0, high = book->entry_num;
+
+    while (low < high) {
+        uint64_t mid = low + (high - low)/2;
+        if (book->keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == book->entry_num || book->keys[low] != key)
+        return false;
+
+    uint16_t value = book->values[low];
+    *score = (int8_t)(value & 0xff);
+    *col = value>>8;
+    if (mirrored)
+        *col = game->col_num - 1 - *col;
+    return true;
+}
+
+/*
+ *  Function name:
+ *      connect4_book_write
+ *
+ *  Description:
+ *      write a book file; keys must be ascending
+ *
+ *  Output:
+ *      return  :   0 on success, -1 on a write error
+ */
+int
+connect4_book_write (const char *path, const Connect4_book_header_t *header,
+                        const uint64_t *keys, const uint16_t *values)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror("fopen");
+        return -1;
+    }
+
+    size_t n = header->entry_num;
+    if (fwrite(header, sizeof(*header), 1, fp) != 1
+            || fwrite(keys, sizeof(*keys), n, fp) != n
+            || fwrite(values, sizeof(*values), n, fp) != n) {
+        perror("fwrite");
+        fclose(fp);
+        return -1;
+    }
+
+    if (fclose(fp) != 0) {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "connect4.h"
+
+/*
+ *  <<Opening book>>
+ *
+ *  Every position up to a ply depth, solved offline by connect4_book_gen
+ *  and looked up at run time instead of searching.
+ *
+ *  file layout (native byte order, no padding):
+ *      header  :   Connect4_book_header_t (32 bytes)
+ *      keys    :   uint64_t[entry_num], ascending
+ *      values  :   uint16_t[entry_num], score (int8) | best column<<8
+ *
+ *  The key is current + mask of the column-major bitboards (see
+ *  connect4_solve.c), taken from whichever of the position and its
+ *  mirror image gives the smaller key, so a position and its mirror
+ *  share one entry. The stored column belongs to the smaller-key side
+ *  and is mirrored back on lookup.
+ *
+ *  The file is mapped read-only and searched in place; opening it costs
+ *  a header check, nothing is parsed or copied.
+ */
+
+#define CONNECT4_BOOK_MAGIC "C4BOOK1"
+
+typedef struct Connect4_book_header {
+    char magic[8];
+    uint64_t entry_num;
+    uint8_t col_num, row_num;
+    uint8_t depth;          // plies from the empty board
+    uint8_t reserved[13];
+} Connect4_book_header_t;
+
+typedef struct Connect4_book {
+    void *map;
+    size_t map_size;
+    const uint64_t *keys;
+    const uint16_t *values;
+    uint64_t entry_num;
+    int col_num, row_num;
+    int depth;
+} Connect4_book_t;
+
+int connect4_book_open (Connect4_book_t *book, const char *path);
+void connect4_book_close (Connect4_book_t *book);
+bool connect4_book_lookup (const Connect4_book_t *book, Connect4_t *game,
+                            int *col, int *score);
+uint64_t connect4_book_key (Connect4_t *game, bool *mirrored);
+uint16_t connect4_book_value (int col, int score);
+int connect4_book_write (const char *path, const Connect4_book_header_t *header,
+                            const uint64_t *keys, const uint16_t *values);
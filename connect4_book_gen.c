@@ -0,0 +1,253 @@
+/*
+ *  Connect four opening book generator
+ *
+ *  usage: connect4_book_gen [-c cols] [-r rows] [-d depth] [-m tt_MiB]
+ *                           [-t threads] [-o path]
+ *
+ *  Collects every position reachable in at most depth plies (mirror
+ *  images once), solves each of them and writes the book sorted by key
+ *  (see connect4_book.h). The deepest positions are solved first, so
+ *  the shallower ones find their subtrees in the transposition table.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "connect4.h"
+#include "connect4_solve.h"
+#include "connect4_book.h"
+#include "connect4_util.h"
+
+#define BOARD_ROW_NUM 6
+#define BOARD_COL_NUM 7
+#define DEFAULT_DEPTH 8
+#define DEFAULT_PATH "connect4.book"
+
+typedef struct Book_pos {
+    uint64_t key;
+    Connect4_t game;        // as reached, may be the mirror of key
+    bool mirrored;
+} Book_pos_t;
+
+typedef struct Collector {
+    Book_pos_t *positions;
+    size_t num, cap;
+    uint64_t *seen;         // open addressing set of key + 1 (0 is empty)
+    size_t seen_cap;        // power of two
+    int depth;
+} Collector_t;
+
+static int
+grow_seen (Collector_t *col)
+{
+    size_t cap = col->seen_cap ? col->seen_cap*2 : 1024;
+    uint64_t *seen = calloc(cap, sizeof(uint64_t));
+    if (seen == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < col->seen_cap; i++) {
+        if (col->seen[i] == 0)
+            continue;
+        size_t h = (col->seen[i]*UINT64_C(0x9e3779b97f4a7c15))>>32 & (cap - 1);
+        while (seen[h] != 0)
+            h = (h + 1) & (cap - 1);
+        seen[h] = col->seen[i];
+    }
+
+    free(col->seen);
+    col->seen = seen;
+    col->seen_cap = cap;
+    return 0;
+}
+
+/*
+ *  return 1 when the key was added, 0 when it was already there
+ */
+static int
+insert_seen (Collector_t *col, uint64_t key)
+{
+    // keep the set at most half full
+    if (col->num*2 >= col->seen_cap && grow_seen(col) < 0)
+        return -1;
+
+    uint64_t entry = key + 1;
+    size_t h = (entry*UINT64_C(0x9e3779b97f4a7c15))>>32 & (col->seen_cap - 1);
+    while (col->seen[h] != 0) {
+        if (col->seen[h] == entry)
+            return 0;
+        h = (h + 1) & (col->seen_cap - 1);
+    }
+    col->seen[h] = entry;
+    return 1;
+}
+
+/*
+ *  add the position and everything reachable from it; a position seen
+ *  before (or its mirror) has the same subtree and is not walked again
+ */
+static int
+collect (Collector_t *col, Connect4_t *game)
+{
+    bool mirrored;
+    uint64_t key = connect4_book_key(game, &mirrored);
+
+    int added = insert_seen(col, key);
+    if (added <= 0)
+        return added;
+
+    if (col->num == col->cap) {
+        size_t cap = col->cap ? col->cap*2 : 1024;
+        Book_pos_t *positions = realloc(col->positions, cap*sizeof(Book_pos_t));
+        if (positions == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        col->positions = positions;
+        col->cap = cap;
+    }
+    col->positions[col->num++] = (Book_pos_t){key, *game, mirrored};
+
+    if (game->move_num == col->depth)
+        return 0;
+
+    for (int c = 0; c < game->col_num; c++) {
+        if (connect4_drop(game, c) < 0)
+            continue;
+        int ret = 0;
+        if (connect4_get_game_state(game) != GAME_OVER)
+            ret = collect(col, game);
+        connect4_unmake_move(game);
+        if (ret < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+compare_key (const void *a, const void *b)
+{
+    uint64_t ka = ((const Book_pos_t *)a)->key, kb = ((const Book_pos_t *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static int
+generate (int col_num, int row_num, int depth, size_t tt_bytes,
+            int thread_num, const char *path)
+{
+    Collector_t col = {.depth = depth};
+    Connect4_t game;
+    new_game(&game, col_num, row_num);
+
+    if (collect(&col, &game) < 0)
+        return -1;
+    free(col.seen);
+    qsort(col.positions, col.num, sizeof(Book_pos_t), compare_key);
+    fprintf(stderr, "%zu positions up to %d plies\n", col.num, depth);
+
+    uint64_t *keys = malloc(col.num*sizeof(uint64_t));
+    uint16_t *values = malloc(col.num*sizeof(uint16_t));
+    Connect4_solver_t solver;
+    if (keys == NULL || values == NULL || connect4_solver_init(&solver, tt_bytes) < 0) {
+        perror("malloc");
+        free(keys);
+        free(values);
+        free(col.positions);
+        return -1;
+    }
+    connect4_solver_set_thread_num(&solver, thread_num);
+
+    double start = connect4_now_sec();
+    size_t done = 0;
+    for (int ply = depth; ply >= 0; ply--) {
+        for (size_t i = 0; i < col.num; i++) {
+            Book_pos_t *pos = &col.positions[i];
+            Connect4_solve_result_t result;
+            if (pos->game.move_num != ply)
+                continue;
+
+            connect4_solve(&solver, &pos->game, &result);
+            if (pos->mirrored)
+                result.col = col_num - 1 - result.col;
+            keys[i] = pos->key;
+            values[i] = connect4_book_value(result.col, result.score);
+
+            if (++done % 1000 == 0)
+                fprintf(stderr, "%zu/%zu solved (ply %d), %.1f s\n",
+                        done, col.num, ply, connect4_now_sec() - start);
+        }
+    }
+    fprintf(stderr, "%zu positions solved in %.1f s, %llu nodes\n",
+            done, connect4_now_sec() - start, (unsigned long long)solver.node_count);
+
+    Connect4_book_header_t header = {
+        .magic = CONNECT4_BOOK_MAGIC,
+        .entry_num = col.num,
+        .col_num = col_num,
+        .row_num = row_num,
+        .depth = depth,
+    };
+    int ret = connect4_book_write(path, &header, keys, values);
+
+    connect4_solver_finalize(&solver);
+    free(keys);
+    free(values);
+    free(col.positions);
+    return ret;
+}
+
+int main (int argc, char *argv[])
+{
+    int col_num = BOARD_COL_NUM, row_num = BOARD_ROW_NUM;
+    int depth = DEFAULT_DEPTH, thread_num = 1;
+    size_t tt_bytes = CONNECT4_SOLVER_TT_DEFAULT;
+    const char *path = DEFAULT_PATH;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:d:m:t:o:")) != -1) {
+        switch (opt)
+        {
+        case 'c':
+            col_num = strtol(optarg, NULL, 10);
+            break;
+        case 'r':
+            row_num = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            depth = strtol(optarg, NULL, 10);
+            break;
+        case 'm':
+            tt_bytes = strtoull(optarg, NULL, 10)<<20;
+            break;
+        case 't':
+            thread_num = strtol(optarg, NULL, 10);
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c cols] [-r rows] [-d depth] [-m tt_MiB] "
+                    "[-t threads] [-o path]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (col_num < 1 || row_num < 1 || col_num*(row_num + 1) > 64) {
+        fprintf(stderr, "%dx%d board does not fit the bitboards\n", col_num, row_num);
+        return 1;
+    }
+    if (depth < 0 || depth >= col_num*row_num) {
+        fprintf(stderr, "depth must be between 0 and %d\n", col_num*row_num - 1);
+        return 1;
+    }
+
+    if (generate(col_num, row_num, depth, tt_bytes, thread_num, path) < 0)
+        return 1;
+
+    printf("%s written\n", path);
+    return 0;
+}
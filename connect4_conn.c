@@ -0,0 +1,515 @@
+/*
+ *  Connect four: non-blocking connection setup (see connect4_conn.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "connect4_conn.h"
+#include "connect4_util.h"
+
+/*
+ *  getaddrinfo() may wait seconds for a DNS server, so a host name is
+ *  looked up on a thread of its own. The thread and the connection
+ *  hold a reference each; a connection closed meanwhile just drops its
+ *  own, and the last one out frees the lookup.
+ */
+typedef struct Connect4_lookup {
+    int refs;
+    bool done;                  // ret and addrs are set
+    int ret;
+    struct addrinfo *addrs;
+    int fds[2];                 // a byte is written to fds[1] when done
+    char host[CONNECT4_CONN_HOST_MAX];
+    char service[8];
+} Connect4_lookup_t;
+
+static void
+lookup_unref (Connect4_lookup_t *lookup)
+{
+    if (__atomic_sub_fetch(&lookup->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    if (lookup->addrs != NULL)
+        freeaddrinfo(lookup->addrs);
+    close(lookup->fds[0]);
+    close(lookup->fds[1]);
+    free(lookup);
+}
+
+static void *
+lookup_thread (void *arg)
+{
+    Connect4_lookup_t *lookup = arg;
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV
+    };
+
+    lookup->ret = getaddrinfo(lookup->host, lookup->service, &hints, &lookup->addrs);
+    if (lookup->ret != 0)
+        lookup->addrs = NULL;
+    __atomic_store_n(&lookup->done, true, __ATOMIC_RELEASE);
+
+    // the read end is open until the last reference is dropped
+    if (write(lookup->fds[1], "", 1) < 0)
+        perror("write");
+    lookup_unref(lookup);
+    return NULL;
+}
+
+static void
+set_status (Connect4_conn_t *conn, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(conn->status, sizeof(conn->status), fmt, ap);
+    va_end(ap);
+}
+
+static void
+free_addrs (Connect4_conn_t *conn)
+{
+    if (conn->addrs != NULL)
+        freeaddrinfo(conn->addrs);
+    conn->addrs = conn->next_addr = NULL;
+}
+
+static void
+close_listeners (Connect4_conn_t *conn)
+{
+    for (int i = 0; i < conn->listen_num; i++)
+        close(conn->listen_fds[i]);
+    conn->listen_num = 0;
+}
+
+static void
+set_connected (Connect4_conn_t *conn)
+{
+    int flags = fcntl(conn->fd, F_GETFL);
+    if (flags >= 0)
+        fcntl(conn->fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    free_addrs(conn);
+    conn->state = CONNECT4_CONN_CONNECTED;
+    conn->deadline_ms = -1;
+    set_status(conn, "Connected to %s", conn->host);
+}
+
+/*
+ *  Function name:
+ *      end_round
+ *
+ *  Description:
+ *      every address of this round failed; wait before the next round,
+ *      or give up after retry_max rounds. The wait doubles every round
+ *      and a random part of it is dropped, so clients that failed
+ *      together do not retry together.
+ *
+ *  Input:
+ *      conn    :   connection
+ *      reason  :   why the last attempt failed
+ */
+static void
+end_round (Connect4_conn_t *conn, const char *reason)
+{
+    free_addrs(conn);
+    conn->round++;
+
+    if (conn->opts.retry_max >= 0 && conn->round > conn->opts.retry_max) {
+        conn->state = CONNECT4_CONN_FAILED;
+        conn->deadline_ms = -1;
+        set_status(conn, "Cannot connect to %s: %s", conn->host, reason);
+        return;
+    }
+
+    long delay = conn->opts.backoff_max_ms;
+    if (conn->round - 1 < 20)
+        delay = (long)conn->opts.backoff_min_ms << (conn->round - 1);
+    if (delay > conn->opts.backoff_max_ms)
+        delay = conn->opts.backoff_max_ms;
+    delay = delay/2 + connect4_rand_next(&conn->seed)%(delay/2 + 1);
+
+    conn->state = CONNECT4_CONN_BACKOFF;
+    conn->deadline_ms = connect4_now_ms() + delay;
+    set_status(conn, "%s, retrying in %.1f s", reason, delay/1000.0);
+}
+
+/*
+ *  start connecting to the remaining addresses of this round until one
+ *  is in progress or connected
+ */
+static void
+try_next_addr (Connect4_conn_t *conn, const char *reason)
+{
+    while (conn->next_addr != NULL) {
+        struct addrinfo *ai = conn->next_addr;
+        conn->next_addr = ai->ai_next;
+
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        ai->ai_protocol);
+        if (fd < 0) {
+            reason = strerror(errno);
+            continue;
+        }
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            conn->fd = fd;
+            set_connected(conn);
+            return;
+        }
+        if (errno == EINPROGRESS) {
+            conn->fd = fd;
+            conn->state = CONNECT4_CONN_CONNECTING;
+            conn->deadline_ms = connect4_now_ms() + conn->opts.connect_timeout_ms;
+            set_status(conn, "Connecting to %s (attempt %d)...", conn->host, conn->round + 1);
+            return;
+        }
+        reason = strerror(errno);
+        close(fd);
+    }
+
+    end_round(conn, reason ? reason : "no address");
+}
+
+static void
+lookup_abandon (Connect4_conn_t *conn)
+{
+    if (conn->lookup != NULL)
+        lookup_unref(conn->lookup);
+    conn->lookup = NULL;
+}
+
+static void
+lookup_finish (Connect4_conn_t *conn)
+{
+    Connect4_lookup_t *lookup = conn->lookup;
+    int ret = lookup->ret;
+    conn->addrs = lookup->addrs;
+    lookup->addrs = NULL;
+    lookup_abandon(conn);
+
+    if (ret != 0) {
+        end_round(conn, gai_strerror(ret));
+        return;
+    }
+    conn->next_addr = conn->addrs;
+    try_next_addr(conn, NULL);
+}
+
+/*
+ *  Function name:
+ *      resolve
+ *
+ *  Description:
+ *      look the host up for a new round; a numeric address needs no
+ *      DNS and is tried at once, a name is handed to a lookup thread
+ *      and the round goes on when it is done
+ *
+ *  Input:
+ *      conn    :   connection
+ */
+static void
+resolve (Connect4_conn_t *conn)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV | AI_NUMERICHOST
+    };
+
+    // looked up again every round, the server may have moved
+    int ret = getaddrinfo(conn->host, conn->service, &hints, &conn->addrs);
+    if (ret == 0) {
+        conn->next_addr = conn->addrs;
+        try_next_addr(conn, NULL);
+        return;
+    }
+    conn->addrs = NULL;
+    if (ret != EAI_NONAME) {
+        end_round(conn, gai_strerror(ret));
+        return;
+    }
+
+    Connect4_lookup_t *lookup = calloc(1, sizeof(Connect4_lookup_t));
+    if (lookup == NULL) {
+        end_round(conn, strerror(errno));
+        return;
+    }
+    if (pipe2(lookup->fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        free(lookup);
+        end_round(conn, strerror(errno));
+        return;
+    }
+    lookup->refs = 2;
+    snprintf(lookup->host, sizeof(lookup->host), "%s", conn->host);
+    snprintf(lookup->service, sizeof(lookup->service), "%s", conn->service);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, lookup_thread, lookup);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        lookup->refs = 1;
+        lookup_unref(lookup);
+        end_round(conn, strerror(ret));
+        return;
+    }
+
+    conn->lookup = lookup;
+    conn->state = CONNECT4_CONN_RESOLVING;
+    conn->deadline_ms = connect4_now_ms() + conn->opts.connect_timeout_ms;
+    set_status(conn, "Looking up %s...", conn->host);
+}
+
+static int
+open_listeners (Connect4_conn_t *conn)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_PASSIVE | AI_ADDRCONFIG
+    };
+    struct addrinfo *addrs;
+    int one = 1;
+
+    int ret = getaddrinfo(NULL, conn->service, &hints, &addrs);
+    if (ret != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(ret));
+        return -1;
+    }
+
+    for (struct addrinfo *ai = addrs;
+            ai != NULL && conn->listen_num < CONNECT4_CONN_LISTEN_MAX; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        // the IPv4 wildcard gets its own socket
+        if (ai->ai_family == AF_INET6)
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 1) < 0) {
+            perror("bind");
+            close(fd);
+            continue;
+        }
+        conn->listen_fds[conn->listen_num++] = fd;
+    }
+    freeaddrinfo(addrs);
+
+    return (conn->listen_num > 0) ? 0 : -1;
+}
+
+/*
+ *  Function name:
+ *      connect4_conn_open
+ *
+ *  Description:
+ *      start setting up the connection; nothing here waits for the
+ *      network except binding the listening sockets
+ *
+ *  Input:
+ *      conn    :   connection
+ *      host    :   peer to connect to, ignored when passive
+ *      port_no :   port number
+ *      passive :   wait for the peer instead of connecting to it
+ *      opts    :   timeouts and retries, NULL for the defaults
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when no socket can listen
+ */
+int
+connect4_conn_open (Connect4_conn_t *conn, const char *host, int port_no,
+                    bool passive, const Connect4_conn_opts_t *opts)
+{
+    *conn = (Connect4_conn_t){
+        .opts = opts ? *opts : CONNECT4_CONN_OPTS_DEFAULT,
+        .fd = -1,
+        .deadline_ms = -1,
+        .seed = (uint64_t)connect4_now_ms()<<20 ^ getpid() ^ (uintptr_t)conn,
+    };
+    snprintf(conn->host, sizeof(conn->host), "%s", host ? host : "");
+    snprintf(conn->service, sizeof(conn->service), "%d", port_no);
+
+    if (passive) {
+        if (open_listeners(conn) < 0)
+            return -1;
+        conn->state = CONNECT4_CONN_LISTENING;
+        if (conn->opts.accept_timeout_ms > 0)
+            conn->deadline_ms = connect4_now_ms() + conn->opts.accept_timeout_ms;
+        set_status(conn, "Waiting for a client on port %d...", port_no);
+        return 0;
+    }
+
+    // resolved on the first step, once the caller has drawn the status
+    conn->state = CONNECT4_CONN_RESOLVING;
+    conn->deadline_ms = connect4_now_ms();
+    set_status(conn, "Looking up %s...", conn->host);
+    return 0;
+}
+
+void
+connect4_conn_close (Connect4_conn_t *conn)
+{
+    close_listeners(conn);
+    lookup_abandon(conn);
+    free_addrs(conn);
+    if (conn->fd >= 0)
+        close(conn->fd);
+    conn->fd = -1;
+}
+
+/*
+ *  fill fds with what the current state waits on; return their number
+ */
+int
+connect4_conn_pollfds (Connect4_conn_t *conn, struct pollfd *fds, int fd_max)
+{
+    int fd_num = 0;
+
+    switch (conn->state)
+    {
+    case CONNECT4_CONN_RESOLVING:
+        if (conn->lookup != NULL && fd_max > 0)
+            fds[fd_num++] = (struct pollfd){.fd = conn->lookup->fds[0], .events = POLLIN};
+        break;
+    case CONNECT4_CONN_LISTENING:
+        for (int i = 0; i < conn->listen_num && fd_num < fd_max; i++)
+            fds[fd_num++] = (struct pollfd){.fd = conn->listen_fds[i], .events = POLLIN};
+        break;
+    case CONNECT4_CONN_CONNECTING:
+        if (fd_max > 0)
+            fds[fd_num++] = (struct pollfd){.fd = conn->fd, .events = POLLOUT};
+        break;
+    default:
+        break;
+    }
+    return fd_num;
+}
+
+/*
+ *  milliseconds until the current state times out, -1 for never
+ */
+int
+connect4_conn_timeout (Connect4_conn_t *conn)
+{
+    if (conn->deadline_ms < 0)
+        return -1;
+
+    long left = conn->deadline_ms - connect4_now_ms();
+    return (left > 0) ? left : 0;
+}
+
+/*
+ *  Function name:
+ *      connect4_conn_step
+ *
+ *  Description:
+ *      advance the setup after poll() returned, with or without events
+ *
+ *  Input:
+ *      conn    :   connection
+ *      fds     :   the fds from connect4_conn_pollfds with their revents
+ *      fd_num  :   number of fds
+ *
+ *  Output:
+ *      return  :   the new state
+ */
+Connect4_conn_state_t
+connect4_conn_step (Connect4_conn_t *conn, const struct pollfd *fds, int fd_num)
+{
+    bool expired = conn->deadline_ms >= 0 && connect4_now_ms() >= conn->deadline_ms;
+
+    switch (conn->state)
+    {
+    case CONNECT4_CONN_RESOLVING:
+        if (conn->lookup == NULL) {
+            if (expired)
+                resolve(conn);
+        } else if (__atomic_load_n(&conn->lookup->done, __ATOMIC_ACQUIRE))
+            lookup_finish(conn);
+        else if (expired) {
+            // the thread finishes on its own and frees what it holds
+            lookup_abandon(conn);
+            end_round(conn, "Lookup timed out");
+        }
+        break;
+
+    case CONNECT4_CONN_BACKOFF:
+        if (expired)
+            resolve(conn);
+        break;
+
+    case CONNECT4_CONN_CONNECTING:
+        for (int i = 0; i < fd_num; i++) {
+            if (fds[i].fd != conn->fd || fds[i].revents == 0)
+                continue;
+
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+                err = errno;
+            if (err == 0) {
+                set_connected(conn);
+                return conn->state;
+            }
+            close(conn->fd);
+            conn->fd = -1;
+            try_next_addr(conn, strerror(err));
+            return conn->state;
+        }
+        if (expired) {
+            close(conn->fd);
+            conn->fd = -1;
+            try_next_addr(conn, "Connection timed out");
+        }
+        break;
+
+    case CONNECT4_CONN_LISTENING:
+        for (int i = 0; i < fd_num; i++) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            // the accepted socket is blocking
+            int fd = accept4(fds[i].fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != ECONNABORTED)
+                    perror("accept");
+                continue;
+            }
+            close_listeners(conn);
+            conn->fd = fd;
+            conn->state = CONNECT4_CONN_CONNECTED;
+            conn->deadline_ms = -1;
+            set_status(conn, "Client connected");
+            return conn->state;
+        }
+        if (expired) {
+            close_listeners(conn);
+            conn->state = CONNECT4_CONN_FAILED;
+            conn->deadline_ms = -1;
+            set_status(conn, "No client connected in %d s",
+                    conn->opts.accept_timeout_ms/1000);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return conn->state;
+}
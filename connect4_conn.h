@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
+#include <netdb.h>
+
+/*
+ *  <<Connection setup>>
+ *
+ *  Sets up the game socket without blocking, so the caller keeps
+ *  drawing and handling input while it waits. The caller polls the fds
+ *  from connect4_conn_pollfds() with the timeout from
+ *  connect4_conn_timeout() and calls connect4_conn_step() after every
+ *  poll(), until the state is CONNECTED or FAILED.
+ *
+ *  active  :   the host is resolved with getaddrinfo (IPv4 and IPv6)
+ *              on a helper thread, a numeric address right away, and
+ *              every address is tried in turn with a non-blocking
+ *              connect(); the lookup and every attempt are bounded by
+ *              connect_timeout_ms. When all fail, the next round starts
+ *              after an exponential backoff with jitter, so clients
+ *              turned away by a restarting server do not come back all
+ *              at once.
+ *  passive :   listens on every wildcard address and takes the first
+ *              peer, giving up after accept_timeout_ms (0 waits forever).
+ *
+ *  The connected socket is blocking again, as the game code expects.
+ */
+
+#define CONNECT4_CONN_LISTEN_MAX 4
+#define CONNECT4_CONN_HOST_MAX 128
+#define CONNECT4_CONN_STATUS_MAX 96
+
+typedef enum {
+    CONNECT4_CONN_RESOLVING,    // looking the host up, or about to
+    CONNECT4_CONN_CONNECTING,   // connect() in progress
+    CONNECT4_CONN_BACKOFF,      // waiting before the next round
+    CONNECT4_CONN_LISTENING,    // waiting for the peer
+    CONNECT4_CONN_CONNECTED,
+    CONNECT4_CONN_FAILED
+} Connect4_conn_state_t;
+
+typedef struct Connect4_conn_opts {
+    int connect_timeout_ms;     // per address
+    int accept_timeout_ms;      // 0 for none
+    int retry_max;              // rounds after the first, -1 for no limit
+    int backoff_min_ms, backoff_max_ms;
+} Connect4_conn_opts_t;
+
+#define CONNECT4_CONN_OPTS_DEFAULT ((Connect4_conn_opts_t){ \
+    .connect_timeout_ms = 3000,                             \
+    .accept_timeout_ms = 0,                                 \
+    .retry_max = 5,                                         \
+    .backoff_min_ms = 250,                                  \
+    .backoff_max_ms = 8000                                  \
+})
+
+struct Connect4_lookup;
+
+typedef struct Connect4_conn {
+    Connect4_conn_state_t state;
+    Connect4_conn_opts_t opts;
+    char host[CONNECT4_CONN_HOST_MAX];
+    char service[8];
+    struct addrinfo *addrs;     // this round's addresses
+    struct addrinfo *next_addr; // the one to try after the current
+    struct Connect4_lookup *lookup; // running on its thread, NULL for none
+    int fd;                     // connecting or connected, -1 for none
+    int listen_fds[CONNECT4_CONN_LISTEN_MAX];
+    int listen_num;
+    long deadline_ms;           // of the current state, -1 for none
+    int round;                  // rounds of connect attempts so far
+    uint64_t seed;              // backoff jitter
+    char status[CONNECT4_CONN_STATUS_MAX];
+} Connect4_conn_t;
+
+int connect4_conn_open (Connect4_conn_t *conn, const char *host, int port_no,
+                        bool passive, const Connect4_conn_opts_t *opts);
+void connect4_conn_close (Connect4_conn_t *conn);
+int connect4_conn_pollfds (Connect4_conn_t *conn, struct pollfd *fds, int fd_max);
+int connect4_conn_timeout (Connect4_conn_t *conn);
+Connect4_conn_state_t connect4_conn_step (Connect4_conn_t *conn,
+                        const struct pollfd *fds, int fd_num);
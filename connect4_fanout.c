@@ -0,0 +1,145 @@
+/*
+ *  Connect four: shared buffers and scatter output queues for sending
+ *  the same bytes to many sockets (see connect4_fanout.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "connect4_fanout.h"
+
+/*
+ *  return a buffer holding a copy of data with one reference, NULL when
+ *  out of memory
+ */
+Connect4_shared_buf_t *
+connect4_shared_buf_new (const uint8_t *data, size_t len)
+{
+    Connect4_shared_buf_t *buf = malloc(sizeof(Connect4_shared_buf_t) + len);
+    if (buf == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    buf->ref = 1;
+    buf->len = len;
+    memcpy(buf->data, data, len);
+    return buf;
+}
+
+Connect4_shared_buf_t *
+connect4_shared_buf_ref (Connect4_shared_buf_t *buf)
+{
+    buf->ref++;
+    return buf;
+}
+
+void
+connect4_shared_buf_unref (Connect4_shared_buf_t *buf)
+{
+    if (--buf->ref == 0)
+        free(buf);
+}
+
+void
+connect4_out_queue_init (Connect4_out_queue_t *queue)
+{
+    queue->head = 0;
+    queue->num = 0;
+    queue->offset = 0;
+}
+
+/*
+ *  drop everything not sent yet
+ */
+void
+connect4_out_queue_clear (Connect4_out_queue_t *queue)
+{
+    for (int i = 0; i < queue->num; i++)
+        connect4_shared_buf_unref(queue->bufs[(queue->head + i)%CONNECT4_OUT_QUEUE_MAX]);
+    connect4_out_queue_init(queue);
+}
+
+/*
+ *  queue a reference to buf; return -1 when the queue is full
+ */
+int
+connect4_out_queue_push (Connect4_out_queue_t *queue, Connect4_shared_buf_t *buf)
+{
+    if (queue->num == CONNECT4_OUT_QUEUE_MAX)
+        return -1;
+
+    queue->bufs[(queue->head + queue->num)%CONNECT4_OUT_QUEUE_MAX] =
+        connect4_shared_buf_ref(buf);
+    queue->num++;
+    return 0;
+}
+
+bool
+connect4_out_queue_empty (const Connect4_out_queue_t *queue)
+{
+    return queue->num == 0;
+}
+
+/*
+ *  Function name:
+ *      connect4_out_queue_flush
+ *
+ *  Description:
+ *      send as much of the queue as a non-blocking socket accepts, all
+ *      queued buffers in one sendmsg()
+ *
+ *  Input:
+ *      queue   :   output queue
+ *      fd      :   socket
+ *
+ *  Output:
+ *      return  :   0 when sent or the socket is full, -1 when it is broken
+ */
+int
+connect4_out_queue_flush (Connect4_out_queue_t *queue, int fd)
+{
+    while (queue->num > 0) {
+        struct iovec iov[CONNECT4_OUT_QUEUE_MAX];
+        for (int i = 0; i < queue->num; i++) {
+            Connect4_shared_buf_t *buf = queue->bufs[(queue->head + i)%CONNECT4_OUT_QUEUE_MAX];
+            iov[i].iov_base = buf->data;
+            iov[i].iov_len = buf->len;
+        }
+        iov[0].iov_base = (uint8_t*)iov[0].iov_base + queue->offset;
+        iov[0].iov_len -= queue->offset;
+
+        // one buffer, the common case of a spectator keeping up
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = queue->num};
+        ssize_t len = (queue->num == 1)
+                ? send(fd, iov[0].iov_base, iov[0].iov_len, MSG_NOSIGNAL)
+                : sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+
+        // release what went out completely
+        size_t sent = len + queue->offset;
+        while (queue->num > 0) {
+            Connect4_shared_buf_t *buf = queue->bufs[queue->head];
+            if (sent < buf->len)
+                break;
+            sent -= buf->len;
+            connect4_shared_buf_unref(buf);
+            queue->head = (queue->head + 1)%CONNECT4_OUT_QUEUE_MAX;
+            queue->num--;
+        }
+        queue->offset = sent;
+    }
+
+    queue->offset = 0;
+    return 0;
+}
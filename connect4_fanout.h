@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *  <<Fan-out>>
+ *
+ *  A message for many receivers is serialized once into a
+ *  Connect4_shared_buf_t. Every receiver's Connect4_out_queue_t holds a
+ *  reference to it instead of a copy, and a flush hands everything
+ *  queued to the kernel with one sendmsg() (scatter I/O). The buffer is
+ *  freed when the last queue is done with it.
+ *
+ *  Single-threaded: the reference count is a plain int.
+ */
+
+// a whole game on the largest board and its snapshot fit; a receiver
+// this far behind is stalled
+#define CONNECT4_OUT_QUEUE_MAX 256
+
+typedef struct Connect4_shared_buf {
+    int ref;
+    size_t len;
+    uint8_t data[];
+} Connect4_shared_buf_t;
+
+typedef struct Connect4_out_queue {
+    Connect4_shared_buf_t *bufs[CONNECT4_OUT_QUEUE_MAX];    // ring
+    int head, num;
+    size_t offset;          // sent part of bufs[head]
+} Connect4_out_queue_t;
+
+Connect4_shared_buf_t *connect4_shared_buf_new (const uint8_t *data, size_t len);
+Connect4_shared_buf_t *connect4_shared_buf_ref (Connect4_shared_buf_t *buf);
+void connect4_shared_buf_unref (Connect4_shared_buf_t *buf);
+
+void connect4_out_queue_init (Connect4_out_queue_t *queue);
+void connect4_out_queue_clear (Connect4_out_queue_t *queue);
+int connect4_out_queue_push (Connect4_out_queue_t *queue, Connect4_shared_buf_t *buf);
+int connect4_out_queue_flush (Connect4_out_queue_t *queue, int fd);
+bool connect4_out_queue_empty (const Connect4_out_queue_t *queue);
@@ -1,682 +1,588 @@
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/Xatom.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
-#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <netdb.h>
 #include "connect4.h"
+#include "connect4_proto.h"
+#include "connect4_conn.h"
+#include "connect4_render.h"
+#include "connect4_mcts.h"
+#include "connect4_util.h"
 
-#define WINDOW_SIZE_X_MIN 200
-#define WINDOW_SIZE_Y_MIN 200
-#define GRID_LINE_WID 1
-#define BOARD_ROW_NUM 6
-#define BOARD_COL_NUM 7
-#define DEFAULT_SIZE_X 400
-#define DEFAULT_SIZE_Y 400
 #define BUF_MAX 128
+#define WAKEUP_REPORT_MS 1000
+#define POLL_FD_MAX (CONNECT4_CONN_LISTEN_MAX + 1)
 static int DEFAULT_PORT_NO = 20000;
-static char *FONT_NAME = "fixed";
-static char *WINDOW_NAME = "Report 1";
-
-
-typedef struct Color_pixel {
-    unsigned long black, black_highlight;
-    unsigned long white, white_highlight;
-    unsigned long board, board_highlight;
-} Color_pixel_t;
-
-typedef struct GCs {
-    GC black, black_highlight;
-    GC white, white_highlight;
-    GC board, board_highlight;
-} GCs_t;
-
-typedef struct Grid {
-    int row_num, col_num; // num of visible cells
-    int cellsize_x, cellsize_y;
-    int selected_row, selected_col;
-    int size_x, size_y; // including invisible cells
-    int pos_x, pos_y;   // including invisible cells
-    int gap_size;
-} Grid_t;
 
-typedef struct X11othello {
-    Connect4_t game;
-    Game_state_t my_move;
-    int sock_fd;
-    Display *disp;
-    Window  win;
-    Grid_t grid;
-    GCs_t   GCs;
-    XFontStruct *font;
-    Color_pixel_t color_pixel;
-    Atom wm_delete_window;
-} X11Connect4_t;
 
 typedef enum {
     CONNECT4_SERVER_ROLE,
-    CONNECT4_CLIENT_ROLE
+    CONNECT4_CLIENT_ROLE,
+    CONNECT4_MATCH_ROLE     // player of connect4_server
 } Connect4_role_t;
 
-// X11Connect4_t othello;
-
-static unsigned long _alloc_named_color (X11Connect4_t *cnct4, const char *color_name);
-void alloc_named_colors (X11Connect4_t *cnct4);
-void create_GCs (X11Connect4_t *cnct4);
-void set_foregrounds (X11Connect4_t *cnct4);
-static int init_sock (char *host_name, int port_no, Connect4_role_t role);
-
-void init (X11Connect4_t *cnct4, char **argv, int argc,
-            int col_num, int row_num, int grid_gap,
-            Connect4_role_t role, char *host_name, int port_no);
-
-int min (int a, int b);
-int max (int a, int b);
-
-bool is_on_grid (X11Connect4_t *cnct4, int cursor_x, int cursor_y, int *row, int *col);
-void optimize_grid_pos (X11Connect4_t *cnct4, int win_width, int win_height);
-void draw_string (X11Connect4_t *cnct4, const char *str, int xpos, int ypos);
-void draw_cell (X11Connect4_t *cnct4, int row, int col);
-void draw_grid (X11Connect4_t *cnct4);
-void select_cell (X11Connect4_t *cnct4, int row, int col);
-void highlight_cell_mouse_on (X11Connect4_t *cnct4);
-void mouse_click (X11Connect4_t *cnct4);
+typedef struct X11othello {
+    Connect4_t game;
+    Game_state_t my_move;
+    Connect4_role_t role;
+    bool binary_proto;
+    Connect4_conn_t conn;
+    Connect4_conn_opts_t conn_opts;
+    char host_name[CONNECT4_CONN_HOST_MAX];
+    int port_no;
+    int sock_fd;                // -1 until connected
+    bool link_lost;             // the socket broke, as opposed to the game ending
+    bool has_session;           // the match server can resume us
+    bool resuming;
+    bool authoritative;         // the match server plays our moves and decides the result
+    bool move_sent;             // our move is waiting for the server to accept it
+    uint64_t session_token;
+    Connect4_proto_mode_t proto_mode;
+    bool hello_sent;            // on this connection; the peer's HELLO then only answers it
+    Connect4_decoder_t decoder;
+    Connect4_render_t render;
+    bool autoplay;              // play random columns, for bots and load tests
+    uint64_t seed;
+    double mcts_budget_sec;     // > 0: autoplay searches this long for a move
+    Connect4_mcts_t mcts;
+    bool report_wakeups;        // print wakeups and X round-trips per second
+    unsigned long wakeup_num;   // poll() returns since the last report
+} X11Connect4_t;
 
+void init (X11Connect4_t *cnct4, int col_num, int row_num, int win_len,
+            Connect4_role_t role, char *host_name, int port_no,
+            bool binary_proto, const char *renderer,
+            const Connect4_conn_opts_t *conn_opts);
+void connected (X11Connect4_t *cnct4);
+bool default_geometry (X11Connect4_t *cnct4);
+Connect4_msg_t hello_msg (X11Connect4_t *cnct4);
+bool reconnect (X11Connect4_t *cnct4);
+
+void play_column (X11Connect4_t *cnct4, int col);
+void autoplay (X11Connect4_t *cnct4);
+
+int send_msg (X11Connect4_t *cnct4, const Connect4_msg_t *msg);
+bool handle_msg (X11Connect4_t *cnct4, const Connect4_msg_t *msg);
+bool handle_sock (X11Connect4_t *cnct4);
 void loop (X11Connect4_t *cnct4);
 
-
-
-// XErrorHandler
-// err_handler (Display *err_disp, XErrorEvent *err_event)
-// {
-//     char err_msg[256];
-//     XGetErrorText(err_disp, err_event->error_code, err_msg, sizeof(err_msg));
-//     printf("Error: %s\n", err_msg);
-//     exit(EXIT_FAILURE);
-//     return 0;
-// }
-
-void xerror (const char *msg)
-{
-    // printf()
-}
-
-// --------------------------------------------------
-// <Color initializer>
-
-static unsigned long
-_alloc_named_color (X11Connect4_t *cnct4, const char *color_name)
-{
-    Colormap cmap = DefaultColormap(
-        cnct4->disp,
-        DefaultScreen(cnct4->disp)
-    );
-    XColor color, useless;
-    int rslt;
-    rslt = XAllocNamedColor(
-        cnct4->disp,
-        cmap,
-        color_name,
-        &color,
-        &useless
-    );
-    // if (rslt == 0)
-    //     xerror("XAllocNamedColor()");
-
-    return color.pixel;
-}
-
-void alloc_named_colors (X11Connect4_t *cnct4)
-{
-    cnct4->color_pixel = (Color_pixel_t){
-        .black = BlackPixel(cnct4->disp, DefaultScreen(cnct4->disp)),
-        .white = WhitePixel(cnct4->disp, DefaultScreen(cnct4->disp)),
-        .board = _alloc_named_color(cnct4, "ForestGreen"),
-        .black_highlight = _alloc_named_color(cnct4, "DarkSlateGray"),
-        .white_highlight = _alloc_named_color(cnct4, "Honeydew"),
-        .board_highlight = _alloc_named_color(cnct4, "Green"),
-    };
-
-}
-
-// </Color initializer>
-// --------------------------------------------------
-// <GC intializer and applier>
-void create_GCs (X11Connect4_t *cnct4)
-{
-    cnct4->GCs = (GCs_t){
-        .black = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-        .white = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-        .board = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-        .black_highlight = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-        .white_highlight = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-        .board_highlight = XCreateGC(cnct4->disp, cnct4->win, 0, NULL),
-    };
-}
-void set_foregrounds (X11Connect4_t *cnct4)
-{
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.black,
-        cnct4->color_pixel.black
-    );
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.white,
-        cnct4->color_pixel.white
-    );
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.black_highlight,
-        cnct4->color_pixel.black_highlight
-    );
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.white_highlight,
-        cnct4->color_pixel.white_highlight
-    );
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.board,
-        cnct4->color_pixel.board
-    );
-    XSetForeground(
-        cnct4->disp,
-        cnct4->GCs.board_highlight,
-        cnct4->color_pixel.board_highlight
-    );
-}
-// </GC initializer and applier>
-// --------------------------------------------------
-// <Network initializer>
-static int
-init_sock (char *host_name, int port_no, Connect4_role_t role)
+/*
+ *  The window comes up first; the connection is set up by the event
+ *  loop, which shows its progress in the status line.
+ */
+void
+init (X11Connect4_t *cnct4, int col_num, int row_num, int win_len,
+        Connect4_role_t role, char *host_name, int port_no,
+        bool binary_proto, const char *renderer,
+        const Connect4_conn_opts_t *conn_opts)
 {
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port   = htons(port_no)
-    };
-    // strcpy((char*)&addr.sin_addr, gethostbyname(host_name)->h_addr);
-    memcpy((char*)&addr.sin_addr, gethostbyname(host_name)->h_addr, gethostbyname(host_name)->h_length);
-
-    int sock_fd;
-    if ((sock_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("socket");
+    if (!connect4_valid_geometry(col_num, row_num, win_len)) {
+        printf("%dx%d board with %d in a row is not supported\n", col_num, row_num, win_len);
         exit(EXIT_FAILURE);
     }
+    connect4_new_game(&cnct4->game, col_num, row_num, win_len);
 
-    if (role == CONNECT4_SERVER_ROLE) {
-        if (bind(sock_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            perror("bind");
-            close(sock_fd);
-            exit(EXIT_FAILURE);
-        }
-
-        listen(sock_fd, 1);
-
-        puts("Waiting a client connecting...");
-        int temp_fd = sock_fd;
-        sock_fd = accept(temp_fd, NULL, NULL);
-        close(temp_fd);
-        if (sock_fd < 0) {
-            perror("accept");
-            close(sock_fd);
+    // no display is needed from here on unless the x11 renderer is used
+    if (renderer != NULL) {
+        if (connect4_render_open(&cnct4->render, renderer, &cnct4->game) < 0)
             exit(EXIT_FAILURE);
-        }
-        puts("Established connects successfully!!");
     }
-    else {
-        // role == CONNECT4_CLIENT_ROLE
-        puts("Connecting to the server...");
-        if (connect(sock_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            perror("connect");
-            close(sock_fd);
+    else if (connect4_render_open(&cnct4->render,
+                connect4_render_default(), &cnct4->game) < 0) {
+        puts("Falling back to the terminal");
+        if (connect4_render_open(&cnct4->render, "term", &cnct4->game) < 0)
             exit(EXIT_FAILURE);
-        }
-        puts("Connected!!");
     }
 
-    return sock_fd;
-}
-
-// </Network initializer>
-// --------------------------------------------------
-void
-init (X11Connect4_t *cnct4, char **argv, int argc,
-        int col_num, int row_num, int grid_gap,
-        Connect4_role_t role, char *host_name, int port_no)
-{
+    cnct4->role = role;
+    cnct4->binary_proto = binary_proto;
+    cnct4->conn_opts = *conn_opts;
+    snprintf(cnct4->host_name, sizeof(cnct4->host_name), "%s", host_name);
+    cnct4->port_no = port_no;
+    cnct4->sock_fd = -1;
+    cnct4->link_lost = false;
+    cnct4->has_session = false;
+    cnct4->resuming = false;
+    cnct4->authoritative = false;
+    cnct4->move_sent = false;
+    cnct4->proto_mode = CONNECT4_PROTO_TEXT;
+    cnct4->hello_sent = false;
+    connect4_decoder_init(&cnct4->decoder);
+
+    switch (role)
+    {
+    case CONNECT4_SERVER_ROLE:
+        cnct4->my_move = BLACK_MOVE;
+        break;
+    case CONNECT4_CLIENT_ROLE:
+        cnct4->my_move = WHITE_MOVE;
+        break;
+    default:
+        // the match server tells which side we play
+        cnct4->my_move = GAME_OVER;
+        break;
+    }
 
-    assert(0 <= row_num && row_num < 10);
-    assert(0 <= col_num && col_num < 10);
-
-    cnct4->sock_fd = init_sock(host_name, port_no, role);
-    cnct4->my_move = (role == CONNECT4_SERVER_ROLE) ? BLACK_MOVE : WHITE_MOVE;
-
-    new_game(&cnct4->game, col_num, row_num);
-    cnct4->grid.col_num = col_num;
-    cnct4->grid.row_num = row_num;
-    cnct4->grid.gap_size = grid_gap;
-    // X11Connect4_t *cnct4 = &othello;
-    // XSetErrorHandler(err_handler);
-    cnct4->disp = XOpenDisplay(NULL);
-    // if (cnct4->disp == NULL)
-    //     xerror("XOpenDisplay()");
-
-    cnct4->win = XCreateSimpleWindow(
-        cnct4->disp, RootWindow(cnct4->disp, DefaultScreen(cnct4->disp)),
-        0, 0, DEFAULT_SIZE_X, DEFAULT_SIZE_Y, GRID_LINE_WID,
-        BlackPixel(cnct4->disp, DefaultScreen(cnct4->disp)),
-        WhitePixel(cnct4->disp, DefaultScreen(cnct4->disp))
-    );
-    // XMapWindow(cnct4->disp, cnct4->win);
-    alloc_named_colors(cnct4);
-    create_GCs(cnct4);
-    set_foregrounds(cnct4);
-
-    // Set up the font
-    cnct4->font = XLoadQueryFont(cnct4->disp, FONT_NAME);
-    if (cnct4->font == NULL)
-        puts("font not found");
-    XSetFont(cnct4->disp, cnct4->GCs.black, cnct4->font->fid);
-
-
-    // puts("Good");
-
-    // Set up the Event Mask
-    XSelectInput(
-        cnct4->disp, cnct4->win,
-        ExposureMask | StructureNotifyMask |
-        ButtonPressMask |
-        PointerMotionMask | PointerMotionHintMask
-    );
-
-    // Set window name
-    XTextProperty text_prop;
-    XStringListToTextProperty(
-        &WINDOW_NAME, 1, &text_prop
-    );
-
-    // Set window minimum size
-    XSizeHints *size_hits = XAllocSizeHints();
-    size_hits->flags = PMinSize;
-    size_hits->min_width    = WINDOW_SIZE_X_MIN;
-    size_hits->min_height   = WINDOW_SIZE_Y_MIN;
-
-    XSetWMProperties(
-        cnct4->disp, cnct4->win,
-        &text_prop, &text_prop,
-        argv, argc, size_hits, NULL, NULL
-    );
-
-    cnct4->wm_delete_window = XInternAtom(
-        cnct4->disp, "WM_DELETE_WINDOW", False
-    );
-    XSetWMProtocols(
-        cnct4->disp, cnct4->win,
-        &cnct4->wm_delete_window, 1
-    );
-
-    XFree(text_prop.value);
-    XFree(size_hits);
-
-    XMapWindow(cnct4->disp, cnct4->win);
-    XFlush(cnct4->disp);
+    if (connect4_conn_open(&cnct4->conn, host_name, port_no,
+                role == CONNECT4_SERVER_ROLE, &cnct4->conn_opts) < 0) {
+        puts("Cannot listen for a client");
+        connect4_render_close(&cnct4->render);
+        exit(EXIT_FAILURE);
+    }
 }
 
-
-int min (int a, int b)
+/*
+ *  true when the board is the one text peers and old peers play
+ */
+bool default_geometry (X11Connect4_t *cnct4)
 {
-    return(a<b) ? a : b;
+    return cnct4->game.col_num == CONNECT4_DEFAULT_COL_NUM
+            && cnct4->game.row_num == CONNECT4_DEFAULT_ROW_NUM
+            && cnct4->game.win_len == CONNECT4_DEFAULT_WIN_LEN;
 }
 
-int max (int a, int b)
+/*
+ *  HELLO with the geometry we play
+ */
+Connect4_msg_t hello_msg (X11Connect4_t *cnct4)
 {
-    return (a>b) ? a : b;
+    return (Connect4_msg_t){
+        .type = CONNECT4_MSG_HELLO,
+        .version = CONNECT4_PROTO_VERSION,
+        .col_num = cnct4->game.col_num,
+        .row_num = cnct4->game.row_num,
+        .win_len = cnct4->game.win_len
+    };
 }
 
-bool
-is_on_grid (X11Connect4_t *cnct4, int cursor_x, int cursor_y, int *row, int *col)
+/*
+ *  the game socket is up
+ */
+void connected (X11Connect4_t *cnct4)
 {
-    Grid_t *grid = &cnct4->grid;
-
-    *row = -1 + (cursor_y - grid->pos_y)/(grid->cellsize_y + grid->gap_size);
-    *col = -1 + (cursor_x - grid->pos_x)/(grid->cellsize_x + grid->gap_size);
-
-    if (0 <= *row && *row < grid->row_num &&
-        0 <= *col && *col < grid->col_num)
-        return true;
-
-    return false;
-
+    cnct4->sock_fd = cnct4->conn.fd;
+    puts(cnct4->conn.status);
+
+    if (cnct4->resuming) {
+        // in one write, so the server never takes us for a new player
+        uint8_t buf[2*CONNECT4_MSG_MAX];
+        Connect4_msg_t hello = hello_msg(cnct4);
+        int len = connect4_encode_msg(CONNECT4_PROTO_BINARY, &hello, buf, sizeof(buf));
+        len += connect4_encode_msg(CONNECT4_PROTO_BINARY, &(Connect4_msg_t){
+            .type = CONNECT4_MSG_RESUME,
+            .token = cnct4->session_token,
+            .seq = connect4_get_move_num(&cnct4->game)
+        }, buf + len, sizeof(buf) - len);
+        if (send(cnct4->sock_fd, buf, len, MSG_NOSIGNAL) < 0)
+            perror("send");
+        cnct4->hello_sent = true;
+        return;
+    }
 
+    // ask the peer for binary frames; we keep sending text until it agrees.
+    // On another board the listening side speaks first too, so that a
+    // text peer is refused instead of both waiting
+    if (cnct4->binary_proto
+            && (cnct4->role != CONNECT4_SERVER_ROLE || !default_geometry(cnct4))) {
+        Connect4_msg_t hello = hello_msg(cnct4);
+        send_msg(cnct4, &hello);
+        cnct4->hello_sent = true;
+    }
 }
 
-void
-optimize_grid_pos (X11Connect4_t *cnct4, int win_width, int win_height)
+/*
+ *  Function name:
+ *      reconnect
+ *
+ *  Description:
+ *      after the link to the match server broke in the middle of a
+ *      game, start connecting again; connected() then resumes the
+ *      session instead of joining a new match
+ *
+ *  Input:
+ *      cnct4   :   game
+ *
+ *  Output:
+ *      return  :   true when reconnecting, false when the session is over
+ */
+bool reconnect (X11Connect4_t *cnct4)
 {
-    // (col_num)x(row_num) for the game board
-    // top row left column for labels
-    // bottom row for status text
-    // right column is empty
-
-    int nCellx = cnct4->grid.col_num;
-    int cellsize_x =
-        (win_width - (nCellx+1)*cnct4->grid.gap_size)/(nCellx+2);
+    if (!cnct4->link_lost || !cnct4->has_session
+            || connect4_get_game_state(&cnct4->game) == GAME_OVER)
+        return false;
+
+    connect4_conn_close(&cnct4->conn);
+    cnct4->sock_fd = -1;
+    cnct4->link_lost = false;
+    cnct4->resuming = true;
+    cnct4->proto_mode = CONNECT4_PROTO_TEXT;
+    cnct4->hello_sent = false;
+    connect4_decoder_init(&cnct4->decoder);
+
+    return connect4_conn_open(&cnct4->conn, cnct4->host_name, cnct4->port_no,
+                false, &cnct4->conn_opts) == 0;
+}
 
-    int nCelly = cnct4->grid.row_num;
-    int cellsize_y =
-        (win_height - (nCelly+1)*cnct4->grid.gap_size)/(nCelly+2);
+/*
+ *  drop my disk into a column and tell the opponent
+ */
+void play_column (X11Connect4_t *cnct4, int col)
+{
+    if (cnct4->sock_fd < 0
+            || connect4_get_game_state(&cnct4->game) != cnct4->my_move)
+        return;
+    // another board is only played once the peer has agreed to it
+    if (cnct4->proto_mode != CONNECT4_PROTO_BINARY && !default_geometry(cnct4))
+        return;
 
-    if (cellsize_x < cellsize_y)
-        cnct4->grid.cellsize_x = cnct4->grid.cellsize_y = cellsize_x;
-    else
-        cnct4->grid.cellsize_x = cnct4->grid.cellsize_y = cellsize_y;
+    // the server applies the move and sends it back
+    if (cnct4->authoritative) {
+        if (cnct4->move_sent || connect4_landing_row(&cnct4->game, col) < 0)
+            return;
+        if (send_msg(cnct4, &(Connect4_msg_t){.type = CONNECT4_MSG_DROP, .col = col}) == 0)
+            cnct4->move_sent = true;
+        return;
+    }
 
-    cnct4->grid.size_x = (nCellx+2)*cnct4->grid.cellsize_x + (nCellx+2);
-    cnct4->grid.size_y = (nCelly+2)*cnct4->grid.cellsize_y + (nCelly+2);
+    int row = connect4_drop(&cnct4->game, col);
+    if (row < 0)
+        return;
 
-    cnct4->grid.pos_x = win_width/2 - cnct4->grid.size_x/2;
-    cnct4->grid.pos_y = win_height/2 - cnct4->grid.size_y/2;
+    // text peers only know PLACE, which has to carry the row
+    send_msg(cnct4, &(Connect4_msg_t){
+        .type = (cnct4->proto_mode == CONNECT4_PROTO_BINARY)
+                ? CONNECT4_MSG_DROP : CONNECT4_MSG_PLACE,
+        .row = row,
+        .col = col
+    });
 }
 
-
-void draw_string (X11Connect4_t *cnct4, const char *str, int xpos, int ypos)
+/*
+ *  play the column of a tree search, or a random legal column, when it
+ *  is my turn
+ */
+void autoplay (X11Connect4_t *cnct4)
 {
-    int width = XTextWidth(cnct4->font, str, strlen(str));
-    int height = cnct4->font->ascent + cnct4->font->descent;
-
-    XDrawString(
-        cnct4->disp, cnct4->win,
-        cnct4->GCs.black,
-        xpos - width/2, ypos + height/2,
-        str, strlen(str)
-    );
+    if (cnct4->sock_fd < 0 || cnct4->move_sent
+            || connect4_get_game_state(&cnct4->game) != cnct4->my_move)
+        return;
+
+    if (cnct4->mcts_budget_sec > 0) {
+        Connect4_mcts_result_t result;
+        if (connect4_mcts_search(&cnct4->mcts, &cnct4->game, cnct4->mcts_budget_sec,
+                                    &result) == 0) {
+            printf("MCTS: column %d, win %.1f%%, %llu playouts in %.2f s (%.0f/s)\n",
+                    result.col + 1, result.win_rate*100, (unsigned long long)result.playouts,
+                    result.sec, result.playouts/result.sec);
+            play_column(cnct4, result.col);
+        }
+        return;
+    }
+
+    int col_num = cnct4->game.col_num;
+    int start = connect4_rand_next(&cnct4->seed)%col_num;
+    for (int i = 0; i < col_num; i++) {
+        int col = (start + i)%col_num;
+        if (connect4_landing_row(&cnct4->game, col) >= 0) {
+            play_column(cnct4, col);
+            return;
+        }
+    }
 }
 
-void draw_cell (X11Connect4_t *cnct4, int row, int col)
+void finalize (X11Connect4_t *cnct4)
 {
-    Grid_t *grid = &cnct4->grid;
-
-    // 一番上の行と右の列はラベル用のセルなので飛ばす
-    int x = grid->pos_x + (col+1)*(grid->cellsize_x + grid->gap_size);
-    int y = grid->pos_y + (row+1)*(grid->cellsize_y + grid->gap_size);
-
-    bool is_highlight = (
-        row == grid->selected_row &&
-        col == grid->selected_col
-    );
-
-    XFillRectangle(
-        cnct4->disp, cnct4->win,
-        is_highlight ? cnct4->GCs.board_highlight : cnct4->GCs.board,
-        x, y, cnct4->grid.cellsize_x, cnct4->grid.cellsize_y
-    );
-
-    Cell_state_t cs;
-
-    if ((cs = connect4_get_cell_state(&cnct4->game, row, col)) != CELL_EMPTY) {
-        XFillArc(cnct4->disp, cnct4->win,
-            cs == BLACK_MOVE ? cnct4->GCs.black : cnct4->GCs.white,
-            x, y, grid->cellsize_x, grid->cellsize_y,
-            0, 360 * 64
-        );
-    }
+    connect4_render_close(&cnct4->render);
+    // owns the game socket
+    connect4_conn_close(&cnct4->conn);
+    if (cnct4->mcts_budget_sec > 0)
+        connect4_mcts_finalize(&cnct4->mcts);
 }
 
-void draw_grid (X11Connect4_t *cnct4)
+int send_msg (X11Connect4_t *cnct4, const Connect4_msg_t *msg)
 {
-    XClearWindow(cnct4->disp, cnct4->win);
-
-    Grid_t *grid = &cnct4->grid;
-    int nCellx = grid->col_num;
-    int nCelly = grid->row_num;
-
-    XFillRectangle(
-        cnct4->disp, cnct4->win,
-        cnct4->GCs.black,
-        grid->pos_x + grid->cellsize_x,
-        grid->pos_y + grid->cellsize_y,
-        nCellx*grid->cellsize_x + (nCellx+1)*grid->gap_size,
-        nCelly*grid->cellsize_y + (nCelly+1)*grid->gap_size
-    );
-
-    for (int row = 0; row < grid->row_num; row++) {
-        int x = grid->pos_x + grid->cellsize_x/2;
-        int y = grid->pos_y
-                + (row + 1)*(grid->cellsize_y+grid->gap_size)
-                + grid->cellsize_y/2;
-
-        char label[] = {"123456789"[row], '\0'};
-        draw_string(cnct4, label, x, y);
+    uint8_t buf[CONNECT4_MSG_MAX];
+    int len = connect4_encode_msg(cnct4->proto_mode, msg, buf, sizeof(buf));
+    if (len < 0) {
+        puts("Error: message can not be encoded");
+        return -1;
     }
 
-    for (int col = 0; col < grid->col_num; col++) {
-        int x = grid->pos_x
-                + (col + 1)*(grid->cellsize_x+grid->gap_size)
-                + grid->cellsize_x/2;
-        int y = grid->pos_y + grid->cellsize_y/2;
-
-        char label[] = {"ABCDEFGHIJ"[col], '\0'};
-        draw_string(cnct4, label, x, y);
+    // a broken link shows up on the next read, not as SIGPIPE
+    if (send(cnct4->sock_fd, buf, len, MSG_NOSIGNAL) < 0) {
+        perror("send");
+        return -1;
     }
-
-    for (int row = 0; row < grid->row_num; row++)
-        for (int col = 0; col < grid->col_num; col++)
-            draw_cell(cnct4, row, col);
+    return 0;
 }
 
-void select_cell (X11Connect4_t *cnct4, int row, int col)
+/*
+ *  return false when the game session is over
+ */
+bool handle_msg (X11Connect4_t *cnct4, const Connect4_msg_t *msg)
 {
-    int old_col = cnct4->grid.selected_col;
-    int old_row = cnct4->grid.selected_row;
-
-    // すでに選択済み
-    if (row == old_row && col == old_col)
-        return;
+    Connect4_msg_t error_msg = {.type = CONNECT4_MSG_ERROR};
+
+    switch (msg->type)
+    {
+    case CONNECT4_MSG_HELLO: {
+        // the peer asks for (or agrees to) binary frames, on its board
+        int col_num = msg->col_num ? msg->col_num : CONNECT4_DEFAULT_COL_NUM;
+        int row_num = msg->col_num ? msg->row_num : CONNECT4_DEFAULT_ROW_NUM;
+        int win_len = msg->col_num ? msg->win_len : CONNECT4_DEFAULT_WIN_LEN;
+        if (col_num != cnct4->game.col_num || row_num != cnct4->game.row_num
+                || win_len != cnct4->game.win_len) {
+            printf("Error: the opposit plays %dx%d with %d in a row\n",
+                    col_num, row_num, win_len);
+            send_msg(cnct4, &error_msg);
+            return false;
+        }
+        // only the match server referees; a peer in P2P plays as before
+        cnct4->authoritative = cnct4->role == CONNECT4_MATCH_ROLE
+                                && msg->version >= CONNECT4_PROTO_AUTHORITATIVE;
+        cnct4->proto_mode = CONNECT4_PROTO_BINARY;
+        // a peer that spoke first waits for our HELLO; one that answered
+        // ours needs nothing more
+        if (!cnct4->hello_sent) {
+            Connect4_msg_t hello = hello_msg(cnct4);
+            send_msg(cnct4, &hello);
+            cnct4->hello_sent = true;
+        }
+        return true;
+    }
 
-    cnct4->grid.selected_col = col;
-    cnct4->grid.selected_row = row;
+    case CONNECT4_MSG_PLACE:
+    case CONNECT4_MSG_DROP:
+        // every accepted move, ours too; the result comes as RESULT
+        if (cnct4->authoritative) {
+            bool mine = connect4_get_game_state(&cnct4->game) == cnct4->my_move;
+            if (mine != cnct4->move_sent || connect4_drop(&cnct4->game, msg->col) < 0) {
+                puts("Error: the server sent a move out of turn");
+                return false;
+            }
+            cnct4->move_sent = false;
+            return true;
+        }
+        // a text peer plays the default board
+        if (cnct4->proto_mode != CONNECT4_PROTO_BINARY && !default_geometry(cnct4)) {
+            puts("Error: the opposit does not support this board");
+            send_msg(cnct4, &error_msg);
+            return false;
+        }
+        // my move, not opposit's move
+        if (connect4_get_game_state(&cnct4->game) == cnct4->my_move) {
+            puts("Error: it is your turn, but the oppsit made move");
+            send_msg(cnct4, &error_msg);
+            return false;
+        }
+        if ((msg->type == CONNECT4_MSG_DROP)
+                ? connect4_drop(&cnct4->game, msg->col) < 0
+                : connect4_make_move(&cnct4->game, msg->row, msg->col) < 0) {
+            send_msg(cnct4, &error_msg);
+            puts("Error: Invalid move by the opposit");
+            return false;
+        }
+        if (connect4_get_game_state(&cnct4->game) == GAME_OVER)
+            if (connect4_get_game_result(&cnct4->game) != connect4_get_my_win_result_value(cnct4->my_move)) {
+                send_msg(cnct4, &(Connect4_msg_t){.type = CONNECT4_MSG_YOUWIN});
+                puts("You Lose");
+                return false;
+            }
+        return true;
 
-    // ハイライトを消すため
-    if (0 <= old_row)
-        draw_cell(cnct4, old_row, old_col);
+    case CONNECT4_MSG_ERROR:
+        if (connect4_get_game_result(&cnct4->game) == GAME_DRAW) {
+            puts("Game: Draw");
+            return true;
+        }
+        puts("Some error occured!!");
+        return false;
+
+    case CONNECT4_MSG_YOUWIN:
+        puts("congratulations!! You win!!");
+        return false;
+
+    case CONNECT4_MSG_RESULT:
+        if (msg->result == GAME_DRAW)
+            puts("Game: Draw");
+        else if (msg->result == connect4_get_my_win_result_value(cnct4->my_move))
+            puts("congratulations!! You win!!");
+        else
+            puts("You Lose");
+        return false;
+
+    case CONNECT4_MSG_YOUBLACK:
+        puts("Match started: you are black");
+        cnct4->my_move = BLACK_MOVE;
+        return true;
 
-    if (0 <= row)
-        draw_cell(cnct4, row, col);
-}
+    case CONNECT4_MSG_YOUWHITE:
+        puts("Match started: you are white");
+        cnct4->my_move = WHITE_MOVE;
+        return true;
 
-void highlight_cell_mouse_on (X11Connect4_t *cnct4)
-{
-    Window root, child;
-    int root_x, root_y;
-    int win_x, win_y;
-    unsigned int mask;
-
-    int rslt = XQueryPointer(
-        cnct4->disp,
-        cnct4->win,
-        &root, &child,
-        &root_x, &root_y,
-        &win_x, &win_y,
-        &mask
-    );
-    if (!rslt)
-        return;
+    case CONNECT4_MSG_SESSION:
+        cnct4->session_token = msg->token;
+        cnct4->has_session = true;
+        return true;
 
-    int row, col;
-    if (is_on_grid(cnct4, win_x, win_y, &row, &col))
-        select_cell(cnct4, row, col);
-    else
-        select_cell(cnct4, -1, -1); // 以前のハイライトを消すため
+    case CONNECT4_MSG_RESUMED: {
+        // the moves the server missed are ours; the ones we missed follow
+        int move_num = connect4_get_move_num(&cnct4->game);
+        printf("Resumed at move %d\n", msg->seq);
+        cnct4->resuming = false;
+        // a move the server did not get is ours to choose again; one it
+        // got comes back with the moves we missed
+        if (msg->seq <= move_num)
+            cnct4->move_sent = false;
+        for (int i = msg->seq; i < move_num; i++)
+            send_msg(cnct4, &(Connect4_msg_t){
+                .type = CONNECT4_MSG_DROP,
+                .col = connect4_get_move_col(&cnct4->game, i)
+            });
+        return true;
+    }
 
+    default:
+        break;
+    }
 
+    return true;
 }
 
-void mouse_click (X11Connect4_t *cnct4)
+/*
+ *  read what the socket has and handle every complete message;
+ *  return false when the game session is over
+ */
+bool handle_sock (X11Connect4_t *cnct4)
 {
-    if (connect4_get_game_state(&cnct4->game) != cnct4->my_move)
-        return;
-
-    Grid_t *grid = &cnct4->grid;
-    if (!is_valid_move(&cnct4->game, grid->selected_row, grid->selected_col))
-        return;
-
-    connect4_make_move(&cnct4->game, cnct4->grid.selected_row, cnct4->grid.selected_col);
-
-    char buf[BUF_MAX];
-    snprintf(buf, sizeof(buf), "PLACE-%d%d", grid->selected_col, grid->selected_row);
-    if (write(cnct4->sock_fd, buf, strlen(buf)) < 0) {
-        perror("write");
-        return;
+    size_t avail;
+    uint8_t *space = connect4_decoder_space(&cnct4->decoder, &avail);
+    ssize_t len = read(cnct4->sock_fd, space, avail);
+    if (len < 0) {
+        perror("read");
+        cnct4->link_lost = true;
+        return false;
     }
+    if (len == 0) {
+        puts("Connection closed by the opposit");
+        cnct4->link_lost = true;
+        return false;
+    }
+    connect4_decoder_commit(&cnct4->decoder, len);
+
+    // one read may carry several messages, or only a part of one
+    Connect4_msg_t msg;
+    int ret;
+    while ((ret = connect4_decoder_next(&cnct4->decoder, &msg)) > 0)
+        if (!handle_msg(cnct4, &msg))
+            return false;
+    if (ret < 0) {
+        puts("Recieved invalid messeage");
+        send_msg(cnct4, &(Connect4_msg_t){.type = CONNECT4_MSG_ERROR});
+        return false;
+    }
+    return true;
 }
 
-int finalize (X11Connect4_t *cnct4)
-{
-    XFreeGC(cnct4->disp, cnct4->GCs.black);
-    XFreeGC(cnct4->disp, cnct4->GCs.white);
-    XFreeGC(cnct4->disp, cnct4->GCs.board);
-    XFreeGC(cnct4->disp, cnct4->GCs.black_highlight);
-    XFreeGC(cnct4->disp, cnct4->GCs.white_highlight);
-    XFreeGC(cnct4->disp, cnct4->GCs.board_highlight);
-
-    XFreeFont(cnct4->disp, cnct4->font);
-
-    XCloseDisplay(cnct4->disp);
-
-    close(cnct4->sock_fd);
-}
-
+/*
+ *  One wait point for the renderer's input (the X connection, stdin or
+ *  nothing) and the network: the connection being set up, then the game
+ *  socket. The process sleeps in poll() until one of them has input or
+ *  the next deadline (connection timeout, backoff, wakeup report) is
+ *  due.
+ *
+ *  The renderer may have read input ahead into its own queue (Xlib
+ *  does), so the queue is drained before every poll().
+ */
 void loop (X11Connect4_t *cnct4)
 {
-    char buf[BUF_MAX];
-    fd_set fd_mask;
-    XEvent event;
-    bool redraw_flg;
-    char *ERROR_MSG = "ERROR";
-    char *YOUWIN_MSG = "YOU-WIN";
+    Connect4_render_t *render = &cnct4->render;
+    Connect4_conn_t *conn = &cnct4->conn;
+    Connect4_input_t input;
+    long report_ms = connect4_now_ms() + WAKEUP_REPORT_MS;
+    struct pollfd fds[POLL_FD_MAX];
+
+    cnct4->wakeup_num = 0;
+    render->round_trip_num = 0;
     for (;;) {
-        FD_ZERO(&fd_mask);
-        FD_SET(cnct4->sock_fd, &fd_mask);
-        int select_ret = select(cnct4->sock_fd + 1,
-                    &fd_mask, NULL, NULL,
-                    &(struct timeval){.tv_usec = 1}
-        );
-        if (select_ret < 0) {
-            perror("select");
-            return;
-        }
-
-        if (FD_ISSET(cnct4->sock_fd, &fd_mask)) {
-            redraw_flg = true;
-            ssize_t len = read(cnct4->sock_fd, buf, sizeof(buf));
-            if (len < 0) {
-                perror("read");
+        while (connect4_render_next_input(render, &input)) {
+            if (input.type == CONNECT4_INPUT_QUIT)
                 return;
-            }
-            if (strstr(buf, "PLACE-")) {
-                // my move, not opposit's move
-                if (connect4_get_game_state(&cnct4->game) == cnct4->my_move) {
-                    puts("Error: it is your turn, but the oppsit made move");
-                    if (write(cnct4->sock_fd, ERROR_MSG, strlen(ERROR_MSG)) < 0) {
-                        perror("write");
-                        return;
-                    }
-                    return;
-                }
-                char xc, yc;
-                sscanf(buf, "PLACE-%c%c", &xc, &yc);
-                int col = xc - '0';
-                int row = yc - '0';
-                if (!is_valid_move(&cnct4->game, row, col)) {
-                    if (write(cnct4->sock_fd, ERROR_MSG, strlen(ERROR_MSG)) < 0) {
-                        perror("write");
-                        return;
-                    }
-                    puts("Error: Invalid move by the opposit");
-                    // printf("%d:%d\n", row, col);
-                    return;
-                }
-                connect4_make_move(&cnct4->game, row, col);
-                if (connect4_get_game_state(&cnct4->game) == GAME_OVER)
-                    if (connect4_get_game_result(&cnct4->game) != connect4_get_my_win_result_value(cnct4->my_move)) {
-                        write(cnct4->sock_fd, YOUWIN_MSG, strlen(YOUWIN_MSG));
-                        puts("You Lose");
-                        return;
-                    }
-            }
-            else if (strstr(buf, ERROR_MSG)) {
-                if (connect4_get_game_result(&cnct4->game) == GAME_DRAW) {
-                    puts("Game: Draw");
-                }
-                else {
-                    puts("Some error occured!!");
-                    return;
-                }
-            }
-            else if (strstr(buf, YOUWIN_MSG)) {
-                puts("congratulations!! You win!!");
-                return;
-            }
-            else {
-                puts("Recieved invalid messeage");
-                if (write(cnct4->sock_fd, ERROR_MSG, strlen(ERROR_MSG)) < 0) {
-                    perror("write");
-                    return;
-                }
-                return;
-            }
+            play_column(cnct4, input.col);
         }
-        if (redraw_flg) {
-            draw_grid(cnct4);
-            redraw_flg = false;
+        if (cnct4->autoplay)
+            autoplay(cnct4);
+        connect4_render_set_status(render, conn->status);
+        connect4_render_update(render);
+
+        int timeout = connect4_conn_timeout(conn);
+        if (cnct4->report_wakeups) {
+            long now = connect4_now_ms();
+            if (now >= report_ms) {
+                long elapsed = now - report_ms + WAKEUP_REPORT_MS;
+                printf("wakeups: %lu/s, X round-trips: %lu/s\n",
+                        cnct4->wakeup_num*1000/elapsed,
+                        render->round_trip_num*1000/elapsed);
+                cnct4->wakeup_num = 0;
+                render->round_trip_num = 0;
+                report_ms = now + WAKEUP_REPORT_MS;
+            }
+            if (timeout < 0 || report_ms - now < timeout)
+                timeout = report_ms - now;
         }
-        if (!XPending(cnct4->disp))
-            continue;
-
-        XNextEvent(cnct4->disp, &event);
-        // XClearWindow(cnct4->disp, cnct4->win);
-        // XDrawString(cnct4->disp, cnct4->win, cnct4->GCs.board,
-        // 20, 20, "WE", 2);
-        // draw_string(cnct4, &"123456789"[0], 0, 0);
-
-        switch (event.type)
-        {
-            case ConfigureNotify:
-                optimize_grid_pos(cnct4,
-                    event.xconfigure.width,
-                    event.xconfigure.height
-                );
-                break;
-            case Expose:
-                if (event.xexpose.count == 0)
-                    redraw_flg = true;
-                break;
-            case MotionNotify:
-                highlight_cell_mouse_on(cnct4);
-                break;
-            case ButtonPress:
-                highlight_cell_mouse_on(cnct4);
-                mouse_click(cnct4);
-                redraw_flg = true;
 
+        // the network first, then the renderer if it has input
+        int net_num;
+        if (cnct4->sock_fd >= 0) {
+            fds[0] = (struct pollfd){.fd = cnct4->sock_fd, .events = POLLIN};
+            net_num = 1;
+        }
+        else {
+            net_num = connect4_conn_pollfds(conn, fds, POLL_FD_MAX - 1);
+        }
+        int input_fd = connect4_render_input_fd(render);
+        int fd_num = net_num;
+        if (input_fd >= 0)
+            fds[fd_num++] = (struct pollfd){.fd = input_fd, .events = POLLIN};
+
+        int poll_ret = poll(fds, fd_num, timeout);
+        if (poll_ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return;
+        }
+        // deadlines are not counted
+        if (poll_ret > 0)
+            cnct4->wakeup_num++;
+
+        if (cnct4->sock_fd < 0) {
+            switch (connect4_conn_step(conn, fds, net_num))
+            {
+            case CONNECT4_CONN_CONNECTED:
+                connected(cnct4);
                 break;
-            case ClientMessage:
-                if (event.xclient.data.l[0] == cnct4->wm_delete_window) {
-                    puts("Catch quit flag");
-                    return;
-                }
-
+            case CONNECT4_CONN_FAILED:
+                puts(conn->status);
+                return;
             default:
                 break;
+            }
+        }
+        else if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!handle_sock(cnct4) && !reconnect(cnct4))
+                return;
+        }
+
+        if (input_fd >= 0 && fds[net_num].revents & (POLLHUP | POLLERR)) {
+            puts("Lost the display connection");
+            return;
         }
     }
 }
@@ -686,40 +592,147 @@ int main (int argc, char *argv[])
     X11Connect4_t cnct4;
     Connect4_role_t role;
     char buf[BUF_MAX];
+    bool binary_proto = false;
+    bool report_wakeups = false;
+    bool autoplay = false;
+    int mcts_budget_ms = 0;
+    int mcts_thread_num = 1;
+    const char *renderer = NULL;
+    const char *match_host = NULL;
+    Connect4_conn_opts_t conn_opts = CONNECT4_CONN_OPTS_DEFAULT;
+    int port_no = DEFAULT_PORT_NO;
+    int col_num = CONNECT4_DEFAULT_COL_NUM, row_num = CONNECT4_DEFAULT_ROW_NUM;
+    int win_len = CONNECT4_DEFAULT_WIN_LEN;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "bwar:m:p:t:n:l:s:k:M:j:")) != -1) {
+        switch (opt)
+        {
+        case 'b':
+            // ask the peer for the binary protocol
+            binary_proto = true;
+            break;
+        case 'w':
+            // print how often the event loop wakes up and waits for X
+            report_wakeups = true;
+            break;
+        case 'a':
+            // play random columns instead of waiting for input
+            autoplay = true;
+            break;
+        case 'r':
+            // x11, term, null or fb[:path]
+            renderer = optarg;
+            break;
+        case 'm':
+            // join the match server on this host without asking
+            match_host = optarg;
+            break;
+        case 't':
+            // give up on an address after this many milliseconds
+            conn_opts.connect_timeout_ms = atoi(optarg);
+            break;
+        case 'n':
+            // connect retries, -1 for no limit
+            conn_opts.retry_max = atoi(optarg);
+            break;
+        case 'l':
+            // as the server, wait this many seconds for a client
+            conn_opts.accept_timeout_ms = atoi(optarg)*1000;
+            break;
+        case 'p':
+            port_no = atoi(optarg);
+            break;
+        case 's':
+            // board size as colsxrows
+            if (sscanf(optarg, "%dx%d", &col_num, &row_num) != 2)
+                col_num = 0;
+            break;
+        case 'k':
+            // disks in a row that win
+            win_len = atoi(optarg);
+            break;
+        case 'M':
+            // autoplay with a tree search of this many milliseconds a move
+            mcts_budget_ms = atoi(optarg);
+            autoplay = mcts_budget_ms > 0;
+            break;
+        case 'j':
+            // tree search threads
+            mcts_thread_num = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-b] [-w] [-a] [-r renderer] [-m host]"
+                    " [-p port]\n\t[-t connect_ms] [-n retries] [-l listen_s]"
+                    " [-s colsxrows] [-k win_len]\n\t[-M search_ms] [-j threads]\n", argv[0]);
+            return 1;
+        }
+    }
 
-    // Select role
-    do {
-        printf("Select your role\n");
-        printf("%d: Server\n", CONNECT4_SERVER_ROLE);
-        printf("%d: Client\n", CONNECT4_CLIENT_ROLE);
-        fgets(buf, sizeof(buf), stdin);
-        role = (Connect4_role_t)strtol(buf, NULL, 10);
-    } while (role != CONNECT4_SERVER_ROLE && role != CONNECT4_CLIENT_ROLE);
-
-    // Host name
-    if (role == CONNECT4_CLIENT_ROLE) {
-        do {
-            printf("Input server's host name: ");
-            fgets(buf, sizeof(buf), stdin);
-        } while (strlen(buf) == 0 || buf[0] == '\n');
+    // only HELLO can tell the peer about another board
+    if (col_num != CONNECT4_DEFAULT_COL_NUM || row_num != CONNECT4_DEFAULT_ROW_NUM
+            || win_len != CONNECT4_DEFAULT_WIN_LEN)
+        binary_proto = true;
+
+    // the terminal renderer reads moves from fd 0 after the prompts
+    setvbuf(stdin, NULL, _IONBF, 0);
 
-        if (buf[strlen(buf) - 1] == '\n')
-            buf[strlen(buf) - 1] = '\0';
+    if (match_host != NULL) {
+        role = CONNECT4_MATCH_ROLE;
+        snprintf(buf, sizeof(buf), "%s", match_host);
     }
     else {
-        int ret = gethostname(buf, sizeof(buf));
-        if (ret < 0) {
-            perror("gethostname");
-            return 1;
+        // Select role
+        do {
+            printf("Select your role\n");
+            printf("%d: Server\n", CONNECT4_SERVER_ROLE);
+            printf("%d: Client\n", CONNECT4_CLIENT_ROLE);
+            printf("%d: Join a match server\n", CONNECT4_MATCH_ROLE);
+            fgets(buf, sizeof(buf), stdin);
+            role = (Connect4_role_t)strtol(buf, NULL, 10);
+        } while (role != CONNECT4_SERVER_ROLE && role != CONNECT4_CLIENT_ROLE
+                    && role != CONNECT4_MATCH_ROLE);
+
+        // Host name
+        if (role != CONNECT4_SERVER_ROLE) {
+            do {
+                printf("Input server's host name: ");
+                fgets(buf, sizeof(buf), stdin);
+            } while (strlen(buf) == 0 || buf[0] == '\n');
+
+            if (buf[strlen(buf) - 1] == '\n')
+                buf[strlen(buf) - 1] = '\0';
+        }
+        else {
+            int ret = gethostname(buf, sizeof(buf));
+            if (ret < 0) {
+                perror("gethostname");
+                return 1;
+            }
+            printf("This server name: %s\n", buf);
         }
-        printf("This server name: %s\n", buf);
     }
 
-    init(&cnct4, argv, argc,
-            BOARD_COL_NUM, BOARD_ROW_NUM, 1,
-            role, buf, DEFAULT_PORT_NO);
+    init(&cnct4, col_num, row_num, win_len,
+            role, buf, port_no, binary_proto, renderer, &conn_opts);
+    cnct4.report_wakeups = report_wakeups;
+    cnct4.autoplay = autoplay;
+    cnct4.seed = (uint64_t)time(NULL)<<20 ^ getpid();
+    cnct4.mcts_budget_sec = 0;
+    if (mcts_budget_ms > 0) {
+        if (connect4_mcts_init(&cnct4.mcts, CONNECT4_MCTS_NODE_DEFAULT) < 0) {
+            perror("connect4_mcts_init");
+            finalize(&cnct4);
+            return 1;
+        }
+        connect4_mcts_set_thread_num(&cnct4.mcts, mcts_thread_num);
+        cnct4.mcts.seed = cnct4.seed | 1;
+        cnct4.mcts_budget_sec = mcts_budget_ms*1e-3;
+    }
 
     loop(&cnct4);
+    // the final position
+    connect4_render_update(&cnct4.render);
     // getchar();
 
     finalize(&cnct4);
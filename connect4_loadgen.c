@@ -0,0 +1,885 @@
+/*
+ *  Connect four load generator
+ *
+ *  usage: connect4_loadgen [-m host] [-p port] [-c clients] [-d seconds]
+ *                          [-P text|binary|mixed] [-o random|greedy]
+ *                          [-s colsxrows] [-k win_len] [-S seed]
+ *
+ *  Opens the given number of player connections to a match server (see
+ *  connect4_server.c) and keeps them all playing until the time is up:
+ *  a client that finishes its game connects again for the next one.
+ *  The server pairs the clients with each other, so every game has both
+ *  of its players here. Everything runs on one epoll loop without a
+ *  thread per client, so a few thousand clients fit one process.
+ *
+ *  Clients speak the text protocol ("PLACE-cr") or switch to binary
+ *  frames with HELLO, as the front end does; -P mixed alternates. A
+ *  board other than 7x6 with 4 in a row needs binary clients.
+ *
+ *  <<Measurements>>
+ *
+ *  round trip  :   from sending a move to receiving the opponent's next
+ *                  move, i.e. server -> opponent -> server -> us. Both
+ *                  players are in this process and pick their moves in
+ *                  well under a microsecond, so it is two relays through
+ *                  the server plus the time this loop takes to get to
+ *                  the opponent's socket. Kept in a log-linear histogram
+ *                  (1/16 of a power of two wide buckets).
+ *  accepted    :   from sending a move to getting it back from a server
+ *                  that plays the moves (binary clients, see
+ *                  <<Authoritative server>> in connect4_proto.h): one
+ *                  relay, with the same histogram
+ *  throughput  :   moves sent and games finished per second
+ *  errors      :   failed connects, ERROR from the server, illegal or
+ *                  undecodable messages, connections closed in the
+ *                  middle of a game and clients that heard nothing for
+ *                  CLIENT_TIMEOUT_MS; the rate is per connection tried,
+ *                  a connection being one game
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "connect4.h"
+#include "connect4_proto.h"
+#include "connect4_util.h"
+
+#define DEFAULT_CLIENT_NUM 1000
+#define DEFAULT_DURATION_S 10
+#define EVENT_MAX 256
+#define TICK_MS 50              // timeouts and retries are looked at this often
+#define CLIENT_TIMEOUT_MS 10000
+#define RECONNECT_MS 200        // after a failed connect
+#define HIST_SUB_BITS 4
+#define HIST_SUB_NUM (1<<HIST_SUB_BITS)
+#define HIST_BUCKET_NUM (64*HIST_SUB_NUM)
+static int DEFAULT_PORT_NO = 20000;
+
+typedef enum {
+    CLIENT_IDLE,        // not connected, opens at restart_ns
+    CLIENT_CONNECTING,
+    CLIENT_WAITING,     // for YOU-BLACK or YOU-WHITE
+    CLIENT_PLAYING,
+    CLIENT_ENDING       // game over, waiting for the server to close
+} Client_state_t;
+
+typedef enum {
+    PLAYER_RANDOM,
+    PLAYER_GREEDY       // wins when it can and avoids giving a win away
+} Player_t;
+
+typedef struct Client {
+    int fd;             // -1 while idle
+    Client_state_t state;
+    bool binary;        // sends HELLO after connecting
+    Connect4_proto_mode_t proto_mode;
+    bool authoritative; // the server sends our moves back and RESULT
+    Game_state_t my_move;
+    long move_ns;       // our last move went out then, 0 when no reply is due
+    long active_ns;     // last message or state change, for timeouts
+    long restart_ns;    // of an idle client
+    Connect4_decoder_t decoder;
+    Connect4_t game;
+} Client_t;
+
+typedef struct Histogram {
+    uint64_t counts[HIST_BUCKET_NUM];
+    uint64_t num;
+    uint64_t max;
+} Histogram_t;
+
+typedef struct Loadgen_stats {
+    unsigned long connects;     // connections tried, one per game
+    unsigned long games, moves;
+    unsigned long results[3];   // black wins, white wins, draws
+    unsigned long connect_errors, server_errors, protocol_errors, dropped, timeouts;
+} Loadgen_stats_t;
+
+typedef struct Loadgen {
+    int epoll_fd;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    int col_num, row_num, win_len;
+    Player_t player;
+    uint64_t seed;
+    bool stopping;      // no more games are started
+    Client_t *clients;
+    int client_num;
+    Histogram_t round_trip;
+    Histogram_t accepted;   // our move back from the server, authoritative only
+    Loadgen_stats_t stats;
+} Loadgen_t;
+
+static volatile sig_atomic_t quit_flg = 0;
+
+static void
+on_signal (int signo)
+{
+    quit_flg = 1;
+}
+
+// --------------------------------------------------
+// <Histogram>
+
+/*
+ *  values below HIST_SUB_NUM have a bucket each; above, every power of
+ *  two is split into HIST_SUB_NUM buckets
+ */
+static int
+hist_bucket (uint64_t value)
+{
+    if (value < HIST_SUB_NUM)
+        return value;
+
+    int exp = 63 - __builtin_clzll(value);
+    int sub = (value>>(exp - HIST_SUB_BITS)) & (HIST_SUB_NUM - 1);
+    return (exp - HIST_SUB_BITS + 1)*HIST_SUB_NUM + sub;
+}
+
+// largest value of a bucket
+static uint64_t
+hist_bucket_max (int bucket)
+{
+    if (bucket < HIST_SUB_NUM)
+        return bucket;
+
+    int exp = bucket/HIST_SUB_NUM + HIST_SUB_BITS - 1;
+    uint64_t sub = bucket%HIST_SUB_NUM;
+    return ((HIST_SUB_NUM + sub + 1)<<(exp - HIST_SUB_BITS)) - 1;
+}
+
+static void
+hist_add (Histogram_t *hist, uint64_t value)
+{
+    hist->counts[hist_bucket(value)]++;
+    hist->num++;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+/*
+ *  smallest bucket bound that fraction of the values do not exceed
+ */
+static uint64_t
+hist_percentile (const Histogram_t *hist, double fraction)
+{
+    uint64_t want = (uint64_t)(fraction*hist->num + 0.5);
+    uint64_t seen = 0;
+
+    if (want == 0)
+        want = 1;
+    for (int i = 0; i < HIST_BUCKET_NUM; i++) {
+        seen += hist->counts[i];
+        if (seen >= want) {
+            uint64_t bound = hist_bucket_max(i);
+            return (bound < hist->max) ? bound : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// </Histogram>
+// --------------------------------------------------
+// <Players>
+
+/*
+ *  a column that wins at once, or else a random one of those after
+ *  which the opponent can not win at once, or else any legal column
+ */
+static int
+greedy_col (Connect4_t *game, uint64_t *seed)
+{
+    int safe[CONNECT4_BITS_MAX], safe_num = 0;
+    int legal[CONNECT4_BITS_MAX], legal_num = 0;
+
+    for (int col = 0; col < game->col_num; col++) {
+        if (connect4_drop(game, col) < 0)
+            continue;
+        legal[legal_num++] = col;
+        if (connect4_get_game_state(game) == GAME_OVER) {
+            bool won = connect4_get_game_result(game) != GAME_DRAW;
+            connect4_unmake_move(game);
+            if (won)
+                return col;
+            safe[safe_num++] = col;
+            continue;
+        }
+
+        bool lost = false;
+        for (int reply = 0; reply < game->col_num && !lost; reply++) {
+            if (connect4_drop(game, reply) < 0)
+                continue;
+            lost = connect4_get_game_state(game) == GAME_OVER
+                    && connect4_get_game_result(game) != GAME_DRAW;
+            connect4_unmake_move(game);
+        }
+        connect4_unmake_move(game);
+        if (!lost)
+            safe[safe_num++] = col;
+    }
+
+    if (safe_num > 0)
+        return safe[connect4_rand_next(seed)%safe_num];
+    return legal[connect4_rand_next(seed)%legal_num];
+}
+
+static int
+random_col (Connect4_t *game, uint64_t *seed)
+{
+    int col_num = game->col_num;
+    int start = connect4_rand_next(seed)%col_num;
+
+    for (int i = 0; i < col_num; i++) {
+        int col = (start + i)%col_num;
+        if (connect4_landing_row(game, col) >= 0)
+            return col;
+    }
+    return -1;
+}
+
+// </Players>
+// --------------------------------------------------
+// <Clients>
+
+static int
+client_send (Client_t *client, const Connect4_msg_t *msg)
+{
+    uint8_t buf[CONNECT4_MSG_MAX];
+    int len = connect4_encode_msg(client->proto_mode, msg, buf, sizeof(buf));
+    if (len < 0)
+        return -1;
+
+    // a few bytes at a time never fill the socket buffer of a live peer
+    return (send(client->fd, buf, len, MSG_NOSIGNAL) == len) ? 0 : -1;
+}
+
+static void
+client_open (Loadgen_t *loadgen, Client_t *client)
+{
+    loadgen->stats.connects++;
+    int fd = socket(loadgen->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        loadgen->stats.connect_errors++;
+        client->restart_ns = connect4_now_ns() + RECONNECT_MS*1000000L;
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (struct sockaddr*)&loadgen->addr, loadgen->addr_len) < 0
+            && errno != EINPROGRESS) {
+        close(fd);
+        loadgen->stats.connect_errors++;
+        client->restart_ns = connect4_now_ns() + RECONNECT_MS*1000000L;
+        return;
+    }
+
+    struct epoll_event ev = {
+        .events  = EPOLLOUT,
+        .data.u32 = client - loadgen->clients
+    };
+    if (epoll_ctl(loadgen->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(fd);
+        loadgen->stats.connect_errors++;
+        client->restart_ns = connect4_now_ns() + RECONNECT_MS*1000000L;
+        return;
+    }
+
+    client->fd = fd;
+    client->state = CLIENT_CONNECTING;
+    client->proto_mode = CONNECT4_PROTO_TEXT;
+    client->authoritative = false;
+    client->my_move = GAME_OVER;
+    client->move_ns = 0;
+    client->active_ns = connect4_now_ns();
+    connect4_decoder_init(&client->decoder);
+    connect4_new_game(&client->game, loadgen->col_num, loadgen->row_num, loadgen->win_len);
+}
+
+/*
+ *  close the connection; unless the run is over the client connects
+ *  again for the next game, at once or after delay_ns
+ */
+static void
+client_close (Loadgen_t *loadgen, Client_t *client, long delay_ns)
+{
+    if (client->fd >= 0) {
+        epoll_ctl(loadgen->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+        close(client->fd);
+    }
+    client->fd = -1;
+    client->state = CLIENT_IDLE;
+    client->move_ns = 0;
+    client->restart_ns = connect4_now_ns() + delay_ns;
+
+    if (delay_ns == 0 && !loadgen->stopping)
+        client_open(loadgen, client);
+}
+
+/*
+ *  the connect finished; binary clients ask for frames and the board
+ */
+static int
+client_connected (Loadgen_t *loadgen, Client_t *client)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        loadgen->stats.connect_errors++;
+        client_close(loadgen, client, RECONNECT_MS*1000000L);
+        return -1;
+    }
+
+    struct epoll_event ev = {
+        .events  = EPOLLIN | EPOLLRDHUP,
+        .data.u32 = client - loadgen->clients
+    };
+    epoll_ctl(loadgen->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    client->state = CLIENT_WAITING;
+    client->active_ns = connect4_now_ns();
+
+    if (client->binary) {
+        Connect4_msg_t hello = {
+            .type = CONNECT4_MSG_HELLO,
+            .version = CONNECT4_PROTO_VERSION,
+            .col_num = loadgen->col_num,
+            .row_num = loadgen->row_num,
+            .win_len = loadgen->win_len
+        };
+        if (client_send(client, &hello) < 0) {
+            loadgen->stats.dropped++;
+            client_close(loadgen, client, 0);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+client_move (Loadgen_t *loadgen, Client_t *client)
+{
+    Connect4_t *game = &client->game;
+    int col = (loadgen->player == PLAYER_GREEDY) ? greedy_col(game, &loadgen->seed)
+                                                : random_col(game, &loadgen->seed);
+    int row = connect4_landing_row(game, col);
+    if (row < 0)
+        return -1;
+
+    // text peers only know PLACE, which has to carry the row
+    Connect4_msg_t msg = {
+        .type = (client->proto_mode == CONNECT4_PROTO_BINARY)
+                ? CONNECT4_MSG_DROP : CONNECT4_MSG_PLACE,
+        .row = row,
+        .col = col
+    };
+    if (client_send(client, &msg) < 0)
+        return -1;
+
+    // an authoritative server plays it when it sends it back
+    if (!client->authoritative)
+        connect4_drop(game, col);
+    loadgen->stats.moves++;
+    client->move_ns = connect4_now_ns();
+    return 0;
+}
+
+/*
+ *  the game is over on this side; black counts it for both players
+ */
+static void
+game_over (Loadgen_t *loadgen, Client_t *client)
+{
+    client->state = CLIENT_ENDING;
+    if (client->my_move != BLACK_MOVE)
+        return;
+
+    loadgen->stats.games++;
+    switch (connect4_get_game_result(&client->game))
+    {
+    case BLACK_WIN:
+        loadgen->stats.results[0]++;
+        break;
+    case WHITE_WIN:
+        loadgen->stats.results[1]++;
+        break;
+    default:
+        loadgen->stats.results[2]++;
+        break;
+    }
+}
+
+/*
+ *  Function name:
+ *      client_handle_msg
+ *
+ *  Description:
+ *      play one message of the match protocol; the server decides how
+ *      the game ends (RESULT, or YOU-WIN and ERROR on a draw for older
+ *      players) and closes both connections, and a client whose own
+ *      view of the game disagrees counts a protocol error
+ *
+ *  Input:
+ *      loadgen :   load generator
+ *      client  :   client
+ *      msg     :   message from the server
+ *
+ *  Output:
+ *      return  :   0 to go on, -1 when the client was closed
+ */
+static int
+client_handle_msg (Loadgen_t *loadgen, Client_t *client, const Connect4_msg_t *msg)
+{
+    Connect4_t *game = &client->game;
+
+    switch (msg->type)
+    {
+    case CONNECT4_MSG_HELLO:
+        if (msg->col_num != game->col_num || msg->row_num != game->row_num
+                || msg->win_len != game->win_len)
+            break;
+        client->proto_mode = CONNECT4_PROTO_BINARY;
+        client->authoritative = msg->version >= CONNECT4_PROTO_AUTHORITATIVE;
+        return 0;
+
+    case CONNECT4_MSG_SESSION:
+        return 0;
+
+    case CONNECT4_MSG_YOUBLACK:
+    case CONNECT4_MSG_YOUWHITE:
+        if (client->state != CLIENT_WAITING)
+            break;
+        client->state = CLIENT_PLAYING;
+        client->my_move = (msg->type == CONNECT4_MSG_YOUBLACK) ? BLACK_MOVE : WHITE_MOVE;
+        if (client->my_move == BLACK_MOVE && client_move(loadgen, client) < 0) {
+            loadgen->stats.dropped++;
+            client_close(loadgen, client, 0);
+            return -1;
+        }
+        return 0;
+
+    case CONNECT4_MSG_PLACE:
+    case CONNECT4_MSG_DROP: {
+        bool mine = connect4_get_game_state(game) == client->my_move;
+        // only an authoritative server sends our own move, once we made it
+        if (client->state != CLIENT_PLAYING
+                || (mine && (!client->authoritative || client->move_ns == 0)))
+            break;
+        int row = (msg->type == CONNECT4_MSG_DROP) ? connect4_drop(game, msg->col)
+                    : (connect4_make_move(game, msg->row, msg->col) == 0) ? msg->row : -1;
+        if (row < 0)
+            break;
+
+        if (mine) {
+            hist_add(&loadgen->accepted, connect4_now_ns() - client->move_ns);
+            // the last move gets no reply
+            if (connect4_get_game_state(game) == GAME_OVER)
+                client->move_ns = 0;
+            return 0;
+        }
+        if (client->move_ns != 0) {
+            hist_add(&loadgen->round_trip, connect4_now_ns() - client->move_ns);
+            client->move_ns = 0;
+        }
+
+        if (connect4_get_game_state(game) == GAME_OVER) {
+            // RESULT follows
+            if (!client->authoritative)
+                game_over(loadgen, client);
+            return 0;
+        }
+        if (client_move(loadgen, client) < 0) {
+            loadgen->stats.dropped++;
+            client_close(loadgen, client, 0);
+            return -1;
+        }
+        if (connect4_get_game_state(game) == GAME_OVER) {
+            client->move_ns = 0;
+            game_over(loadgen, client);
+        }
+        return 0;
+    }
+
+    case CONNECT4_MSG_RESULT:
+        if (!client->authoritative || client->state != CLIENT_PLAYING
+                || connect4_get_game_state(game) != GAME_OVER
+                || connect4_get_game_result(game) != (Game_result_t)msg->result)
+            break;
+        game_over(loadgen, client);
+        return 0;
+
+    case CONNECT4_MSG_YOUWIN:
+        if (client->state != CLIENT_ENDING
+                || connect4_get_game_result(game) != connect4_get_my_win_result_value(client->my_move))
+            break;
+        return 0;
+
+    case CONNECT4_MSG_ERROR:
+        // how an older player hears of a draw
+        if (client->state == CLIENT_ENDING && connect4_get_game_result(game) == GAME_DRAW)
+            return 0;
+        loadgen->stats.server_errors++;
+        client_close(loadgen, client, 0);
+        return -1;
+
+    default:
+        break;
+    }
+
+    loadgen->stats.protocol_errors++;
+    client_close(loadgen, client, 0);
+    return -1;
+}
+
+static void
+client_readable (Loadgen_t *loadgen, Client_t *client)
+{
+    for (;;) {
+        size_t avail;
+        uint8_t *space = connect4_decoder_space(&client->decoder, &avail);
+        ssize_t len = read(client->fd, space, avail);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+        }
+        if (len <= 0) {
+            // the server closes both players once the game is over
+            if (client->state != CLIENT_ENDING)
+                loadgen->stats.dropped++;
+            client_close(loadgen, client, 0);
+            return;
+        }
+        connect4_decoder_commit(&client->decoder, len);
+        client->active_ns = connect4_now_ns();
+
+        int ret;
+        Connect4_msg_t msg;
+        while ((ret = connect4_decoder_next(&client->decoder, &msg)) > 0)
+            if (client_handle_msg(loadgen, client, &msg) < 0)
+                return;
+        if (ret < 0) {
+            loadgen->stats.protocol_errors++;
+            client_close(loadgen, client, 0);
+            return;
+        }
+    }
+}
+
+/*
+ *  start the idle clients that are due and give up on the silent ones
+ */
+static void
+tick (Loadgen_t *loadgen)
+{
+    long now = connect4_now_ns();
+
+    for (int i = 0; i < loadgen->client_num; i++) {
+        Client_t *client = &loadgen->clients[i];
+        if (client->state == CLIENT_IDLE) {
+            if (!loadgen->stopping && client->restart_ns <= now)
+                client_open(loadgen, client);
+        }
+        else if (now - client->active_ns > CLIENT_TIMEOUT_MS*1000000L) {
+            loadgen->stats.timeouts++;
+            client_close(loadgen, client, 0);
+        }
+    }
+}
+
+// </Clients>
+// --------------------------------------------------
+// <Load generator initializer>
+
+static int
+fd_limit (int want)
+{
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) < 0) {
+        perror("getrlimit");
+        return 0;
+    }
+    if (lim.rlim_cur < (rlim_t)want) {
+        lim.rlim_cur = (lim.rlim_max < (rlim_t)want) ? lim.rlim_max : (rlim_t)want;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        getrlimit(RLIMIT_NOFILE, &lim);
+    }
+    return lim.rlim_cur;
+}
+
+static int
+init_loadgen (Loadgen_t *loadgen, const char *host, int port_no, int client_num,
+                const char *proto, Player_t player, int col_num, int row_num, int win_len,
+                uint64_t seed)
+{
+    *loadgen = (Loadgen_t){
+        .col_num = col_num,
+        .row_num = row_num,
+        .win_len = win_len,
+        .player = player,
+        .seed = seed,
+        .client_num = client_num,
+    };
+
+    char service[8];
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addrs;
+    snprintf(service, sizeof(service), "%d", port_no);
+    int ret = getaddrinfo(host, service, &hints, &addrs);
+    if (ret != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+        return -1;
+    }
+    memcpy(&loadgen->addr, addrs->ai_addr, addrs->ai_addrlen);
+    loadgen->addr_len = addrs->ai_addrlen;
+    freeaddrinfo(addrs);
+
+    // the clients, the epoll fd and stdio
+    int limit = fd_limit(client_num + 16);
+    if (limit < client_num + 16) {
+        fprintf(stderr, "limited to %d clients by RLIMIT_NOFILE\n", limit - 16);
+        loadgen->client_num = client_num = limit - 16;
+        if (client_num < 2)
+            return -1;
+    }
+
+    loadgen->clients = calloc(client_num, sizeof(Client_t));
+    if (loadgen->clients == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    for (int i = 0; i < client_num; i++) {
+        Client_t *client = &loadgen->clients[i];
+        client->fd = -1;
+        client->state = CLIENT_IDLE;
+        client->binary = strcmp(proto, "binary") == 0
+                            || (strcmp(proto, "mixed") == 0 && i%2 == 1);
+    }
+
+    loadgen->epoll_fd = epoll_create1(0);
+    if (loadgen->epoll_fd < 0) {
+        perror("epoll_create1");
+        free(loadgen->clients);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+finalize_loadgen (Loadgen_t *loadgen)
+{
+    for (int i = 0; i < loadgen->client_num; i++)
+        if (loadgen->clients[i].fd >= 0)
+            close(loadgen->clients[i].fd);
+    free(loadgen->clients);
+    close(loadgen->epoll_fd);
+}
+
+// </Load generator initializer>
+// --------------------------------------------------
+
+static unsigned long
+error_num (const Loadgen_stats_t *stats)
+{
+    return stats->connect_errors + stats->server_errors + stats->protocol_errors
+            + stats->dropped + stats->timeouts;
+}
+
+static void
+loop (Loadgen_t *loadgen, double duration_s)
+{
+    struct epoll_event events[EVENT_MAX];
+    long start = connect4_now_ns();
+    long end = start + (long)(duration_s*1e9);
+    long next_tick = start, next_report = start + 1000000000L;
+    unsigned long report_moves = 0;
+
+    while (!quit_flg && connect4_now_ns() < end) {
+        long now = connect4_now_ns();
+        if (now >= next_tick) {
+            tick(loadgen);
+            next_tick = now + TICK_MS*1000000L;
+        }
+        if (now >= next_report) {
+            printf("%5.0f s %10lu games %10lu moves/s %8lu errors\n",
+                    (now - start)*1e-9, loadgen->stats.games,
+                    loadgen->stats.moves - report_moves, error_num(&loadgen->stats));
+            fflush(stdout);
+            report_moves = loadgen->stats.moves;
+            next_report += 1000000000L;
+        }
+
+        int timeout = (next_tick - now)/1000000 + 1;
+        int n = epoll_wait(loadgen->epoll_fd, events, EVENT_MAX, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            Client_t *client = &loadgen->clients[events[i].data.u32];
+            if (client->fd < 0)
+                continue;
+            if (client->state == CLIENT_CONNECTING) {
+                if (client_connected(loadgen, client) < 0)
+                    continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                client_readable(loadgen, client);
+        }
+    }
+    loadgen->stopping = true;
+}
+
+static void
+report_hist (const char *name, const char *unit, const Histogram_t *hist)
+{
+    if (hist->num == 0)
+        return;
+    printf("%-12s %10llu %s, us: p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n", name,
+            (unsigned long long)hist->num, unit, hist_percentile(hist, 0.5)*1e-3,
+            hist_percentile(hist, 0.99)*1e-3, hist_percentile(hist, 0.999)*1e-3,
+            hist->max*1e-3);
+}
+
+static void
+report (Loadgen_t *loadgen, double sec)
+{
+    Loadgen_stats_t *stats = &loadgen->stats;
+
+    printf("\n%.2f s, %d clients\n", sec, loadgen->client_num);
+    printf("games        %10lu %12.1f /s  (black %lu, white %lu, draw %lu)\n",
+            stats->games, stats->games/sec, stats->results[0], stats->results[1],
+            stats->results[2]);
+    printf("moves        %10lu %12.1f /s\n", stats->moves, stats->moves/sec);
+    report_hist("round trip", "replies", &loadgen->round_trip);
+    report_hist("accepted", "moves", &loadgen->accepted);
+    printf("errors       %10lu %11.3f %%  (connect %lu, server ERROR %lu, protocol %lu,"
+            " dropped %lu, timeout %lu)\n",
+            error_num(stats), stats->connects ? 100.0*error_num(stats)/stats->connects : 0.0,
+            stats->connect_errors, stats->server_errors, stats->protocol_errors,
+            stats->dropped, stats->timeouts);
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr, "Usage: %s [-m host] [-p port] [-c clients] [-d seconds]\n"
+            "\t[-P text|binary|mixed] [-o random|greedy] [-s colsxrows] [-k win_len]"
+            " [-S seed]\n", name);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *host = "localhost";
+    int port_no = DEFAULT_PORT_NO;
+    int client_num = DEFAULT_CLIENT_NUM;
+    double duration_s = DEFAULT_DURATION_S;
+    const char *proto = "text";
+    Player_t player = PLAYER_RANDOM;
+    int col_num = CONNECT4_DEFAULT_COL_NUM, row_num = CONNECT4_DEFAULT_ROW_NUM;
+    int win_len = CONNECT4_DEFAULT_WIN_LEN;
+    uint64_t seed = (uint64_t)time(NULL)<<20 ^ getpid();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:p:c:d:P:o:s:k:S:")) != -1) {
+        switch (opt)
+        {
+        case 'm':
+            host = optarg;
+            break;
+        case 'p':
+            port_no = strtol(optarg, NULL, 10);
+            break;
+        case 'c':
+            client_num = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration_s = strtod(optarg, NULL);
+            break;
+        case 'P':
+            proto = optarg;
+            break;
+        case 'o':
+            if (strcmp(optarg, "greedy") == 0)
+                player = PLAYER_GREEDY;
+            else if (strcmp(optarg, "random") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            // board size as colsxrows
+            if (sscanf(optarg, "%dx%d", &col_num, &row_num) != 2)
+                col_num = 0;
+            break;
+        case 'k':
+            win_len = strtol(optarg, NULL, 10);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (strcmp(proto, "text") != 0 && strcmp(proto, "binary") != 0
+            && strcmp(proto, "mixed") != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (client_num < 2 || duration_s <= 0) {
+        fprintf(stderr, "at least 2 clients and a positive duration are needed\n");
+        return 1;
+    }
+    if (!connect4_valid_geometry(col_num, row_num, win_len)) {
+        fprintf(stderr, "%dx%d board with %d in a row is not supported\n",
+                col_num, row_num, win_len);
+        return 1;
+    }
+    // only HELLO can tell the server about another board
+    if ((col_num != CONNECT4_DEFAULT_COL_NUM || row_num != CONNECT4_DEFAULT_ROW_NUM
+                || win_len != CONNECT4_DEFAULT_WIN_LEN) && strcmp(proto, "binary") != 0) {
+        fprintf(stderr, "another board needs -P binary\n");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    Loadgen_t loadgen;
+    if (init_loadgen(&loadgen, host, port_no, client_num, proto, player,
+                        col_num, row_num, win_len, seed | 1) < 0)
+        return 1;
+
+    printf("%d %s clients (%s moves) on %s port %d, %dx%d with %d in a row\n",
+            loadgen.client_num, proto, player == PLAYER_GREEDY ? "greedy" : "random",
+            host, port_no, col_num, row_num, win_len);
+    long start = connect4_now_ns();
+    loop(&loadgen, duration_s);
+    report(&loadgen, (connect4_now_ns() - start)*1e-9);
+
+    int ret = loadgen.stats.games == 0 || error_num(&loadgen.stats) != 0;
+    finalize_loadgen(&loadgen);
+    return ret;
+}
@@ -0,0 +1,369 @@
+/*
+ *  Connect four Monte Carlo tree search (see connect4_mcts.h)
+ *
+ *
+ *  <<Playouts>>
+ *
+ *  The legal cells of a position are the engine's
+ *      (filled + bottom_mask) & board_mask
+ *  one per column that is not full (see connect4.c). A playout move
+ *  counts them, skips a random number of them by clearing the lowest
+ *  bit and takes the column of the next one with a bit scan;
+ *  connect4_drop() then settles wins and draws as in a real game.
+ *
+ *  <<Scores>>
+ *
+ *  A node counts its visits and the score of the side that moved into
+ *  it, 2 for a win and 1 for a draw, so that integers fit the atomic
+ *  adds. UCT picks the child with the largest
+ *      score/(2*visits) + exploration*sqrt(ln(parent visits)/visits)
+ *  and any child not visited yet before that.
+ */
+
+#include "connect4_mcts.h"
+#include "connect4_util.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define CHILDREN_EXPANDING UINT32_MAX       // a thread is adding the children
+#define CHILDREN_NO_ROOM (UINT32_MAX - 1)   // the pool was full, a leaf for good
+#define EXPAND_VISITS 2         // a leaf gets its children on its second visit
+#define CLOCK_CHECK_NUM 16      // iterations between looks at the clock
+#define SCORE_WIN 2
+#define SCORE_DRAW 1
+
+struct Connect4_mcts_node {
+    _Atomic uint32_t visits;
+    _Atomic uint32_t score;     // SCORE_* of the side that moved into the node
+    _Atomic uint32_t children;  // pool index of the first child, 0 before expansion
+    uint8_t child_num;
+    uint8_t col;                // move into the node
+};
+
+typedef struct Worker {
+    Connect4_mcts_t *mcts;
+    Connect4_t *game;           // root position, not changed
+    double deadline;
+    uint64_t seed;
+    uint64_t playouts;
+    pthread_t thread;
+} Worker_t;
+
+static int
+bits_popcount (Connect4_bits_t bits)
+{
+#if CONNECT4_BITS_MAX > 64
+    return __builtin_popcountll((uint64_t)bits) + __builtin_popcountll((uint64_t)(bits>>64));
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+static int
+bits_ctz (Connect4_bits_t bits)
+{
+#if CONNECT4_BITS_MAX > 64
+    if ((uint64_t)bits == 0)
+        return 64 + __builtin_ctzll((uint64_t)(bits>>64));
+#endif
+    return __builtin_ctzll((uint64_t)bits);
+}
+
+static Connect4_bits_t
+legal_cells (const Connect4_t *game)
+{
+    return ((game->black | game->white) + game->bottom_mask) & game->board_mask;
+}
+
+/*
+ *  play random moves to the end of the game
+ */
+static Game_result_t
+playout (Connect4_t *game, uint64_t *seed)
+{
+    while (connect4_get_game_state(game) != GAME_OVER) {
+        int col;
+        if (!game->wide) {
+            uint64_t cells = legal_cells(game);
+            for (int skip = connect4_rand_next(seed)%__builtin_popcountll(cells); skip > 0; skip--)
+                cells &= cells - 1;
+            col = __builtin_ctzll(cells)/(game->row_num + 1);
+        }
+        else {
+            Connect4_bits_t cells = legal_cells(game);
+            for (int skip = connect4_rand_next(seed)%bits_popcount(cells); skip > 0; skip--)
+                cells &= cells - 1;
+            col = bits_ctz(cells)/(game->row_num + 1);
+        }
+        connect4_drop(game, col);
+    }
+    return connect4_get_game_result(game);
+}
+
+static void
+init_node (Connect4_mcts_node_t *node, int col)
+{
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->score, 0);
+    atomic_init(&node->children, 0);
+    node->child_num = 0;
+    node->col = col;
+}
+
+/*
+ *  Function name:
+ *      expand
+ *
+ *  Description:
+ *      add a child for every legal move of the node's position; only
+ *      the thread that claims the node does, the others go on with a
+ *      playout from the node
+ *
+ *  Input:
+ *      mcts    :   tree
+ *      node    :   leaf, its game not over
+ *      game    :   position of the node
+ */
+static void
+expand (Connect4_mcts_t *mcts, Connect4_mcts_node_t *node, Connect4_t *game)
+{
+    uint32_t expected = 0;
+    if (!atomic_compare_exchange_strong(&node->children, &expected, CHILDREN_EXPANDING))
+        return;
+
+    int child_num = bits_popcount(legal_cells(game));
+    size_t first = atomic_fetch_add(&mcts->node_num, child_num);
+    if (first + child_num > mcts->node_max) {
+        atomic_store(&node->children, CHILDREN_NO_ROOM);
+        return;
+    }
+
+    int k = 0;
+    for (int col = 0; col < game->col_num; col++)
+        if (connect4_landing_row(game, col) >= 0)
+            init_node(&mcts->nodes[first + k++], col);
+    node->child_num = child_num;
+    // the children are set up before anyone can see them
+    atomic_store_explicit(&node->children, first, memory_order_release);
+}
+
+static uint32_t
+select_child (Connect4_mcts_t *mcts, Connect4_mcts_node_t *node, uint32_t first)
+{
+    double log_visits = log(atomic_load_explicit(&node->visits, memory_order_relaxed));
+    double best_value = -1;
+    uint32_t best = first;
+
+    for (int k = 0; k < node->child_num; k++) {
+        Connect4_mcts_node_t *child = &mcts->nodes[first + k];
+        uint32_t visits = atomic_load_explicit(&child->visits, memory_order_relaxed);
+        if (visits == 0)
+            return first + k;
+
+        uint32_t score = atomic_load_explicit(&child->score, memory_order_relaxed);
+        double value = score/(2.0*visits) + mcts->exploration*sqrt(log_visits/visits);
+        if (value > best_value) {
+            best_value = value;
+            best = first + k;
+        }
+    }
+    return best;
+}
+
+/*
+ *  Function name:
+ *      iterate
+ *
+ *  Description:
+ *      one selection, expansion, playout and backup from the root
+ *
+ *  Input:
+ *      mcts    :   tree
+ *      root    :   position of the root
+ *      seed    :   random state of the thread
+ */
+static void
+iterate (Connect4_mcts_t *mcts, Connect4_t *root, uint64_t *seed)
+{
+    Connect4_t game = *root;
+    uint32_t path[CONNECT4_HISTORY_MAX + 1];
+    int depth = 0;
+
+    Connect4_mcts_node_t *node = &mcts->nodes[0];
+    atomic_fetch_add_explicit(&node->visits, 1, memory_order_relaxed);
+    path[depth++] = 0;
+
+    while (connect4_get_game_state(&game) != GAME_OVER) {
+        uint32_t first = atomic_load_explicit(&node->children, memory_order_acquire);
+        if (first == 0
+                && atomic_load_explicit(&node->visits, memory_order_relaxed) >= EXPAND_VISITS) {
+            expand(mcts, node, &game);
+            first = atomic_load_explicit(&node->children, memory_order_acquire);
+        }
+        if (first == 0 || first >= CHILDREN_NO_ROOM)
+            break;
+
+        uint32_t index = select_child(mcts, node, first);
+        node = &mcts->nodes[index];
+        // counted now, scored on the way back: a virtual loss meanwhile
+        atomic_fetch_add_explicit(&node->visits, 1, memory_order_relaxed);
+        path[depth++] = index;
+        connect4_drop(&game, node->col);
+    }
+
+    Game_result_t result = playout(&game, seed);
+
+    // the side to move at the root moved into the nodes at odd depths
+    Game_result_t root_win = connect4_get_my_win_result_value(connect4_get_game_state(root));
+    for (int d = 1; d < depth; d++) {
+        uint32_t score = SCORE_DRAW;
+        if (result != GAME_DRAW)
+            score = ((result == root_win) == (d%2 == 1)) ? SCORE_WIN : 0;
+        if (score != 0)
+            atomic_fetch_add_explicit(&mcts->nodes[path[d]].score, score, memory_order_relaxed);
+    }
+}
+
+static void *
+worker_main (void *arg)
+{
+    Worker_t *worker = arg;
+
+    do {
+        for (int i = 0; i < CLOCK_CHECK_NUM; i++)
+            iterate(worker->mcts, worker->game, &worker->seed);
+        worker->playouts += CLOCK_CHECK_NUM;
+    } while (connect4_now_sec() < worker->deadline);
+    return NULL;
+}
+
+/*
+ *  Function name:
+ *      connect4_mcts_init
+ *
+ *  Description:
+ *      set up a search with a pool of node_max nodes
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the pool can not be allocated
+ */
+int
+connect4_mcts_init (Connect4_mcts_t *mcts, size_t node_max)
+{
+    if (node_max < 1 || CHILDREN_NO_ROOM <= node_max)
+        return -1;
+
+    mcts->nodes = malloc(node_max*sizeof(Connect4_mcts_node_t));
+    if (mcts->nodes == NULL)
+        return -1;
+
+    mcts->node_max = node_max;
+    atomic_init(&mcts->node_num, 0);
+    mcts->thread_num = 1;
+    mcts->exploration = CONNECT4_MCTS_EXPLORATION;
+    mcts->seed = 88172645463325252ULL;
+    mcts->playout_count = 0;
+    return 0;
+}
+
+void
+connect4_mcts_finalize (Connect4_mcts_t *mcts)
+{
+    free(mcts->nodes);
+    mcts->nodes = NULL;
+}
+
+void
+connect4_mcts_set_thread_num (Connect4_mcts_t *mcts, int thread_num)
+{
+    if (thread_num < 1)
+        thread_num = 1;
+    if (thread_num > CONNECT4_MCTS_THREAD_MAX)
+        thread_num = CONNECT4_MCTS_THREAD_MAX;
+    mcts->thread_num = thread_num;
+}
+
+/*
+ *  Function name:
+ *      connect4_mcts_search
+ *
+ *  Description:
+ *      grow a new tree from the position for budget_sec and pick the
+ *      column visited most; at least a few playouts are run whatever
+ *      the budget
+ *
+ *  Input:
+ *      mcts        :   search (pool, thread number, statistics)
+ *      game        :   position
+ *      budget_sec  :   time to think
+ *      result      :   column, its win rate and the search statistics
+ *                      (output)
+ *
+ *  Output:
+ *      return      :   0 on success, -1 when the game is over
+ */
+int
+connect4_mcts_search (Connect4_mcts_t *mcts, Connect4_t *game, double budget_sec,
+                        Connect4_mcts_result_t *result)
+{
+    Worker_t workers[CONNECT4_MCTS_THREAD_MAX];
+
+    if (connect4_get_game_state(game) == GAME_OVER)
+        return -1;
+
+    double start = connect4_now_sec();
+    atomic_store(&mcts->node_num, 1);
+    init_node(&mcts->nodes[0], 0);
+    expand(mcts, &mcts->nodes[0], game);
+
+    int started = 1;
+    for (int i = 0; i < mcts->thread_num; i++) {
+        Worker_t *worker = &workers[(i == 0) ? 0 : started];
+        worker->mcts = mcts;
+        worker->game = game;
+        worker->deadline = start + budget_sec;
+        worker->seed = connect4_rand_next(&mcts->seed) | 1;
+        worker->playouts = 0;
+        if (i != 0 && pthread_create(&worker->thread, NULL, worker_main, worker) == 0)
+            started++;
+    }
+
+    worker_main(&workers[0]);
+
+    result->playouts = 0;
+    for (int i = 0; i < started; i++) {
+        if (i != 0)
+            pthread_join(workers[i].thread, NULL);
+        result->playouts += workers[i].playouts;
+    }
+    mcts->playout_count += result->playouts;
+    result->sec = connect4_now_sec() - start;
+    result->node_num = atomic_load(&mcts->node_num);
+    if (result->node_num > mcts->node_max)
+        result->node_num = mcts->node_max;
+
+    // the most visited column is the one the search trusts most
+    Connect4_mcts_node_t *root = &mcts->nodes[0];
+    uint32_t first = atomic_load(&root->children);
+    uint32_t best_visits = 0;
+    result->col = -1;
+    result->win_rate = 0;
+    for (int k = 0; first < CHILDREN_NO_ROOM && k < root->child_num; k++) {
+        Connect4_mcts_node_t *child = &mcts->nodes[first + k];
+        uint32_t visits = atomic_load(&child->visits);
+        if (result->col < 0 || visits > best_visits) {
+            best_visits = visits;
+            result->col = child->col;
+            result->win_rate = visits ? atomic_load(&child->score)/(2.0*visits) : 0;
+        }
+    }
+
+    // a pool too small for the root's children: any legal column
+    for (int col = 0; result->col < 0 && col < game->col_num; col++)
+        if (connect4_landing_row(game, col) >= 0)
+            result->col = col;
+    return 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "connect4.h"
+
+/*
+ *  <<Monte Carlo tree search>>
+ *
+ *  An anytime player for any board and win length the engine plays,
+ *  including those the solver can not finish. Each iteration walks
+ *  down the tree by UCT, adds the children of the leaf it reaches and
+ *  plays the game out with random moves; the result is added to every
+ *  node on the way. The column visited most when the time is up is
+ *  played.
+ *
+ *  Nodes come from a pool allocated once and emptied for every search.
+ *  With more than one thread every thread runs iterations on the same
+ *  tree (tree parallelism): counts are atomic, a node is expanded by
+ *  the thread that wins a compare-and-swap, and the visit is counted
+ *  on the way down so that the others spread to other branches until
+ *  the result comes back (virtual loss). When the pool is full the
+ *  tree stops growing and the leaves keep getting playouts.
+ */
+
+#define CONNECT4_MCTS_NODE_DEFAULT ((size_t)1<<21)
+#define CONNECT4_MCTS_THREAD_MAX 64
+#define CONNECT4_MCTS_EXPLORATION 1.4   // UCT constant, about sqrt(2)
+
+typedef struct Connect4_mcts_node Connect4_mcts_node_t;
+
+typedef struct Connect4_mcts_result {
+    int col;                // column visited most
+    double win_rate;        // of that column for the side to move, draws half
+    uint64_t playouts;
+    double sec;             // time actually taken
+    size_t node_num;        // nodes in the tree
+} Connect4_mcts_result_t;
+
+typedef struct Connect4_mcts {
+    Connect4_mcts_node_t *nodes;
+    size_t node_max;
+    atomic_size_t node_num;
+    int thread_num;         // tree parallel threads, 1 by default
+    double exploration;
+    uint64_t seed;
+    uint64_t playout_count; // since init
+} Connect4_mcts_t;
+
+int connect4_mcts_init (Connect4_mcts_t *mcts, size_t node_max);
+void connect4_mcts_finalize (Connect4_mcts_t *mcts);
+void connect4_mcts_set_thread_num (Connect4_mcts_t *mcts, int thread_num);
+int connect4_mcts_search (Connect4_mcts_t *mcts, Connect4_t *game, double budget_sec,
+                            Connect4_mcts_result_t *result);
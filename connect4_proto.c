@@ -0,0 +1,386 @@
+/*
+ *  Connect four wire protocol
+ *
+ *  Streaming decoder and encoder shared by the front end and the match
+ *  server. Received bytes are appended to the decoder as they arrive;
+ *  every complete message is then taken out one by one, so a read that
+ *  holds several messages or only a part of one is handled the same way.
+ */
+
+#include "connect4_proto.h"
+#include "connect4.h"
+#include <stdio.h>
+#include <string.h>
+
+static const struct {
+    const char *str;
+    Connect4_msg_type_t type;
+} TEXT_TOKENS[] = {
+    {"PLACE-", CONNECT4_MSG_PLACE},
+    {"ERROR", CONNECT4_MSG_ERROR},
+    {"YOU-WIN", CONNECT4_MSG_YOUWIN},
+    {"YOU-BLACK", CONNECT4_MSG_YOUBLACK},
+    {"YOU-WHITE", CONNECT4_MSG_YOUWHITE},
+};
+
+#define TEXT_TOKEN_NUM (sizeof(TEXT_TOKENS)/sizeof(TEXT_TOKENS[0]))
+
+void
+connect4_decoder_init (Connect4_decoder_t *dec)
+{
+    dec->pos = 0;
+    dec->len = 0;
+}
+
+/*
+ *  Function name:
+ *      connect4_decoder_space
+ *
+ *  Description:
+ *      return the free tail of the buffer so that read() can fill it
+ *      directly; call connect4_decoder_commit() with the read length
+ *
+ *  Input:
+ *      dec     :   decoder
+ *      avail   :   number of free bytes (output)
+ *
+ *  Output:
+ *      return  :   start of the free space
+ */
+uint8_t *
+connect4_decoder_space (Connect4_decoder_t *dec, size_t *avail)
+{
+    if (dec->pos != 0) {
+        memmove(dec->buf, dec->buf + dec->pos, dec->len - dec->pos);
+        dec->len -= dec->pos;
+        dec->pos = 0;
+    }
+
+    *avail = sizeof(dec->buf) - dec->len;
+    return dec->buf + dec->len;
+}
+
+void
+connect4_decoder_commit (Connect4_decoder_t *dec, size_t len)
+{
+    dec->len += len;
+}
+
+static int
+decode_text (const uint8_t *buf, size_t len, Connect4_msg_t *msg)
+{
+    for (size_t i = 0; i < TEXT_TOKEN_NUM; i++) {
+        size_t tok_len = strlen(TEXT_TOKENS[i].str);
+        size_t cmp_len = (len < tok_len) ? len : tok_len;
+
+        if (memcmp(buf, TEXT_TOKENS[i].str, cmp_len) != 0)
+            continue;
+        if (len < tok_len)
+            return 0;
+
+        msg->type = TEXT_TOKENS[i].type;
+        if (msg->type != CONNECT4_MSG_PLACE)
+            return tok_len;
+
+        // "PLACE-" is followed by a column digit and a row digit
+        if (len < tok_len + 2)
+            return 0;
+        if (buf[tok_len] < '0' || '9' < buf[tok_len]
+            || buf[tok_len + 1] < '0' || '9' < buf[tok_len + 1])
+            return -1;
+        msg->col = buf[tok_len] - '0';
+        msg->row = buf[tok_len + 1] - '0';
+        return tok_len + 2;
+    }
+
+    return -1;
+}
+
+static uint64_t
+get_be (const uint8_t *buf, int len)
+{
+    uint64_t val = 0;
+    for (int i = 0; i < len; i++)
+        val = val<<8 | buf[i];
+    return val;
+}
+
+static void
+put_be (uint8_t *buf, int len, uint64_t val)
+{
+    for (int i = len - 1; i >= 0; i--, val >>= 8)
+        buf[i] = val & 0xff;
+}
+
+/*
+ *  return frame length, 0 for an unknown type (skipped), -1 when malformed
+ */
+static int
+decode_binary (const uint8_t *frame, size_t frame_len, Connect4_msg_t *msg)
+{
+    const uint8_t *payload = frame + 2;
+    size_t payload_len = frame_len - 2;
+
+    msg->type = frame[1];
+    switch (msg->type)
+    {
+    case CONNECT4_MSG_HELLO:
+        if (payload_len < 1)
+            return -1;
+        msg->version = payload[0];
+        msg->col_num = msg->row_num = msg->win_len = 0;
+        if (payload_len >= 4) {
+            msg->col_num = payload[1];
+            msg->row_num = payload[2];
+            msg->win_len = payload[3];
+        }
+        break;
+
+    case CONNECT4_MSG_PLACE:
+        if (payload_len != 2)
+            return -1;
+        msg->col = payload[0];
+        msg->row = payload[1];
+        break;
+
+    case CONNECT4_MSG_DROP:
+        if (payload_len != 1)
+            return -1;
+        msg->col = payload[0];
+        break;
+
+    case CONNECT4_MSG_SESSION:
+        if (payload_len != 8)
+            return -1;
+        msg->token = get_be(payload, 8);
+        break;
+
+    case CONNECT4_MSG_RESUME:
+        if (payload_len != 10)
+            return -1;
+        msg->token = get_be(payload, 8);
+        msg->seq = get_be(payload + 8, 2);
+        break;
+
+    case CONNECT4_MSG_RESUMED:
+        if (payload_len != 2)
+            return -1;
+        msg->seq = get_be(payload, 2);
+        break;
+
+    case CONNECT4_MSG_WATCH:
+        if (payload_len != 4)
+            return -1;
+        msg->match_id = get_be(payload, 4);
+        break;
+
+    case CONNECT4_MSG_SNAPSHOT:
+        if (payload_len != 24 && payload_len != 25)
+            return -1;
+        msg->match_id = get_be(payload, 4);
+        msg->col_num = payload[4];
+        msg->row_num = payload[5];
+        msg->seq = get_be(payload + 6, 2);
+        msg->black = get_be(payload + 8, 8);
+        msg->white = get_be(payload + 16, 8);
+        // servers before version 2 play four in a row only
+        msg->win_len = (payload_len == 25) ? payload[24] : CONNECT4_DEFAULT_WIN_LEN;
+        break;
+
+    case CONNECT4_MSG_DELTA:
+        if (payload_len != 3)
+            return -1;
+        msg->seq = get_be(payload, 2);
+        msg->bit = payload[2];
+        break;
+
+    case CONNECT4_MSG_RESULT:
+        if (payload_len != 1 || payload[0] > GAME_DRAW)
+            return -1;
+        msg->result = payload[0];
+        break;
+
+    case CONNECT4_MSG_ERROR:
+    case CONNECT4_MSG_YOUWIN:
+    case CONNECT4_MSG_YOUBLACK:
+    case CONNECT4_MSG_YOUWHITE:
+        break;
+
+    default:
+        return 0;
+    }
+
+    return frame_len;
+}
+
+/*
+ *  Function name:
+ *      connect4_decoder_next
+ *
+ *  Description:
+ *      take the next complete message out of the decoder
+ *
+ *  Input:
+ *      dec     :   decoder
+ *      msg     :   decoded message (output)
+ *
+ *  Output:
+ *      return  :   1 when msg is set, 0 when more bytes are needed,
+ *                  -1 when the stream is malformed
+ */
+int
+connect4_decoder_next (Connect4_decoder_t *dec, Connect4_msg_t *msg)
+{
+    while (dec->pos < dec->len) {
+        const uint8_t *head = dec->buf + dec->pos;
+        size_t len = dec->len - dec->pos;
+        int used;
+
+        if (head[0] <= CONNECT4_FRAME_LEN_MAX) {
+            size_t frame_len = (size_t)head[0] + 1;
+            if (head[0] == 0)
+                return -1;
+            if (len < frame_len)
+                return 0;
+
+            used = decode_binary(head, frame_len, msg);
+            if (used == 0) {
+                // a newer peer's message we do not know; skip it
+                dec->pos += frame_len;
+                continue;
+            }
+        }
+        else
+            used = decode_text(head, len, msg);
+
+        if (used <= 0)
+            return used;
+
+        dec->pos += used;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+encode_text (const Connect4_msg_t *msg, uint8_t *buf, size_t size)
+{
+    int len;
+
+    if (msg->type == CONNECT4_MSG_PLACE) {
+        if (msg->col < 0 || 9 < msg->col || msg->row < 0 || 9 < msg->row)
+            return -1;
+        len = snprintf((char*)buf, size, "PLACE-%d%d", msg->col, msg->row);
+        return ((size_t)len < size) ? len : -1;
+    }
+
+    for (size_t i = 0; i < TEXT_TOKEN_NUM; i++) {
+        if (TEXT_TOKENS[i].type != msg->type)
+            continue;
+        len = strlen(TEXT_TOKENS[i].str);
+        if ((size_t)len > size)
+            return -1;
+        memcpy(buf, TEXT_TOKENS[i].str, len);
+        return len;
+    }
+
+    return -1;
+}
+
+static int
+encode_binary (const Connect4_msg_t *msg, uint8_t *buf, size_t size)
+{
+    uint8_t frame[CONNECT4_MSG_MAX];
+    size_t len = 2;
+
+    frame[1] = msg->type;
+    switch (msg->type)
+    {
+    case CONNECT4_MSG_HELLO:
+        frame[len++] = msg->version;
+        frame[len++] = msg->col_num;
+        frame[len++] = msg->row_num;
+        frame[len++] = msg->win_len;
+        break;
+    case CONNECT4_MSG_PLACE:
+        frame[len++] = msg->col;
+        frame[len++] = msg->row;
+        break;
+    case CONNECT4_MSG_DROP:
+        frame[len++] = msg->col;
+        break;
+    case CONNECT4_MSG_SESSION:
+        put_be(frame + len, 8, msg->token);
+        len += 8;
+        break;
+    case CONNECT4_MSG_RESUME:
+        put_be(frame + len, 8, msg->token);
+        put_be(frame + len + 8, 2, msg->seq);
+        len += 10;
+        break;
+    case CONNECT4_MSG_RESUMED:
+        put_be(frame + len, 2, msg->seq);
+        len += 2;
+        break;
+    case CONNECT4_MSG_WATCH:
+        put_be(frame + len, 4, msg->match_id);
+        len += 4;
+        break;
+    case CONNECT4_MSG_SNAPSHOT:
+        put_be(frame + len, 4, msg->match_id);
+        frame[len + 4] = msg->col_num;
+        frame[len + 5] = msg->row_num;
+        put_be(frame + len + 6, 2, msg->seq);
+        put_be(frame + len + 8, 8, msg->black);
+        put_be(frame + len + 16, 8, msg->white);
+        frame[len + 24] = msg->win_len;
+        len += 25;
+        break;
+    case CONNECT4_MSG_DELTA:
+        put_be(frame + len, 2, msg->seq);
+        frame[len + 2] = msg->bit;
+        len += 3;
+        break;
+    case CONNECT4_MSG_RESULT:
+        frame[len++] = msg->result;
+        break;
+    default:
+        break;
+    }
+    frame[0] = len - 1;
+
+    if (len > size)
+        return -1;
+    memcpy(buf, frame, len);
+    return len;
+}
+
+/*
+ *  Function name:
+ *      connect4_encode_msg
+ *
+ *  Description:
+ *      encode one message; several messages may be encoded back to
+ *      back into one buffer and sent with a single write()
+ *
+ *  Input:
+ *      mode    :   text or binary
+ *      msg     :   message to encode
+ *      buf     :   output buffer
+ *      size    :   size of buf
+ *
+ *  Output:
+ *      return  :   encoded length, -1 when the message does not fit or
+ *                  cannot be expressed in the mode
+ */
+int
+connect4_encode_msg (Connect4_proto_mode_t mode, const Connect4_msg_t *msg,
+                        uint8_t *buf, size_t size)
+{
+    // the peer cannot have agreed to binary yet when these are sent
+    if (mode == CONNECT4_PROTO_BINARY || msg->type == CONNECT4_MSG_HELLO
+            || msg->type == CONNECT4_MSG_RESUME || msg->type == CONNECT4_MSG_WATCH)
+        return encode_binary(msg, buf, size);
+    return encode_text(msg, buf, size);
+}
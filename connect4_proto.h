@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *  <<Wire format>>
+ *
+ *  text   :   "PLACE-cr", "ERROR", "YOU-WIN", "YOU-BLACK", "YOU-WHITE"
+ *             (legacy, no delimiter; every token starts with 'A'-'Z')
+ *
+ *  binary :   [len][type][payload ...]
+ *             len counts type and payload and is always below 0x20,
+ *             so the first byte tells a frame from a text token
+ *
+ *  DROP carries only the column and exists in binary frames only;
+ *  text peers get PLACE with the landing row instead.
+ *
+ *  The decoder accepts both on the same stream. A peer that wants
+ *  binary frames sends HELLO first; the other side answers with HELLO
+ *  and both encode in binary from then on. Peers that never send
+ *  HELLO keep talking text.
+ *
+ *  <<Geometry>>
+ *
+ *  HELLO [version][col_num][row_num][win_len]
+ *
+ *  The board and the number in a row that wins are agreed in the
+ *  handshake: HELLO carries the geometry its sender plays, and the
+ *  answer carries the one the answering side plays, which the asking
+ *  side must accept or refuse with ERROR. A version 1 HELLO (no
+ *  geometry) and text peers play CONNECT4_DEFAULT_* only; PLACE in text
+ *  cannot name columns or rows past 9 anyway.
+ *
+ *  <<Authoritative server>> (match server, version 3 players)
+ *
+ *  A player whose HELLO says version 3 or above sends its moves as
+ *  requests only: DROP (or PLACE) is applied by the server's game, and
+ *  the accepted move comes back to the mover as DROP, as it goes to the
+ *  opponent, so both sides apply the same stream of moves. A move the
+ *  server refuses ends the match with ERROR as before. The server's
+ *  answer to HELLO says version 2 when it plays the match the old way,
+ *  as for a player whose HELLO came in after it was paired and that may
+ *  already have moved as an older player.
+ *
+ *  server -> player, spectators :   RESULT [result]   when the game is over
+ *
+ *  result is a Game_result_t (0 black wins, 1 white wins, 2 draw). The
+ *  server decides it and closes the match right after; nobody concedes
+ *  with YOU-WIN. Older players still get YOU-WIN when they win and
+ *  ERROR on a draw.
+ *
+ *  <<Session resume>> (match server, binary players only)
+ *
+ *  server -> player :   SESSION [token:8]   when the match starts
+ *  player -> server :   HELLO, RESUME [token:8][seq:2]   in one write,
+ *                       on a new connection after the old one dropped
+ *  server -> player :   RESUMED [seq:2], then DROP for every move from
+ *                       the player's seq on
+ *
+ *  seq counts the moves of the game, so it is also the index of the
+ *  next move in the log. A player that had moves the server never got
+ *  (seq above the server's) sends them again. Multi-byte fields are
+ *  big-endian. RESUME is encoded in binary even before HELLO is
+ *  answered.
+ *
+ *  <<Spectators>> (match server)
+ *
+ *  spectator -> server :   HELLO, WATCH [match_id:4]   in one write;
+ *                          match_id 0 picks the newest match
+ *  server -> spectator :   SNAPSHOT [match_id:4][col_num][row_num]
+ *                                   [move_num:2][black:8][white:8][win_len]
+ *                          then DELTA [seq:2][bit] for every move
+ *
+ *  black and white are the engine's bitboards (see connect4.h); a DELTA
+ *  sets one bit, in black's board for even seq and white's for odd.
+ *  Boards over 64 bits do not fit: their SNAPSHOT is of the empty board
+ *  (move_num 0) and every move so far follows as DELTA.
+ *  The connection is closed when the match ends. Like RESUME, WATCH is
+ *  always encoded in binary.
+ */
+
+#define CONNECT4_PROTO_VERSION 3
+// players from this version on leave the rules to the match server
+#define CONNECT4_PROTO_AUTHORITATIVE 3
+// geometry of peers that do not send it
+#define CONNECT4_DEFAULT_COL_NUM 7
+#define CONNECT4_DEFAULT_ROW_NUM 6
+#define CONNECT4_DEFAULT_WIN_LEN 4
+#define CONNECT4_FRAME_LEN_MAX 0x1f
+#define CONNECT4_MSG_MAX (CONNECT4_FRAME_LEN_MAX + 1)
+#define CONNECT4_DECODER_BUF_MAX 512
+
+typedef enum {
+    CONNECT4_PROTO_TEXT,
+    CONNECT4_PROTO_BINARY
+} Connect4_proto_mode_t;
+
+typedef enum {
+    CONNECT4_MSG_HELLO = 1,
+    CONNECT4_MSG_PLACE,
+    CONNECT4_MSG_ERROR,
+    CONNECT4_MSG_YOUWIN,
+    CONNECT4_MSG_YOUBLACK,
+    CONNECT4_MSG_YOUWHITE,
+    CONNECT4_MSG_DROP,
+    CONNECT4_MSG_SESSION,
+    CONNECT4_MSG_RESUME,
+    CONNECT4_MSG_RESUMED,
+    CONNECT4_MSG_WATCH,
+    CONNECT4_MSG_SNAPSHOT,
+    CONNECT4_MSG_DELTA,
+    CONNECT4_MSG_RESULT
+} Connect4_msg_type_t;
+
+typedef struct Connect4_msg {
+    Connect4_msg_type_t type;
+    int row, col;       // PLACE, DROP (col only)
+    int version;        // HELLO
+    int col_num, row_num;   // HELLO, SNAPSHOT; 0 when the peer did not send it
+    int win_len;            // HELLO, SNAPSHOT
+    uint64_t token;     // SESSION, RESUME
+    int seq;            // RESUME, RESUMED, DELTA, SNAPSHOT (move_num)
+    uint32_t match_id;  // WATCH, SNAPSHOT
+    uint64_t black, white;  // SNAPSHOT
+    int bit;            // DELTA
+    int result;         // RESULT, a Game_result_t
+} Connect4_msg_t;
+
+typedef struct Connect4_decoder {
+    size_t pos, len;    // unparsed bytes are buf[pos] .. buf[len-1]
+    uint8_t buf[CONNECT4_DECODER_BUF_MAX];
+} Connect4_decoder_t;
+
+void connect4_decoder_init (Connect4_decoder_t *dec);
+uint8_t *connect4_decoder_space (Connect4_decoder_t *dec, size_t *avail);
+void connect4_decoder_commit (Connect4_decoder_t *dec, size_t len);
+int connect4_decoder_next (Connect4_decoder_t *dec, Connect4_msg_t *msg);
+int connect4_encode_msg (Connect4_proto_mode_t mode, const Connect4_msg_t *msg,
+                            uint8_t *buf, size_t size);
@@ -0,0 +1,191 @@
+/*
+ *  Connect four game records (see connect4_record.h)
+ */
+
+#include "connect4_record.h"
+
+static uint32_t
+get_be (const uint8_t *buf, int len)
+{
+    uint32_t val = 0;
+    for (int i = 0; i < len; i++)
+        val = val<<8 | buf[i];
+    return val;
+}
+
+static void
+put_be (uint8_t *buf, int len, uint32_t val)
+{
+    for (int i = len - 1; i >= 0; i--, val >>= 8)
+        buf[i] = val & 0xff;
+}
+
+static size_t
+moves_size (int move_num, bool wide)
+{
+    return wide ? (size_t)move_num : ((size_t)move_num + 1)/2;
+}
+
+/*
+ *  Function name:
+ *      connect4_record_encode
+ *
+ *  Description:
+ *      write the record of a game, finished or not
+ *
+ *  Input:
+ *      game        :   game
+ *      black_id    :   id of the black player, meaningful to the writer
+ *      white_id    :   id of the white player
+ *      buf         :   output buffer, CONNECT4_RECORD_MAX is always enough
+ *      size        :   size of buf
+ *
+ *  Output:
+ *      return      :   record length, -1 when it does not fit
+ */
+int
+connect4_record_encode (Connect4_t *game, uint32_t black_id, uint32_t white_id,
+                        uint8_t *buf, size_t size)
+{
+    int move_num = connect4_get_move_num(game);
+    bool wide = game->col_num > CONNECT4_RECORD_NIBBLE_COL_MAX;
+    size_t len = CONNECT4_RECORD_HEADER_SIZE + moves_size(move_num, wide);
+    if (len > size)
+        return -1;
+
+    int result = (connect4_get_game_state(game) == GAME_OVER)
+                    ? (int)connect4_get_game_result(game) : CONNECT4_RECORD_UNFINISHED;
+    buf[0] = CONNECT4_RECORD_MAGIC;
+    buf[1] = game->col_num;
+    buf[2] = game->row_num;
+    buf[3] = result | (wide ? CONNECT4_RECORD_WIDE : 0)
+                | game->win_len<<CONNECT4_RECORD_WIN_LEN_SHIFT;
+    put_be(buf + 4, 2, move_num);
+    put_be(buf + 6, 4, black_id);
+    put_be(buf + 10, 4, white_id);
+
+    uint8_t *moves = buf + CONNECT4_RECORD_HEADER_SIZE;
+    for (int i = 0; i < move_num; i++) {
+        int col = connect4_get_move_col(game, i);
+        if (wide)
+            moves[i] = col;
+        else if (i%2 == 0)
+            moves[i/2] = col<<4 | 0x0f;
+        else
+            moves[i/2] = (moves[i/2] & 0xf0) | col;
+    }
+    return len;
+}
+
+/*
+ *  Function name:
+ *      connect4_record_decode
+ *
+ *  Description:
+ *      parse the record at the start of buf; the moves are left packed
+ *      in buf and not checked until the record is replayed
+ *
+ *  Input:
+ *      buf     :   record data
+ *      len     :   bytes available in buf
+ *      rec     :   decoded record (output)
+ *
+ *  Output:
+ *      return  :   record length, 0 when buf ends inside the record,
+ *                  -1 when buf does not start with a record
+ */
+int
+connect4_record_decode (const uint8_t *buf, size_t len, Connect4_record_t *rec)
+{
+    if (len < CONNECT4_RECORD_HEADER_SIZE)
+        return 0;
+    if (buf[0] != CONNECT4_RECORD_MAGIC
+            || buf[3] & ~(CONNECT4_RECORD_RESULT_MASK | CONNECT4_RECORD_WIDE
+                            | 0x0f<<CONNECT4_RECORD_WIN_LEN_SHIFT))
+        return -1;
+
+    rec->col_num = buf[1];
+    rec->row_num = buf[2];
+    rec->win_len = buf[3]>>CONNECT4_RECORD_WIN_LEN_SHIFT;
+    if (rec->win_len == 0)
+        rec->win_len = CONNECT4_WIN_LEN;
+    rec->result = buf[3] & CONNECT4_RECORD_RESULT_MASK;
+    rec->wide = buf[3] & CONNECT4_RECORD_WIDE;
+    rec->move_num = get_be(buf + 4, 2);
+    rec->black_id = get_be(buf + 6, 4);
+    rec->white_id = get_be(buf + 10, 4);
+    rec->moves = buf + CONNECT4_RECORD_HEADER_SIZE;
+
+    size_t rec_len = CONNECT4_RECORD_HEADER_SIZE + moves_size(rec->move_num, rec->wide);
+    return (rec_len <= len) ? (int)rec_len : 0;
+}
+
+/*
+ *  column of the index-th move
+ */
+int
+connect4_record_move (const Connect4_record_t *rec, int index)
+{
+    if (rec->wide)
+        return rec->moves[index];
+    return (index%2 == 0) ? rec->moves[index/2]>>4 : rec->moves[index/2] & 0x0f;
+}
+
+/*
+ *  Function name:
+ *      connect4_record_replay
+ *
+ *  Description:
+ *      play a record through the engine from the empty board and check
+ *      that every move is legal and the stored result is what the game
+ *      came to
+ *
+ *  Input:
+ *      rec     :   decoded record
+ *      game    :   the replayed game (output), valid up to the first
+ *                  bad move
+ *
+ *  Output:
+ *      return  :   CONNECT4_RECORD_OK or what is wrong with the record
+ */
+Connect4_record_error_t
+connect4_record_replay (const Connect4_record_t *rec, Connect4_t *game)
+{
+    if (!connect4_valid_geometry(rec->col_num, rec->row_num, rec->win_len))
+        return CONNECT4_RECORD_BAD_SIZE;
+
+    connect4_new_game(game, rec->col_num, rec->row_num, rec->win_len);
+    for (int i = 0; i < rec->move_num; i++) {
+        if (connect4_get_game_state(game) == GAME_OVER)
+            return CONNECT4_RECORD_PAST_END;
+        int col = connect4_record_move(rec, i);
+        if (col >= rec->col_num || connect4_drop(game, col) < 0)
+            return CONNECT4_RECORD_BAD_MOVE;
+    }
+
+    bool over = connect4_get_game_state(game) == GAME_OVER;
+    if (rec->result == CONNECT4_RECORD_UNFINISHED)
+        return over ? CONNECT4_RECORD_BAD_RESULT : CONNECT4_RECORD_OK;
+    if (!over || (int)connect4_get_game_result(game) != rec->result)
+        return CONNECT4_RECORD_BAD_RESULT;
+    return CONNECT4_RECORD_OK;
+}
+
+const char *
+connect4_record_strerror (Connect4_record_error_t err)
+{
+    switch (err)
+    {
+    case CONNECT4_RECORD_OK:
+        return "ok";
+    case CONNECT4_RECORD_BAD_SIZE:
+        return "unsupported geometry";
+    case CONNECT4_RECORD_BAD_MOVE:
+        return "illegal move";
+    case CONNECT4_RECORD_PAST_END:
+        return "moves after the end of the game";
+    case CONNECT4_RECORD_BAD_RESULT:
+    default:
+        return "result does not match the moves";
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "connect4.h"
+
+/*
+ *  <<Game records>>
+ *
+ *  A finished (or abandoned) game in a few bytes. A record file is
+ *  nothing but records back to back, so the server appends to it with
+ *  one write() per match and files can simply be concatenated.
+ *
+ *  record layout (multi-byte fields big-endian):
+ *      [0]         CONNECT4_RECORD_MAGIC
+ *      [1]         col_num
+ *      [2]         row_num
+ *      [3]         result (Game_result_t, CONNECT4_RECORD_UNFINISHED)
+ *                  | CONNECT4_RECORD_WIDE | win_len<<4 (0 is read as four)
+ *      [4..5]      move_num
+ *      [6..9]      black player id
+ *      [10..13]    white player id
+ *      [14..]      the column of every move in order: a nibble each,
+ *                  first move in the high nibble and an odd count
+ *                  padded with 0xf, or a byte each when WIDE is set
+ *                  (boards over 15 columns)
+ *
+ *  A standard game of 20-odd moves takes about 25 bytes. The record
+ *  holds columns only; rows, bitboards and the result are derived by
+ *  replaying it, which is also how a record is validated.
+ */
+
+#define CONNECT4_RECORD_MAGIC 0xc4
+#define CONNECT4_RECORD_HEADER_SIZE 14
+#define CONNECT4_RECORD_RESULT_MASK 0x03
+#define CONNECT4_RECORD_UNFINISHED 3    // result of a game that was abandoned
+#define CONNECT4_RECORD_WIDE 0x04       // a byte per move instead of a nibble
+#define CONNECT4_RECORD_WIN_LEN_SHIFT 4
+#define CONNECT4_RECORD_NIBBLE_COL_MAX 15
+#define CONNECT4_RECORD_MAX (CONNECT4_RECORD_HEADER_SIZE + CONNECT4_HISTORY_MAX)
+
+typedef struct Connect4_record {
+    int col_num, row_num;
+    int win_len;
+    int result;             // Game_result_t or CONNECT4_RECORD_UNFINISHED
+    bool wide;
+    int move_num;
+    uint32_t black_id, white_id;
+    const uint8_t *moves;   // packed columns, points into the decoded buffer
+} Connect4_record_t;
+
+typedef enum {
+    CONNECT4_RECORD_OK,
+    CONNECT4_RECORD_BAD_SIZE,       // geometry the engine does not support
+    CONNECT4_RECORD_BAD_MOVE,       // column out of range or full
+    CONNECT4_RECORD_PAST_END,       // moves after the game was over
+    CONNECT4_RECORD_BAD_RESULT      // stored result differs from the replay
+} Connect4_record_error_t;
+
+int connect4_record_encode (Connect4_t *game, uint32_t black_id, uint32_t white_id,
+                            uint8_t *buf, size_t size);
+int connect4_record_decode (const uint8_t *buf, size_t len, Connect4_record_t *rec);
+int connect4_record_move (const Connect4_record_t *rec, int index);
+Connect4_record_error_t connect4_record_replay (const Connect4_record_t *rec,
+                                                Connect4_t *game);
+const char *connect4_record_strerror (Connect4_record_error_t err);
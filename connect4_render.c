@@ -0,0 +1,483 @@
+/*
+ *  Connect four renderer: backend dispatch, board layout and dirty
+ *  tracking shared by every backend, and the null and terminal backends
+ *  (see connect4_render.h)
+ */
+
+#include "connect4_render.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define TERM_LINE_MAX 64
+
+static const Connect4_render_ops_t *BACKENDS[] = {
+#ifdef CONNECT4_HAVE_X11
+    &connect4_render_x11_ops,
+#endif
+    &connect4_render_term_ops,
+    &connect4_render_null_ops,
+    &connect4_render_fb_ops,
+};
+
+#define BACKEND_NUM (sizeof(BACKENDS)/sizeof(BACKENDS[0]))
+
+/*
+ *  x11 when it is built in, the terminal otherwise
+ */
+const char *
+connect4_render_default (void)
+{
+    return BACKENDS[0]->name;
+}
+
+/*
+ *  Function name:
+ *      connect4_render_open
+ *
+ *  Description:
+ *      open a backend by name; "name:arg" passes arg to the backend
+ *
+ *  Input:
+ *      render  :   renderer
+ *      spec    :   backend name, optionally followed by ':' and an argument
+ *      game    :   game to draw, must outlive the renderer
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the backend is unknown or fails
+ */
+int
+connect4_render_open (Connect4_render_t *render, const char *spec, Connect4_t *game)
+{
+    const char *arg = strchr(spec, ':');
+    size_t name_len = arg ? (size_t)(arg - spec) : strlen(spec);
+
+    render->game = game;
+    render->selected_row = render->selected_col = -1;
+    render->full_redraw = true;
+    render->drawn_move_num = 0;
+    render->round_trip_num = 0;
+    render->status_changed = false;
+    render->status[0] = '\0';
+    render->backend = NULL;
+
+    for (size_t i = 0; i < BACKEND_NUM; i++) {
+        if (strlen(BACKENDS[i]->name) != name_len
+                || strncmp(BACKENDS[i]->name, spec, name_len) != 0)
+            continue;
+
+        render->ops = BACKENDS[i];
+        return render->ops->open(render, arg ? arg + 1 : NULL);
+    }
+
+    fprintf(stderr, "Unknown renderer: %s (", spec);
+    for (size_t i = 0; i < BACKEND_NUM; i++)
+        fprintf(stderr, i ? " %s" : "%s", BACKENDS[i]->name);
+    fprintf(stderr, ")\n");
+    return -1;
+}
+
+void
+connect4_render_close (Connect4_render_t *render)
+{
+    render->ops->close(render);
+}
+
+int
+connect4_render_input_fd (Connect4_render_t *render)
+{
+    return render->ops->input_fd(render);
+}
+
+/*
+ *  handle everything the backend has queued; return true with the
+ *  next player input, false when there is none left
+ */
+bool
+connect4_render_next_input (Connect4_render_t *render, Connect4_input_t *input)
+{
+    return render->ops->next_input(render, input);
+}
+
+void
+connect4_render_select_cell (Connect4_render_t *render, int row, int col)
+{
+    int old_col = render->selected_col;
+    int old_row = render->selected_row;
+
+    // すでに選択済み
+    if (row == old_row && col == old_col)
+        return;
+
+    render->selected_col = col;
+    render->selected_row = row;
+
+    // ハイライトを消すため
+    if (0 <= old_row)
+        render->ops->draw_cell(render, old_row, old_col);
+
+    if (0 <= row)
+        render->ops->draw_cell(render, row, col);
+}
+
+/*
+ *  show a new status line with the next update
+ */
+void
+connect4_render_set_status (Connect4_render_t *render, const char *status)
+{
+    if (strcmp(render->status, status) == 0)
+        return;
+
+    snprintf(render->status, sizeof(render->status), "%s", status);
+    render->status_changed = true;
+}
+
+/*
+ *  column name into label (CONNECT4_RENDER_LABEL_MAX bytes): A .. Z,
+ *  then AA, AB ... like a spreadsheet
+ */
+void
+connect4_render_col_label (int col, char *label)
+{
+    if (col < 26)
+        snprintf(label, CONNECT4_RENDER_LABEL_MAX, "%c", 'A' + col);
+    else
+        snprintf(label, CONNECT4_RENDER_LABEL_MAX, "%c%c", 'A' + col/26 - 1, 'A' + col%26);
+}
+
+/*
+ *  row number into label, 1 for the top row
+ */
+void
+connect4_render_row_label (int row, char *label)
+{
+    snprintf(label, CONNECT4_RENDER_LABEL_MAX, "%d", row + 1);
+}
+
+void
+connect4_render_draw_grid (Connect4_render_t *render)
+{
+    Connect4_t *game = render->game;
+    char label[CONNECT4_RENDER_LABEL_MAX];
+
+    render->ops->clear(render);
+
+    for (int row = 0; row < game->row_num; row++) {
+        connect4_render_row_label(row, label);
+        render->ops->draw_string(render, label, row, -1);
+    }
+
+    for (int col = 0; col < game->col_num; col++) {
+        connect4_render_col_label(col, label);
+        render->ops->draw_string(render, label, -1, col);
+    }
+
+    for (int row = 0; row < game->row_num; row++)
+        for (int col = 0; col < game->col_num; col++)
+            render->ops->draw_cell(render, row, col);
+
+    // cleared with the rest
+    render->status_changed = true;
+    render->full_redraw = false;
+    render->drawn_move_num = connect4_get_move_num(game);
+}
+
+/*
+ *  Function name:
+ *      connect4_render_update
+ *
+ *  Description:
+ *      bring the picture up to date and present it: everything after a
+ *      resize, otherwise only the cells of the disks placed since the
+ *      last call
+ *
+ *  Input:
+ *      render  :   renderer
+ */
+void
+connect4_render_update (Connect4_render_t *render)
+{
+    Connect4_t *game = render->game;
+    int move_num = connect4_get_move_num(game);
+
+    if (render->full_redraw || move_num < render->drawn_move_num) {
+        connect4_render_draw_grid(render);
+    }
+    else {
+        for (int i = render->drawn_move_num; i < move_num; i++)
+            render->ops->draw_cell(render,
+                    connect4_get_move_row(game, i),
+                    connect4_get_move_col(game, i));
+        render->drawn_move_num = move_num;
+    }
+
+    if (render->status_changed) {
+        render->ops->draw_status(render, render->status);
+        render->status_changed = false;
+    }
+    render->ops->present(render);
+}
+
+// --------------------------------------------------
+// <Null backend>
+
+static int
+null_open (Connect4_render_t *render, const char *arg)
+{
+    return 0;
+}
+
+static void
+null_close (Connect4_render_t *render)
+{
+}
+
+static int
+null_input_fd (Connect4_render_t *render)
+{
+    return -1;
+}
+
+static bool
+null_next_input (Connect4_render_t *render, Connect4_input_t *input)
+{
+    return false;
+}
+
+static void
+null_clear (Connect4_render_t *render)
+{
+}
+
+static void
+null_draw_cell (Connect4_render_t *render, int row, int col)
+{
+}
+
+static void
+null_draw_string (Connect4_render_t *render, const char *str, int row, int col)
+{
+}
+
+static void
+null_draw_status (Connect4_render_t *render, const char *status)
+{
+}
+
+const Connect4_render_ops_t connect4_render_null_ops = {
+    .name = "null",
+    .open = null_open,
+    .close = null_close,
+    .input_fd = null_input_fd,
+    .next_input = null_next_input,
+    .clear = null_clear,
+    .draw_cell = null_draw_cell,
+    .draw_string = null_draw_string,
+    .draw_status = null_draw_status,
+    .present = null_clear,
+};
+
+// </Null backend>
+// --------------------------------------------------
+// <Terminal backend>
+
+/*
+ *  The board is printed whenever it changed; a line with a column
+ *  letter drops a disk, "q" or end of input quits.
+ */
+typedef struct Term {
+    bool changed;
+    bool status_changed;
+    bool eof;
+    size_t line_len;
+    char line[TERM_LINE_MAX];
+} Term_t;
+
+static int
+term_open (Connect4_render_t *render, const char *arg)
+{
+    Term_t *term = calloc(1, sizeof(Term_t));
+    if (term == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    render->backend = term;
+    return 0;
+}
+
+static void
+term_close (Connect4_render_t *render)
+{
+    free(render->backend);
+    render->backend = NULL;
+}
+
+static int
+term_input_fd (Connect4_render_t *render)
+{
+    Term_t *term = render->backend;
+    return term->eof ? -1 : STDIN_FILENO;
+}
+
+/*
+ *  parse one line; return true when it is an input
+ */
+static bool
+term_parse_line (Connect4_render_t *render, const char *line, Connect4_input_t *input)
+{
+    int col_num = render->game->col_num;
+    char label[CONNECT4_RENDER_LABEL_MAX];
+    size_t len = 0;
+
+    if (line[0] == 'q' || line[0] == 'Q') {
+        *input = (Connect4_input_t){.type = CONNECT4_INPUT_QUIT};
+        return true;
+    }
+
+    // column names in either case
+    char name[CONNECT4_RENDER_LABEL_MAX];
+    while (len < sizeof(name) - 1 && isalpha((unsigned char)line[len])) {
+        name[len] = toupper((unsigned char)line[len]);
+        len++;
+    }
+    name[len] = '\0';
+    for (int col = 0; len > 0 && col < col_num; col++) {
+        connect4_render_col_label(col, label);
+        if (strcmp(label, name) == 0) {
+            *input = (Connect4_input_t){.type = CONNECT4_INPUT_DROP, .col = col};
+            return true;
+        }
+    }
+
+    if (line[0] != '\0') {
+        connect4_render_col_label(col_num - 1, label);
+        printf("Input a column name (A-%s) or q\n", label);
+    }
+    return false;
+}
+
+static bool
+term_next_input (Connect4_render_t *render, Connect4_input_t *input)
+{
+    Term_t *term = render->backend;
+
+    for (;;) {
+        // a complete line already buffered
+        char *newline = memchr(term->line, '\n', term->line_len);
+        if (newline != NULL) {
+            *newline = '\0';
+            size_t used = newline - term->line + 1;
+            bool ret = term_parse_line(render, term->line, input);
+            memmove(term->line, term->line + used, term->line_len - used);
+            term->line_len -= used;
+            if (ret)
+                return true;
+            continue;
+        }
+
+        if (term->eof)
+            return false;
+        struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+        if (poll(&pfd, 1, 0) <= 0)
+            return false;
+
+        // a line longer than the buffer is dropped
+        if (term->line_len == sizeof(term->line))
+            term->line_len = 0;
+        ssize_t len = read(STDIN_FILENO, term->line + term->line_len,
+                            sizeof(term->line) - term->line_len);
+        if (len <= 0) {
+            term->eof = true;
+            *input = (Connect4_input_t){.type = CONNECT4_INPUT_QUIT};
+            return true;
+        }
+        term->line_len += len;
+    }
+}
+
+static void
+term_changed (Connect4_render_t *render)
+{
+    Term_t *term = render->backend;
+    term->changed = true;
+}
+
+static void
+term_draw_cell (Connect4_render_t *render, int row, int col)
+{
+    term_changed(render);
+}
+
+static void
+term_draw_string (Connect4_render_t *render, const char *str, int row, int col)
+{
+    term_changed(render);
+}
+
+static void
+term_draw_status (Connect4_render_t *render, const char *status)
+{
+    Term_t *term = render->backend;
+    term->status_changed = true;
+}
+
+static void
+term_present (Connect4_render_t *render)
+{
+    Term_t *term = render->backend;
+    Connect4_t *game = render->game;
+    static const char DISKS[] = {'X', 'O', '.'};   // by Cell_state_t
+
+    // the status alone is printed as one line
+    if (term->status_changed && render->status[0] != '\0')
+        printf("[%s]\n", render->status);
+    term->status_changed = false;
+
+    if (!term->changed) {
+        fflush(stdout);
+        return;
+    }
+    term->changed = false;
+
+    // as wide as the longest label
+    char label[CONNECT4_RENDER_LABEL_MAX];
+    connect4_render_col_label(game->col_num - 1, label);
+    int col_width = strlen(label);
+    connect4_render_row_label(game->row_num - 1, label);
+    int row_width = strlen(label);
+
+    printf("\n%*s", row_width, "");
+    for (int col = 0; col < game->col_num; col++) {
+        connect4_render_col_label(col, label);
+        printf(" %*s", col_width, label);
+    }
+    putchar('\n');
+    for (int row = 0; row < game->row_num; row++) {
+        connect4_render_row_label(row, label);
+        printf("%*s", row_width, label);
+        for (int col = 0; col < game->col_num; col++)
+            printf(" %*c", col_width, DISKS[connect4_get_cell_state(game, row, col)]);
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+const Connect4_render_ops_t connect4_render_term_ops = {
+    .name = "term",
+    .open = term_open,
+    .close = term_close,
+    .input_fd = term_input_fd,
+    .next_input = term_next_input,
+    .clear = term_changed,
+    .draw_cell = term_draw_cell,
+    .draw_string = term_draw_string,
+    .draw_status = term_draw_status,
+    .present = term_present,
+};
+
+// </Terminal backend>
+// --------------------------------------------------
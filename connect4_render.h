@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "connect4.h"
+
+/*
+ *  <<Renderer backends>>
+ *
+ *  The front end draws through Connect4_render_t and never talks to a
+ *  display directly. A backend implements a few primitives (clear, one
+ *  cell, one label, present) and may deliver player input; the board
+ *  layout and the dirty tracking are shared by all of them.
+ *
+ *  x11     :   window on $DISPLAY (built when X11 is found)
+ *  term    :   board printed as text, columns read from stdin
+ *  null    :   draws nothing, for bots and load tests
+ *  fb      :   in-memory 32-bit framebuffer; "fb:path" writes every
+ *              presented frame to path as a binary PPM (golden images)
+ *
+ *  Labels sit at row -1 (column names A .. Z, AA ...) and col -1 (row
+ *  numbers from 1), the status line (connection state) in the row below
+ *  the board. fb leaves the status out so its images depend only on the
+ *  position.
+ */
+
+#define CONNECT4_RENDER_STATUS_MAX 96
+// a row number of any int fits, so snprintf() never truncates
+#define CONNECT4_RENDER_LABEL_MAX 12
+
+typedef enum {
+    CONNECT4_INPUT_DROP,    // the player picked a column
+    CONNECT4_INPUT_QUIT
+} Connect4_input_type_t;
+
+typedef struct Connect4_input {
+    Connect4_input_type_t type;
+    int col;
+} Connect4_input_t;
+
+struct Connect4_render;
+
+typedef struct Connect4_render_ops {
+    const char *name;
+    int (*open)(struct Connect4_render *render, const char *arg);
+    void (*close)(struct Connect4_render *render);
+    int (*input_fd)(struct Connect4_render *render);    // -1 when there is no input
+    bool (*next_input)(struct Connect4_render *render, Connect4_input_t *input);
+    void (*clear)(struct Connect4_render *render);
+    void (*draw_cell)(struct Connect4_render *render, int row, int col);
+    void (*draw_string)(struct Connect4_render *render, const char *str, int row, int col);
+    void (*draw_status)(struct Connect4_render *render, const char *status);
+    void (*present)(struct Connect4_render *render);
+} Connect4_render_ops_t;
+
+typedef struct Connect4_render {
+    const Connect4_render_ops_t *ops;
+    Connect4_t *game;               // drawn, not owned
+    int selected_row, selected_col; // highlighted cell, -1 for none
+    bool full_redraw;               // the whole board must be repainted
+    int drawn_move_num;             // disks already drawn
+    unsigned long round_trip_num;   // requests that waited for the display
+    bool status_changed;            // status not drawn yet
+    char status[CONNECT4_RENDER_STATUS_MAX];
+    void *backend;
+} Connect4_render_t;
+
+extern const Connect4_render_ops_t connect4_render_x11_ops;
+extern const Connect4_render_ops_t connect4_render_term_ops;
+extern const Connect4_render_ops_t connect4_render_null_ops;
+extern const Connect4_render_ops_t connect4_render_fb_ops;
+
+int connect4_render_open (Connect4_render_t *render, const char *spec, Connect4_t *game);
+void connect4_render_close (Connect4_render_t *render);
+int connect4_render_input_fd (Connect4_render_t *render);
+bool connect4_render_next_input (Connect4_render_t *render, Connect4_input_t *input);
+void connect4_render_select_cell (Connect4_render_t *render, int row, int col);
+void connect4_render_set_status (Connect4_render_t *render, const char *status);
+void connect4_render_draw_grid (Connect4_render_t *render);
+void connect4_render_col_label (int col, char *label);
+void connect4_render_row_label (int row, char *label);
+void connect4_render_update (Connect4_render_t *render);
+const char *connect4_render_default (void);
+const uint32_t *connect4_render_fb_pixels (Connect4_render_t *render,
+                                            int *width, int *height);
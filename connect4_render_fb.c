@@ -0,0 +1,235 @@
+/*
+ *  Connect four renderer: in-memory framebuffer backend
+ *
+ *  Draws the same layout as the X11 window into 0xRRGGBB pixels at a
+ *  fixed cell size, so a position always gives the same image. With
+ *  "fb:path" every presented frame is written to path as a binary PPM.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "connect4_render.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FB_CELL 24
+#define FB_GAP 1
+#define FB_GLYPH_SCALE 2
+
+#define FB_WHITE 0xffffff
+#define FB_BLACK 0x000000
+#define FB_BOARD 0x228b22               // ForestGreen
+#define FB_BOARD_HIGHLIGHT 0x00ff00     // Green
+
+typedef struct Fb {
+    int width, height;
+    uint32_t *pixels;
+    char *path;                 // PPM output, NULL for none
+    bool changed;               // drawn since the last present
+    unsigned long frame_num;
+} Fb_t;
+
+// 3x5 glyphs of the labels, top row in the highest bits
+static const struct {
+    char c;
+    uint16_t bits;
+} GLYPHS[] = {
+    {'1', 026227}, {'2', 071747}, {'3', 071717}, {'4', 055711},
+    {'5', 074717}, {'6', 074757}, {'7', 071111}, {'8', 075757},
+    {'9', 075717}, {'A', 025755}, {'B', 065656}, {'C', 034443},
+    {'D', 065556}, {'E', 074747}, {'F', 074744}, {'G', 034553},
+    {'H', 055755}, {'I', 072227}, {'J', 011152}, {'K', 055655},
+    {'L', 044447}, {'M', 057755}, {'N', 065555}, {'O', 025552},
+    {'P', 065644}, {'Q', 025563}, {'R', 065655}, {'S', 034216},
+    {'T', 072222}, {'U', 055557}, {'V', 055552}, {'W', 055775},
+    {'X', 055255}, {'Y', 055222}, {'Z', 071247}, {'0', 075557},
+};
+
+#define GLYPH_NUM (sizeof(GLYPHS)/sizeof(GLYPHS[0]))
+
+static void
+fill_rect (Fb_t *fb, int x, int y, int width, int height, uint32_t color)
+{
+    for (int py = y; py < y + height && py < fb->height; py++)
+        for (int px = x; px < x + width && px < fb->width; px++)
+            if (0 <= px && 0 <= py)
+                fb->pixels[py*fb->width + px] = color;
+}
+
+static int
+fb_open (Connect4_render_t *render, const char *arg)
+{
+    Fb_t *fb = calloc(1, sizeof(Fb_t));
+    if (fb == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    fb->width = (render->game->col_num + 2)*(FB_CELL + FB_GAP);
+    fb->height = (render->game->row_num + 2)*(FB_CELL + FB_GAP);
+    fb->pixels = malloc((size_t)fb->width*fb->height*sizeof(uint32_t));
+    fb->path = arg ? strdup(arg) : NULL;
+    if (fb->pixels == NULL || (arg && fb->path == NULL)) {
+        perror("malloc");
+        free(fb->pixels);
+        free(fb->path);
+        free(fb);
+        return -1;
+    }
+
+    render->backend = fb;
+    return 0;
+}
+
+static void
+fb_close (Connect4_render_t *render)
+{
+    Fb_t *fb = render->backend;
+
+    free(fb->pixels);
+    free(fb->path);
+    free(fb);
+    render->backend = NULL;
+}
+
+static int
+fb_input_fd (Connect4_render_t *render)
+{
+    return -1;
+}
+
+static bool
+fb_next_input (Connect4_render_t *render, Connect4_input_t *input)
+{
+    return false;
+}
+
+static void
+fb_clear (Connect4_render_t *render)
+{
+    Fb_t *fb = render->backend;
+    int col_num = render->game->col_num, row_num = render->game->row_num;
+
+    fb->changed = true;
+    fill_rect(fb, 0, 0, fb->width, fb->height, FB_WHITE);
+    fill_rect(fb, FB_CELL, FB_CELL,
+            col_num*FB_CELL + (col_num + 1)*FB_GAP,
+            row_num*FB_CELL + (row_num + 1)*FB_GAP,
+            FB_BLACK);
+}
+
+static void
+fb_draw_cell (Connect4_render_t *render, int row, int col)
+{
+    Fb_t *fb = render->backend;
+    int x = (col + 1)*(FB_CELL + FB_GAP);
+    int y = (row + 1)*(FB_CELL + FB_GAP);
+    bool is_highlight = (row == render->selected_row && col == render->selected_col);
+
+    fb->changed = true;
+    fill_rect(fb, x, y, FB_CELL, FB_CELL,
+            is_highlight ? FB_BOARD_HIGHLIGHT : FB_BOARD);
+
+    Cell_state_t cs = connect4_get_cell_state(render->game, row, col);
+    if (cs == CELL_EMPTY)
+        return;
+
+    // pixel centers inside the circle inscribed in the cell
+    uint32_t color = (cs == CELL_BLACK) ? FB_BLACK : FB_WHITE;
+    for (int py = 0; py < FB_CELL; py++) {
+        for (int px = 0; px < FB_CELL; px++) {
+            int dx = 2*px + 1 - FB_CELL, dy = 2*py + 1 - FB_CELL;
+            if (dx*dx + dy*dy <= FB_CELL*FB_CELL)
+                fb->pixels[(y + py)*fb->width + x + px] = color;
+        }
+    }
+}
+
+static void
+fb_draw_string (Connect4_render_t *render, const char *str, int row, int col)
+{
+    Fb_t *fb = render->backend;
+    int glyph_w = 3*FB_GLYPH_SCALE, glyph_h = 5*FB_GLYPH_SCALE;
+    int advance = glyph_w + FB_GLYPH_SCALE;
+    int len = strlen(str);
+
+    // centered in the label cell
+    int x = (col + 1)*(FB_CELL + FB_GAP) + (FB_CELL - len*advance + FB_GLYPH_SCALE)/2;
+    int y = (row + 1)*(FB_CELL + FB_GAP) + (FB_CELL - glyph_h)/2;
+
+    for (int i = 0; i < len; i++, x += advance) {
+        uint16_t bits = 0;
+        for (size_t g = 0; g < GLYPH_NUM; g++)
+            if (GLYPHS[g].c == str[i])
+                bits = GLYPHS[g].bits;
+
+        for (int gy = 0; gy < 5; gy++)
+            for (int gx = 0; gx < 3; gx++)
+                if (bits>>(14 - 3*gy - gx) & 1)
+                    fill_rect(fb, x + gx*FB_GLYPH_SCALE, y + gy*FB_GLYPH_SCALE,
+                            FB_GLYPH_SCALE, FB_GLYPH_SCALE, FB_BLACK);
+    }
+}
+
+// the status would make the image depend on timing
+static void
+fb_draw_status (Connect4_render_t *render, const char *status)
+{
+}
+
+static void
+fb_present (Connect4_render_t *render)
+{
+    Fb_t *fb = render->backend;
+
+    if (!fb->changed)
+        return;
+    fb->changed = false;
+    fb->frame_num++;
+    if (fb->path == NULL)
+        return;
+
+    FILE *fp = fopen(fb->path, "wb");
+    if (fp == NULL) {
+        perror("fopen");
+        return;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", fb->width, fb->height);
+    for (int i = 0; i < fb->width*fb->height; i++) {
+        uint32_t p = fb->pixels[i];
+        uint8_t rgb[3] = {p>>16 & 0xff, p>>8 & 0xff, p & 0xff};
+        fwrite(rgb, 1, sizeof(rgb), fp);
+    }
+    if (fclose(fp) != 0)
+        perror("fclose");
+}
+
+/*
+ *  pixels of the framebuffer backend (0xRRGGBB, row-major), NULL for
+ *  any other backend
+ */
+const uint32_t *
+connect4_render_fb_pixels (Connect4_render_t *render, int *width, int *height)
+{
+    if (render->ops != &connect4_render_fb_ops)
+        return NULL;
+
+    Fb_t *fb = render->backend;
+    *width = fb->width;
+    *height = fb->height;
+    return fb->pixels;
+}
+
+const Connect4_render_ops_t connect4_render_fb_ops = {
+    .name = "fb",
+    .open = fb_open,
+    .close = fb_close,
+    .input_fd = fb_input_fd,
+    .next_input = fb_next_input,
+    .clear = fb_clear,
+    .draw_cell = fb_draw_cell,
+    .draw_string = fb_draw_string,
+    .draw_status = fb_draw_status,
+    .present = fb_present,
+};
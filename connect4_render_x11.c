@@ -0,0 +1,691 @@
+/*
+ *  Connect four renderer: X11 backend
+ *
+ *  Everything is drawn into a back-buffer Pixmap from cell sprites
+ *  rendered once per window size; the changed part is copied to the
+ *  window with one XCopyArea per frame. Pointer positions come from the
+ *  events, so hovering costs no round-trip.
+ */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "connect4_render.h"
+
+#define WINDOW_SIZE_X_MIN 200
+#define WINDOW_SIZE_Y_MIN 200
+#define GRID_LINE_WID 1
+#define GRID_GAP 1
+#define DEFAULT_SIZE_X 400
+#define DEFAULT_SIZE_Y 400
+static char *FONT_NAME = "fixed";
+static char *WINDOW_NAME = "Report 1";
+
+// cached cell images, indexed by Cell_state_t*2 + highlighted
+#define SPRITE_NUM 6
+
+typedef struct Color_pixel {
+    unsigned long black, black_highlight;
+    unsigned long white, white_highlight;
+    unsigned long board, board_highlight;
+} Color_pixel_t;
+
+typedef struct GCs {
+    GC black, black_highlight;
+    GC white, white_highlight;
+    GC board, board_highlight;
+} GCs_t;
+
+typedef struct Grid {
+    int row_num, col_num; // num of visible cells
+    int cellsize_x, cellsize_y;
+    int size_x, size_y; // including invisible cells
+    int pos_x, pos_y;   // including invisible cells
+    int gap_size;
+} Grid_t;
+
+typedef struct Dirty_rect {
+    int x0, y0, x1, y1;     // empty when x1 <= x0
+} Dirty_rect_t;
+
+typedef struct X11_render {
+    Display *disp;
+    Window  win;
+    Grid_t grid;
+    GCs_t   GCs;
+    XFontStruct *font;
+    Color_pixel_t color_pixel;
+    Atom wm_delete_window;
+    int win_width, win_height;
+    Pixmap back_buf;            // everything is drawn here, then copied
+    Pixmap sprites[SPRITE_NUM]; // one cell each, rebuilt on resize
+    Dirty_rect_t dirty;         // part of back_buf not yet on the window
+} X11_render_t;
+
+static int
+min (int a, int b)
+{
+    return(a<b) ? a : b;
+}
+
+static int
+max (int a, int b)
+{
+    return (a>b) ? a : b;
+}
+
+/*
+ *  request is NextRequest() before an Xlib call; a reply to it or to a
+ *  later request was read only if the call waited for the server
+ */
+static void
+count_round_trip (Connect4_render_t *render, unsigned long request)
+{
+    X11_render_t *x11 = render->backend;
+    if (LastKnownRequestProcessed(x11->disp) >= request)
+        render->round_trip_num++;
+}
+
+// --------------------------------------------------
+// <Color initializer>
+
+static unsigned long
+_alloc_named_color (Connect4_render_t *render, const char *color_name)
+{
+    X11_render_t *x11 = render->backend;
+    Colormap cmap = DefaultColormap(
+        x11->disp,
+        DefaultScreen(x11->disp)
+    );
+    XColor color, useless;
+    int rslt;
+    unsigned long request = NextRequest(x11->disp);
+    rslt = XAllocNamedColor(
+        x11->disp,
+        cmap,
+        color_name,
+        &color,
+        &useless
+    );
+    count_round_trip(render, request);
+    // if (rslt == 0)
+    //     xerror("XAllocNamedColor()");
+
+    return color.pixel;
+}
+
+static void
+alloc_named_colors (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+    x11->color_pixel = (Color_pixel_t){
+        .black = BlackPixel(x11->disp, DefaultScreen(x11->disp)),
+        .white = WhitePixel(x11->disp, DefaultScreen(x11->disp)),
+        .board = _alloc_named_color(render, "ForestGreen"),
+        .black_highlight = _alloc_named_color(render, "DarkSlateGray"),
+        .white_highlight = _alloc_named_color(render, "Honeydew"),
+        .board_highlight = _alloc_named_color(render, "Green"),
+    };
+
+}
+
+// </Color initializer>
+// --------------------------------------------------
+// <GC intializer and applier>
+static void
+create_GCs (X11_render_t *x11)
+{
+    x11->GCs = (GCs_t){
+        .black = XCreateGC(x11->disp, x11->win, 0, NULL),
+        .white = XCreateGC(x11->disp, x11->win, 0, NULL),
+        .board = XCreateGC(x11->disp, x11->win, 0, NULL),
+        .black_highlight = XCreateGC(x11->disp, x11->win, 0, NULL),
+        .white_highlight = XCreateGC(x11->disp, x11->win, 0, NULL),
+        .board_highlight = XCreateGC(x11->disp, x11->win, 0, NULL),
+    };
+}
+static void
+set_foregrounds (X11_render_t *x11)
+{
+    XSetForeground(
+        x11->disp,
+        x11->GCs.black,
+        x11->color_pixel.black
+    );
+    XSetForeground(
+        x11->disp,
+        x11->GCs.white,
+        x11->color_pixel.white
+    );
+    XSetForeground(
+        x11->disp,
+        x11->GCs.black_highlight,
+        x11->color_pixel.black_highlight
+    );
+    XSetForeground(
+        x11->disp,
+        x11->GCs.white_highlight,
+        x11->color_pixel.white_highlight
+    );
+    XSetForeground(
+        x11->disp,
+        x11->GCs.board,
+        x11->color_pixel.board
+    );
+    XSetForeground(
+        x11->disp,
+        x11->GCs.board_highlight,
+        x11->color_pixel.board_highlight
+    );
+}
+// </GC initializer and applier>
+// --------------------------------------------------
+// <Back buffer>
+
+static bool
+is_on_grid (X11_render_t *x11, int cursor_x, int cursor_y, int *row, int *col)
+{
+    Grid_t *grid = &x11->grid;
+
+    *row = -1 + (cursor_y - grid->pos_y)/(grid->cellsize_y + grid->gap_size);
+    *col = -1 + (cursor_x - grid->pos_x)/(grid->cellsize_x + grid->gap_size);
+
+    if (0 <= *row && *row < grid->row_num &&
+        0 <= *col && *col < grid->col_num)
+        return true;
+
+    return false;
+}
+
+static void
+free_buffers (X11_render_t *x11)
+{
+    if (x11->back_buf != None)
+        XFreePixmap(x11->disp, x11->back_buf);
+    x11->back_buf = None;
+
+    for (int i = 0; i < SPRITE_NUM; i++) {
+        if (x11->sprites[i] != None)
+            XFreePixmap(x11->disp, x11->sprites[i]);
+        x11->sprites[i] = None;
+    }
+}
+
+/*
+ *  Function name:
+ *      create_buffers
+ *
+ *  Description:
+ *      (re)create the back buffer at the window size and render the
+ *      cell sprites at the current cell size
+ *
+ *  Input:
+ *      x11     :   window
+ */
+static void
+create_buffers (X11_render_t *x11)
+{
+    Display *disp = x11->disp;
+    int depth = DefaultDepth(disp, DefaultScreen(disp));
+    int width = max(x11->grid.cellsize_x, 1);
+    int height = max(x11->grid.cellsize_y, 1);
+
+    free_buffers(x11);
+    x11->back_buf = XCreatePixmap(disp, x11->win,
+            max(x11->win_width, 1), max(x11->win_height, 1), depth);
+
+    for (int cs = CELL_BLACK; cs <= CELL_EMPTY; cs++) {
+        for (int highlight = 0; highlight < 2; highlight++) {
+            Pixmap sprite = XCreatePixmap(disp, x11->win, width, height, depth);
+
+            XFillRectangle(disp, sprite,
+                highlight ? x11->GCs.board_highlight : x11->GCs.board,
+                0, 0, width, height
+            );
+            if (cs != CELL_EMPTY)
+                XFillArc(disp, sprite,
+                    cs == CELL_BLACK ? x11->GCs.black : x11->GCs.white,
+                    0, 0, width, height,
+                    0, 360 * 64
+                );
+            x11->sprites[cs*2 + highlight] = sprite;
+        }
+    }
+}
+
+/*
+ *  return true when the window size changed (and the buffers with it)
+ */
+static bool
+optimize_grid_pos (X11_render_t *x11, int win_width, int win_height)
+{
+    // (col_num)x(row_num) for the game board
+    // top row left column for labels
+    // bottom row for status text
+    // right column is empty
+
+    int nCellx = x11->grid.col_num;
+    int cellsize_x =
+        (win_width - (nCellx+1)*x11->grid.gap_size)/(nCellx+2);
+
+    int nCelly = x11->grid.row_num;
+    int cellsize_y =
+        (win_height - (nCelly+1)*x11->grid.gap_size)/(nCelly+2);
+
+    if (cellsize_x < cellsize_y)
+        x11->grid.cellsize_x = x11->grid.cellsize_y = cellsize_x;
+    else
+        x11->grid.cellsize_x = x11->grid.cellsize_y = cellsize_y;
+
+    x11->grid.size_x = (nCellx+2)*x11->grid.cellsize_x + (nCellx+2);
+    x11->grid.size_y = (nCelly+2)*x11->grid.cellsize_y + (nCelly+2);
+
+    x11->grid.pos_x = win_width/2 - x11->grid.size_x/2;
+    x11->grid.pos_y = win_height/2 - x11->grid.size_y/2;
+
+    // ConfigureNotify also comes for a window that only moved
+    if (x11->back_buf != None
+            && win_width == x11->win_width && win_height == x11->win_height)
+        return false;
+    x11->win_width = win_width;
+    x11->win_height = win_height;
+    create_buffers(x11);
+    return true;
+}
+
+static void
+mark_dirty (X11_render_t *x11, int x, int y, int width, int height)
+{
+    Dirty_rect_t *dirty = &x11->dirty;
+
+    if (dirty->x1 <= dirty->x0) {
+        *dirty = (Dirty_rect_t){x, y, x + width, y + height};
+        return;
+    }
+    dirty->x0 = min(dirty->x0, x);
+    dirty->y0 = min(dirty->y0, y);
+    dirty->x1 = max(dirty->x1, x + width);
+    dirty->y1 = max(dirty->y1, y + height);
+}
+
+// </Back buffer>
+// --------------------------------------------------
+// <Drawing>
+
+/*
+ *  copy what changed in the back buffer to the window, in one request
+ */
+static void
+x11_present (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+    Dirty_rect_t *dirty = &x11->dirty;
+
+    if (dirty->x1 > dirty->x0) {
+        XCopyArea(x11->disp, x11->back_buf, x11->win, x11->GCs.black,
+            dirty->x0, dirty->y0,
+            dirty->x1 - dirty->x0, dirty->y1 - dirty->y0,
+            dirty->x0, dirty->y0
+        );
+        *dirty = (Dirty_rect_t){0};
+    }
+    XFlush(x11->disp);
+}
+
+static void
+x11_draw_string (Connect4_render_t *render, const char *str, int row, int col)
+{
+    X11_render_t *x11 = render->backend;
+    Grid_t *grid = &x11->grid;
+    int xpos = grid->pos_x
+            + (col + 1)*(grid->cellsize_x + grid->gap_size)
+            + grid->cellsize_x/2;
+    int ypos = grid->pos_y
+            + (row + 1)*(grid->cellsize_y + grid->gap_size)
+            + grid->cellsize_y/2;
+    int width = XTextWidth(x11->font, str, strlen(str));
+    int height = x11->font->ascent + x11->font->descent;
+
+    XDrawString(
+        x11->disp, x11->back_buf,
+        x11->GCs.black,
+        xpos - width/2, ypos + height/2,
+        str, strlen(str)
+    );
+}
+
+/*
+ *  the status line fills the row under the board
+ */
+static void
+x11_draw_status (Connect4_render_t *render, const char *status)
+{
+    X11_render_t *x11 = render->backend;
+    Grid_t *grid = &x11->grid;
+    int y = grid->pos_y + (grid->row_num + 1)*(grid->cellsize_y + grid->gap_size);
+    int height = grid->cellsize_y + grid->gap_size;
+    int width = XTextWidth(x11->font, status, strlen(status));
+
+    // the whole width, a long status may stick out of the grid
+    XFillRectangle(
+        x11->disp, x11->back_buf,
+        x11->GCs.white,
+        0, y, x11->win_width, height
+    );
+    XDrawString(
+        x11->disp, x11->back_buf,
+        x11->GCs.black,
+        grid->pos_x + grid->size_x/2 - width/2,
+        y + height/2 + (x11->font->ascent - x11->font->descent)/2,
+        status, strlen(status)
+    );
+    mark_dirty(x11, 0, y, x11->win_width, height);
+}
+
+static void
+x11_draw_cell (Connect4_render_t *render, int row, int col)
+{
+    X11_render_t *x11 = render->backend;
+    Grid_t *grid = &x11->grid;
+
+    // 一番上の行と右の列はラベル用のセルなので飛ばす
+    int x = grid->pos_x + (col+1)*(grid->cellsize_x + grid->gap_size);
+    int y = grid->pos_y + (row+1)*(grid->cellsize_y + grid->gap_size);
+
+    bool is_highlight = (
+        row == render->selected_row &&
+        col == render->selected_col
+    );
+
+    Cell_state_t cs = connect4_get_cell_state(render->game, row, col);
+
+    XCopyArea(
+        x11->disp, x11->sprites[cs*2 + is_highlight], x11->back_buf,
+        x11->GCs.black,
+        0, 0, grid->cellsize_x, grid->cellsize_y, x, y
+    );
+    mark_dirty(x11, x, y, grid->cellsize_x, grid->cellsize_y);
+}
+
+static void
+x11_clear (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+    Grid_t *grid = &x11->grid;
+    int nCellx = grid->col_num;
+    int nCelly = grid->row_num;
+
+    // the window background is white
+    XFillRectangle(
+        x11->disp, x11->back_buf,
+        x11->GCs.white,
+        0, 0, x11->win_width, x11->win_height
+    );
+    mark_dirty(x11, 0, 0, x11->win_width, x11->win_height);
+
+    XFillRectangle(
+        x11->disp, x11->back_buf,
+        x11->GCs.black,
+        grid->pos_x + grid->cellsize_x,
+        grid->pos_y + grid->cellsize_y,
+        nCellx*grid->cellsize_x + (nCellx+1)*grid->gap_size,
+        nCelly*grid->cellsize_y + (nCelly+1)*grid->gap_size
+    );
+}
+
+// </Drawing>
+// --------------------------------------------------
+// <Input>
+
+/*
+ *  highlight the cell under a window position; nothing is sent to the
+ *  X server unless the highlighted cell changes
+ */
+static void
+highlight_cell_at (Connect4_render_t *render, int win_x, int win_y)
+{
+    int row, col;
+    if (is_on_grid(render->backend, win_x, win_y, &row, &col))
+        connect4_render_select_cell(render, row, col);
+    else
+        connect4_render_select_cell(render, -1, -1); // 以前のハイライトを消すため
+}
+
+/*
+ *  ask the server where the pointer is (a round-trip); only needed when
+ *  the grid moves under a pointer that does not
+ */
+static void
+highlight_cell_mouse_on (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+    Window root, child;
+    int root_x, root_y;
+    int win_x, win_y;
+    unsigned int mask;
+
+    unsigned long request = NextRequest(x11->disp);
+    int rslt = XQueryPointer(
+        x11->disp,
+        x11->win,
+        &root, &child,
+        &root_x, &root_y,
+        &win_x, &win_y,
+        &mask
+    );
+    count_round_trip(render, request);
+    if (!rslt)
+        return;
+
+    highlight_cell_at(render, win_x, win_y);
+}
+
+static int
+x11_input_fd (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+    return ConnectionNumber(x11->disp);
+}
+
+/*
+ *  Xlib reads events ahead into its own queue, so the caller must drain
+ *  it before waiting on the connection fd
+ */
+static bool
+x11_next_input (Connect4_render_t *render, Connect4_input_t *input)
+{
+    X11_render_t *x11 = render->backend;
+    XEvent event;
+
+    while (XPending(x11->disp)) {
+        XNextEvent(x11->disp, &event);
+
+        switch (event.type)
+        {
+            case ConfigureNotify:
+                if (optimize_grid_pos(x11,
+                        event.xconfigure.width,
+                        event.xconfigure.height)) {
+                    render->full_redraw = true;
+                    // the grid moved under the pointer
+                    highlight_cell_mouse_on(render);
+                }
+                break;
+            case Expose:
+                // the back buffer still holds the picture
+                mark_dirty(x11,
+                    event.xexpose.x, event.xexpose.y,
+                    event.xexpose.width, event.xexpose.height
+                );
+                break;
+            case MotionNotify:
+                // only the latest position matters
+                while (XCheckTypedWindowEvent(x11->disp, x11->win,
+                            MotionNotify, &event))
+                    ;
+                highlight_cell_at(render, event.xmotion.x, event.xmotion.y);
+                break;
+            case LeaveNotify:
+                connect4_render_select_cell(render, -1, -1);
+                break;
+            case ButtonPress:
+                highlight_cell_at(render, event.xbutton.x, event.xbutton.y);
+                // a click anywhere in a column drops the disk into it
+                if (render->selected_col < 0)
+                    break;
+                *input = (Connect4_input_t){
+                    .type = CONNECT4_INPUT_DROP,
+                    .col = render->selected_col
+                };
+                return true;
+            case ClientMessage:
+                if (event.xclient.data.l[0] == x11->wm_delete_window) {
+                    puts("Catch quit flag");
+                    *input = (Connect4_input_t){.type = CONNECT4_INPUT_QUIT};
+                    return true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+// </Input>
+// --------------------------------------------------
+
+static int
+x11_open (Connect4_render_t *render, const char *arg)
+{
+    X11_render_t *x11 = calloc(1, sizeof(X11_render_t));
+    if (x11 == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    x11->disp = XOpenDisplay(arg);
+    if (x11->disp == NULL) {
+        fprintf(stderr, "Cannot open display %s\n", arg ? arg : XDisplayName(NULL));
+        free(x11);
+        return -1;
+    }
+    render->backend = x11;
+
+    x11->grid.col_num = render->game->col_num;
+    x11->grid.row_num = render->game->row_num;
+    x11->grid.gap_size = GRID_GAP;
+
+    // Set up the font
+    unsigned long request = NextRequest(x11->disp);
+    x11->font = XLoadQueryFont(x11->disp, FONT_NAME);
+    count_round_trip(render, request);
+    if (x11->font == NULL) {
+        puts("font not found");
+        XCloseDisplay(x11->disp);
+        free(x11);
+        return -1;
+    }
+
+    x11->win = XCreateSimpleWindow(
+        x11->disp, RootWindow(x11->disp, DefaultScreen(x11->disp)),
+        0, 0, DEFAULT_SIZE_X, DEFAULT_SIZE_Y, GRID_LINE_WID,
+        BlackPixel(x11->disp, DefaultScreen(x11->disp)),
+        WhitePixel(x11->disp, DefaultScreen(x11->disp))
+    );
+    alloc_named_colors(render);
+    create_GCs(x11);
+    set_foregrounds(x11);
+
+    XSetFont(x11->disp, x11->GCs.black, x11->font->fid);
+
+    x11->back_buf = None;
+    for (int i = 0; i < SPRITE_NUM; i++)
+        x11->sprites[i] = None;
+    optimize_grid_pos(x11, DEFAULT_SIZE_X, DEFAULT_SIZE_Y);
+
+    // Set up the Event Mask
+    XSelectInput(
+        x11->disp, x11->win,
+        ExposureMask | StructureNotifyMask |
+        ButtonPressMask |
+        PointerMotionMask | LeaveWindowMask
+    );
+
+    // Set window name
+    XTextProperty text_prop;
+    XStringListToTextProperty(
+        &WINDOW_NAME, 1, &text_prop
+    );
+
+    // Set window minimum size
+    XSizeHints *size_hits = XAllocSizeHints();
+    size_hits->flags = PMinSize;
+    size_hits->min_width    = WINDOW_SIZE_X_MIN;
+    size_hits->min_height   = WINDOW_SIZE_Y_MIN;
+
+    // these may intern atoms, each a round-trip
+    request = NextRequest(x11->disp);
+    XSetWMProperties(
+        x11->disp, x11->win,
+        &text_prop, &text_prop,
+        NULL, 0, size_hits, NULL, NULL
+    );
+    count_round_trip(render, request);
+
+    request = NextRequest(x11->disp);
+    x11->wm_delete_window = XInternAtom(
+        x11->disp, "WM_DELETE_WINDOW", False
+    );
+    count_round_trip(render, request);
+
+    request = NextRequest(x11->disp);
+    XSetWMProtocols(
+        x11->disp, x11->win,
+        &x11->wm_delete_window, 1
+    );
+    count_round_trip(render, request);
+
+    XFree(text_prop.value);
+    XFree(size_hits);
+
+    XMapWindow(x11->disp, x11->win);
+    XFlush(x11->disp);
+    return 0;
+}
+
+static void
+x11_close (Connect4_render_t *render)
+{
+    X11_render_t *x11 = render->backend;
+
+    XFreeGC(x11->disp, x11->GCs.black);
+    XFreeGC(x11->disp, x11->GCs.white);
+    XFreeGC(x11->disp, x11->GCs.board);
+    XFreeGC(x11->disp, x11->GCs.black_highlight);
+    XFreeGC(x11->disp, x11->GCs.white_highlight);
+    XFreeGC(x11->disp, x11->GCs.board_highlight);
+
+    XFreeFont(x11->disp, x11->font);
+    free_buffers(x11);
+
+    XCloseDisplay(x11->disp);
+    free(x11);
+    render->backend = NULL;
+}
+
+const Connect4_render_ops_t connect4_render_x11_ops = {
+    .name = "x11",
+    .open = x11_open,
+    .close = x11_close,
+    .input_fd = x11_input_fd,
+    .next_input = x11_next_input,
+    .clear = x11_clear,
+    .draw_cell = x11_draw_cell,
+    .draw_string = x11_draw_string,
+    .draw_status = x11_draw_status,
+    .present = x11_present,
+};
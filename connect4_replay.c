@@ -0,0 +1,333 @@
+/*
+ *  Connect four game record replayer
+ *
+ *  usage: connect4_replay [-t threads]
+ *                         [-g games [-c cols] [-r rows] [-k win_len] [-s seed]] path
+ *
+ *  Maps a record file (see connect4_record.h), replays every game
+ *  through the engine to validate it and prints what the games came to.
+ *  The file is split at record boundaries into one range per thread;
+ *  finding the boundaries only reads the headers, so the split costs a
+ *  small fraction of the replay.
+ *
+ *  With -g the file is first overwritten with random games, for
+ *  measuring the throughput without a server archive at hand.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "connect4.h"
+#include "connect4_record.h"
+#include "connect4_util.h"
+
+#define BOARD_ROW_NUM 6
+#define BOARD_COL_NUM 7
+#define THREAD_MAX 256
+#define BAD_REPORT_MAX 10   // invalid records reported one by one per thread
+
+typedef struct Replay_stats {
+    unsigned long game_num, move_num;
+    unsigned long results[CONNECT4_RECORD_UNFINISHED + 1];  // indexed by record result
+    unsigned long errors[CONNECT4_RECORD_BAD_RESULT + 1];   // indexed by error
+    int move_min, move_max;
+} Replay_stats_t;
+
+typedef struct Worker {
+    const uint8_t *map;
+    size_t begin, end;      // record boundaries
+    Replay_stats_t stats;
+    pthread_t thread;
+} Worker_t;
+
+/*
+ *  Function name:
+ *      generate
+ *
+ *  Description:
+ *      write game_num random games, each played to the end
+ *
+ *  Input:
+ *      path        :   record file, overwritten
+ *      game_num    :   number of games
+ *      col_num     :   board width
+ *      row_num     :   board height
+ *      win_len     :   disks in a row that win
+ *      seed        :   random seed
+ *
+ *  Output:
+ *      return      :   0 on success, -1 on a write error
+ */
+static int
+generate (const char *path, unsigned long game_num, int col_num, int row_num,
+            int win_len, uint64_t seed)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror("fopen");
+        return -1;
+    }
+
+    for (unsigned long i = 0; i < game_num; i++) {
+        Connect4_t game;
+        uint8_t buf[CONNECT4_RECORD_MAX];
+
+        connect4_new_game(&game, col_num, row_num, win_len);
+        while (connect4_get_game_state(&game) != GAME_OVER)
+            connect4_drop(&game, connect4_rand_next(&seed)%col_num);
+
+        int len = connect4_record_encode(&game, i*2, i*2 + 1, buf, sizeof(buf));
+        if (len < 0 || fwrite(buf, len, 1, fp) != 1) {
+            perror("fwrite");
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    if (fclose(fp) != 0) {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+static void *
+worker_main (void *arg)
+{
+    Worker_t *worker = arg;
+    Replay_stats_t *stats = &worker->stats;
+    int bad_num = 0;
+
+    stats->move_min = CONNECT4_HISTORY_MAX;
+    for (size_t pos = worker->begin; pos < worker->end; ) {
+        Connect4_record_t rec;
+        Connect4_t game;
+
+        // the ranges were cut at boundaries of well-formed records
+        size_t at = pos;
+        pos += connect4_record_decode(worker->map + pos, worker->end - pos, &rec);
+
+        Connect4_record_error_t err = connect4_record_replay(&rec, &game);
+        stats->game_num++;
+        stats->errors[err]++;
+        if (err != CONNECT4_RECORD_OK) {
+            if (bad_num++ < BAD_REPORT_MAX)
+                fprintf(stderr, "record at %zu (players %u, %u): %s\n",
+                        at, rec.black_id, rec.white_id, connect4_record_strerror(err));
+            continue;
+        }
+
+        stats->results[rec.result]++;
+        stats->move_num += rec.move_num;
+        if (rec.move_num < stats->move_min)
+            stats->move_min = rec.move_num;
+        if (rec.move_num > stats->move_max)
+            stats->move_max = rec.move_num;
+    }
+    return NULL;
+}
+
+/*
+ *  Function name:
+ *      split
+ *
+ *  Description:
+ *      cut the file into about equal ranges of whole records, one per
+ *      worker
+ *
+ *  Input:
+ *      map         :   mapped file
+ *      size        :   file size
+ *      workers     :   workers, begin and end set (output)
+ *      worker_num  :   number of workers
+ *
+ *  Output:
+ *      return      :   end of the last well-formed record; less than
+ *                      size when the file is truncated or corrupt there
+ */
+static size_t
+split (const uint8_t *map, size_t size, Worker_t *workers, int worker_num)
+{
+    size_t pos = 0;
+
+    for (int i = 0; i < worker_num; i++) {
+        size_t target = (i == worker_num - 1) ? size : size/worker_num*(i + 1);
+        workers[i].begin = pos;
+        while (pos < size && pos < target) {
+            Connect4_record_t rec;
+            int len = connect4_record_decode(map + pos, size - pos, &rec);
+            if (len <= 0)
+                break;
+            pos += len;
+        }
+        workers[i].end = pos;
+    }
+    return pos;
+}
+
+static int
+replay (const char *path, int thread_num)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        printf("%s: no games\n", path);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = st.st_size;
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    // read once front to back
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    Worker_t workers[THREAD_MAX];
+    double start = connect4_now_sec();
+    size_t valid_end = split(map, size, workers, thread_num);
+
+    int started = 1;
+    for (int i = 0; i < thread_num; i++) {
+        workers[i].map = map;
+        memset(&workers[i].stats, 0, sizeof(workers[i].stats));
+    }
+    while (started < thread_num
+            && pthread_create(&workers[started].thread, NULL, worker_main,
+                                &workers[started]) == 0)
+        started++;
+
+    // the ranges that did not get a thread are replayed here
+    worker_main(&workers[0]);
+    for (int i = started; i < thread_num; i++)
+        worker_main(&workers[i]);
+
+    Replay_stats_t total = {.move_min = CONNECT4_HISTORY_MAX};
+    for (int i = 0; i < thread_num; i++) {
+        if (0 < i && i < started)
+            pthread_join(workers[i].thread, NULL);
+
+        Replay_stats_t *stats = &workers[i].stats;
+        total.game_num += stats->game_num;
+        total.move_num += stats->move_num;
+        for (int j = 0; j <= CONNECT4_RECORD_UNFINISHED; j++)
+            total.results[j] += stats->results[j];
+        for (int j = 0; j <= CONNECT4_RECORD_BAD_RESULT; j++)
+            total.errors[j] += stats->errors[j];
+        if (stats->move_min < total.move_min)
+            total.move_min = stats->move_min;
+        if (stats->move_max > total.move_max)
+            total.move_max = stats->move_max;
+    }
+    double sec = connect4_now_sec() - start;
+    munmap(map, size);
+
+    unsigned long valid_num = total.errors[CONNECT4_RECORD_OK];
+    printf("%lu games (%zu bytes), %lu valid, %lu invalid\n",
+            total.game_num, valid_end, valid_num, total.game_num - valid_num);
+    for (int j = CONNECT4_RECORD_OK + 1; j <= CONNECT4_RECORD_BAD_RESULT; j++)
+        if (total.errors[j] != 0)
+            printf("  %s: %lu\n", connect4_record_strerror(j), total.errors[j]);
+    if (valid_end < size)
+        printf("  %zu bytes after the last record not read (truncated or corrupt)\n",
+                size - valid_end);
+    if (valid_num != 0)
+        printf("black %lu, white %lu, draw %lu, unfinished %lu; "
+                "%.1f moves per game (%d to %d)\n",
+                total.results[BLACK_WIN], total.results[WHITE_WIN],
+                total.results[GAME_DRAW], total.results[CONNECT4_RECORD_UNFINISHED],
+                (double)total.move_num/valid_num, total.move_min, total.move_max);
+    printf("%.3f s, %.0f games/s with %d threads (%.0f games/s per thread)\n",
+            sec, total.game_num/sec, started, total.game_num/sec/started);
+
+    return (valid_num == total.game_num && valid_end == size) ? 0 : 1;
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-t threads] [-g games [-c cols] [-r rows] [-k win_len] "
+            "[-s seed]] path\n", prog);
+}
+
+int main (int argc, char *argv[])
+{
+    int col_num = BOARD_COL_NUM, row_num = BOARD_ROW_NUM;
+    int win_len = CONNECT4_WIN_LEN;
+    int thread_num = 1;
+    unsigned long game_num = 0;
+    uint64_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:g:c:r:k:s:")) != -1) {
+        switch (opt)
+        {
+        case 't':
+            thread_num = strtol(optarg, NULL, 10);
+            break;
+        case 'g':
+            game_num = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            col_num = strtol(optarg, NULL, 10);
+            break;
+        case 'r':
+            row_num = strtol(optarg, NULL, 10);
+            break;
+        case 'k':
+            win_len = strtol(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10) | 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (thread_num < 1 || THREAD_MAX < thread_num) {
+        fprintf(stderr, "threads must be between 1 and %d\n", THREAD_MAX);
+        return 1;
+    }
+    if (!connect4_valid_geometry(col_num, row_num, win_len)) {
+        fprintf(stderr, "%dx%d board with %d in a row is not supported\n",
+                col_num, row_num, win_len);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    if (game_num != 0) {
+        double start = connect4_now_sec();
+        if (generate(path, game_num, col_num, row_num, win_len, seed) < 0)
+            return 1;
+        printf("%lu random games written to %s in %.3f s\n",
+                game_num, path, connect4_now_sec() - start);
+    }
+
+    int ret = replay(path, thread_num);
+    return (ret < 0) ? 1 : ret;
+}
@@ -0,0 +1,1555 @@
+/*
+ *  Connect four match server (headless)
+ *
+ *  Accepts any number of players on one listening socket, pairs them
+ *  into matches in arrival order and referees every match with its own
+ *  Connect4_t. All sockets are non-blocking and multiplexed by a single
+ *  epoll instance, so one process hosts as many games as it has fds.
+ *
+ *  <<Match protocol>>
+ *
+ *  server -> first player   : "YOU-BLACK"  (moves first)
+ *  server -> second player  : "YOU-WHITE"
+ *  after that the moves of the peer-to-peer protocol ("PLACE-cr", and
+ *  DROP for binary players) are played on the match's game and relayed
+ *  to the opponent.
+ *
+ *  The match's game is the only referee: the move that ends the game
+ *  also ends the match, and the server tells both players the result
+ *  (RESULT for version 3 players, YOU-WIN to an older winner and ERROR
+ *  on a draw) instead of waiting for the loser to concede. Version 3
+ *  players also get their own accepted moves back, so they need no
+ *  rule checks of their own (see connect4_proto.h).
+ *
+ *  Each player may switch its own connection to binary frames with
+ *  HELLO (see connect4_proto.h); the server re-encodes every relayed
+ *  message for the receiving side, so text and binary players can be
+ *  paired with each other.
+ *
+ *  A HELLO may also ask for another board or win length; players are
+ *  only paired with players of the same geometry, and the answer to
+ *  HELLO is the geometry the player gets (that of its match when it was
+ *  paired already).
+ *
+ *  A new connection is paired once its first messages are in, so that
+ *  a player coming back with RESUME or asking for another board with
+ *  HELLO is not paired into a new match first. Those come in the
+ *  client's first write, right behind the TCP handshake, so a text
+ *  player that sends nothing is paired after a few handshake round
+ *  trips (HANDSHAKE_MIN_MS to HANDSHAKE_MS), and one that speaks first
+ *  at once.
+ *
+ *  <<Session resume>>
+ *
+ *  Binary players get a SESSION token per seat when the match starts
+ *  (see connect4_proto.h). When such a player drops before the game is
+ *  over, the match is kept for the grace period and the opponent may
+ *  keep moving; the match's Connect4_t is the move log. A new
+ *  connection with the token gets RESUMED and only the moves it missed.
+ *
+ *  <<Spectators>>
+ *
+ *  A connection that sends WATCH follows a match: one SNAPSHOT, then a
+ *  DELTA per move (see connect4_proto.h). Each move is encoded once into
+ *  a shared buffer that every spectator's queue references, and each
+ *  spectator's queue goes out with one sendmsg() per round; the snapshot
+ *  is also shared by everyone who joins at the same position. A
+ *  spectator whose queue fills up is dropped rather than slowing down
+ *  the match.
+ *
+ *  <<Archive>>
+ *
+ *  With -a every match that got a move in is appended to a record file
+ *  when it ends (see connect4_record.h), one write() per match. Player
+ *  ids are connection serial numbers; a resumed seat keeps the id it
+ *  started with.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/random.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "connect4.h"
+#include "connect4_proto.h"
+#include "connect4_fanout.h"
+#include "connect4_record.h"
+#include "connect4_util.h"
+
+#define OUT_BUF_MAX 512
+#define EVENT_MAX 256
+#define HANDSHAKE_MIN_MS 5
+#define HANDSHAKE_MS 100
+static int DEFAULT_PORT_NO = 20000;
+static int DEFAULT_RESUME_GRACE_S = 30;
+
+struct Match;
+
+typedef struct Conn {
+    int fd;
+    uint32_t id;        // serial number, for the archive
+    struct Match *match;
+    Game_state_t color;
+    Connect4_proto_mode_t proto_mode;
+    bool authoritative; // HELLO version 3 or above: moves are echoed, RESULT at the end
+    bool flush_queued;  // listed in flush_list
+    bool out_armed;     // EPOLLOUT is registered
+    bool closing;       // close as soon as out_buf is flushed
+    bool pending;       // not paired yet, may still send RESUME
+    long pending_ms;    // paired at this time anyway
+    struct Conn *pending_prev, *pending_next;
+    bool waiting;       // paired with the next player of its geometry
+    struct Conn *waiting_prev, *waiting_next;
+    int col_num, row_num, win_len;      // asked for in HELLO
+    struct Match *watching;             // spectated match
+    int spectator_index;                // in watching->spectators
+    Connect4_out_queue_t *out_queue;    // shared buffers, spectators only
+    size_t out_len;
+    Connect4_decoder_t decoder;
+    uint8_t out_buf[OUT_BUF_MAX];
+} Conn_t;
+
+typedef struct Match {
+    Connect4_t game;
+    Conn_t *players[2];     // indexed by BLACK_MOVE / WHITE_MOVE, NULL while detached
+    uint64_t tokens[2];     // session of each seat
+    uint32_t player_ids[2]; // of the players that started the match
+    bool detached;          // a player is gone and may resume
+    long detached_ms;       // ended at this time unless resumed
+    struct Match *detached_prev, *detached_next;
+    uint32_t id;
+    struct Match *live_prev, *live_next;
+    Conn_t **spectators;
+    int spectator_num, spectator_cap;
+    Connect4_shared_buf_t *snapshot;    // of the position after snapshot_seq moves
+    int snapshot_seq;
+} Match_t;
+
+typedef struct Session {
+    uint64_t token;         // 0 for an empty slot
+    Match_t *match;
+} Session_t;
+
+typedef struct Fd_list {
+    int *fds;
+    int num, cap;
+} Fd_list_t;
+
+typedef struct Server {
+    int listen_fd;
+    int epoll_fd;
+    int col_num, row_num;   // of players that do not ask for another one
+    Conn_t **conns;         // indexed by fd
+    int conn_cap;
+    Conn_t *waiting_head, *waiting_tail;    // not yet paired, one per geometry
+    Conn_t *pending_head, *pending_tail;    // in order of pending_ms
+    Match_t *detached_head, *detached_tail; // in order of detached_ms
+    Match_t *live_head, *live_tail;         // every match, the newest last
+    Session_t *sessions;    // open addressing by token, at most half full
+    int session_cap, session_num;
+    long resume_grace_ms;   // 0 ends a match as soon as a player drops
+    int archive_fd;         // record file, -1 for none
+    uint32_t conn_serial;
+    Fd_list_t flush_list;   // connections with output queued in this round
+    Fd_list_t close_list;   // connections to close once flushed
+    unsigned long match_num, move_num, resume_num, watch_num;
+} Server_t;
+
+static volatile sig_atomic_t quit_flg = 0;
+
+static void
+on_signal (int signo)
+{
+    quit_flg = 1;
+}
+
+// --------------------------------------------------
+// <Connection management>
+
+/*
+ *  the detached list is appended to with now + a fixed delay, so it
+ *  stays sorted by deadline; the pending one follows each link's round
+ *  trip, and a new deadline is placed from the tail, where it mostly
+ *  belongs
+ */
+static void
+pending_push (Server_t *server, Conn_t *conn, long wait_ms)
+{
+    conn->pending = true;
+    conn->pending_ms = connect4_now_ms() + wait_ms;
+
+    Conn_t *prev = server->pending_tail;
+    while (prev != NULL && prev->pending_ms > conn->pending_ms)
+        prev = prev->pending_prev;
+
+    conn->pending_prev = prev;
+    conn->pending_next = (prev != NULL) ? prev->pending_next : server->pending_head;
+    if (prev != NULL)
+        prev->pending_next = conn;
+    else
+        server->pending_head = conn;
+    if (conn->pending_next != NULL)
+        conn->pending_next->pending_prev = conn;
+    else
+        server->pending_tail = conn;
+}
+
+static void
+pending_unlink (Server_t *server, Conn_t *conn)
+{
+    if (!conn->pending)
+        return;
+
+    if (conn->pending_prev != NULL)
+        conn->pending_prev->pending_next = conn->pending_next;
+    else
+        server->pending_head = conn->pending_next;
+    if (conn->pending_next != NULL)
+        conn->pending_next->pending_prev = conn->pending_prev;
+    else
+        server->pending_tail = conn->pending_prev;
+    conn->pending = false;
+}
+
+static void
+waiting_push (Server_t *server, Conn_t *conn)
+{
+    conn->waiting = true;
+    conn->waiting_prev = server->waiting_tail;
+    conn->waiting_next = NULL;
+    if (server->waiting_tail != NULL)
+        server->waiting_tail->waiting_next = conn;
+    else
+        server->waiting_head = conn;
+    server->waiting_tail = conn;
+}
+
+static void
+waiting_unlink (Server_t *server, Conn_t *conn)
+{
+    if (!conn->waiting)
+        return;
+
+    if (conn->waiting_prev != NULL)
+        conn->waiting_prev->waiting_next = conn->waiting_next;
+    else
+        server->waiting_head = conn->waiting_next;
+    if (conn->waiting_next != NULL)
+        conn->waiting_next->waiting_prev = conn->waiting_prev;
+    else
+        server->waiting_tail = conn->waiting_prev;
+    conn->waiting = false;
+}
+
+static void
+detached_push (Server_t *server, Match_t *match)
+{
+    match->detached = true;
+    match->detached_ms = connect4_now_ms() + server->resume_grace_ms;
+    match->detached_prev = server->detached_tail;
+    match->detached_next = NULL;
+    if (server->detached_tail != NULL)
+        server->detached_tail->detached_next = match;
+    else
+        server->detached_head = match;
+    server->detached_tail = match;
+}
+
+static void
+detached_unlink (Server_t *server, Match_t *match)
+{
+    if (!match->detached)
+        return;
+
+    if (match->detached_prev != NULL)
+        match->detached_prev->detached_next = match->detached_next;
+    else
+        server->detached_head = match->detached_next;
+    if (match->detached_next != NULL)
+        match->detached_next->detached_prev = match->detached_prev;
+    else
+        server->detached_tail = match->detached_prev;
+    match->detached = false;
+}
+
+static void
+live_push (Server_t *server, Match_t *match)
+{
+    match->live_prev = server->live_tail;
+    match->live_next = NULL;
+    if (server->live_tail != NULL)
+        server->live_tail->live_next = match;
+    else
+        server->live_head = match;
+    server->live_tail = match;
+}
+
+static void
+live_unlink (Server_t *server, Match_t *match)
+{
+    if (match->live_prev != NULL)
+        match->live_prev->live_next = match->live_next;
+    else
+        server->live_head = match->live_next;
+    if (match->live_next != NULL)
+        match->live_next->live_prev = match->live_prev;
+    else
+        server->live_tail = match->live_prev;
+}
+
+/*
+ *  stop sending a spectator the match; its queue is left as it is
+ */
+static void
+unwatch (Conn_t *conn)
+{
+    Match_t *match = conn->watching;
+    if (match == NULL)
+        return;
+
+    Conn_t *last = match->spectators[--match->spectator_num];
+    match->spectators[conn->spectator_index] = last;
+    last->spectator_index = conn->spectator_index;
+    conn->watching = NULL;
+}
+
+static void
+conn_close (Server_t *server, Conn_t *conn)
+{
+    waiting_unlink(server, conn);
+    pending_unlink(server, conn);
+    unwatch(conn);
+    if (conn->out_queue != NULL) {
+        connect4_out_queue_clear(conn->out_queue);
+        free(conn->out_queue);
+    }
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    server->conns[conn->fd] = NULL;
+    free(conn);
+}
+
+static int
+fd_list_push (Fd_list_t *list, int fd)
+{
+    if (list->num == list->cap) {
+        int new_cap = list->cap ? list->cap*2 : 64;
+        int *fds = realloc(list->fds, new_cap*sizeof(int));
+        if (fds == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        list->fds = fds;
+        list->cap = new_cap;
+    }
+    list->fds[list->num++] = fd;
+    return 0;
+}
+
+/*
+ *  write out as much of out_buf (then the shared queue of a spectator)
+ *  as the socket accepts and keep EPOLLOUT registered only while
+ *  something is left
+ *  return -1 when the connection is broken
+ */
+static int
+conn_flush (Server_t *server, Conn_t *conn)
+{
+    size_t sent = 0;
+    while (sent < conn->out_len) {
+        ssize_t len = send(conn->fd, conn->out_buf + sent,
+                            conn->out_len - sent, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        sent += len;
+    }
+
+    memmove(conn->out_buf, conn->out_buf + sent, conn->out_len - sent);
+    conn->out_len -= sent;
+
+    if (conn->out_queue != NULL && conn->out_len == 0
+            && connect4_out_queue_flush(conn->out_queue, conn->fd) < 0)
+        return -1;
+
+    bool want_out = conn->out_len != 0
+            || (conn->out_queue != NULL && !connect4_out_queue_empty(conn->out_queue));
+    if (want_out != conn->out_armed) {
+        struct epoll_event ev = {
+            .events  = EPOLLIN | EPOLLRDHUP | (want_out ? EPOLLOUT : 0),
+            .data.fd = conn->fd
+        };
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->out_armed = want_out;
+    }
+
+    return 0;
+}
+
+/*
+ *  queue a message; all messages queued while handling one batch of
+ *  events go out with a single send() per connection
+ */
+static int
+conn_send (Server_t *server, Conn_t *conn, const uint8_t *msg, size_t len)
+{
+    if (conn->out_len + len > sizeof(conn->out_buf))
+        return -1;
+
+    memcpy(conn->out_buf + conn->out_len, msg, len);
+    conn->out_len += len;
+
+    if (!conn->flush_queued && !conn->out_armed) {
+        if (fd_list_push(&server->flush_list, conn->fd) < 0)
+            return conn_flush(server, conn);
+        conn->flush_queued = true;
+    }
+    return 0;
+}
+
+static void
+conn_schedule_close (Server_t *server, Conn_t *conn)
+{
+    if (conn->closing)
+        return;
+
+    // when the list cannot grow, the peer closing its side cleans it up
+    if (fd_list_push(&server->close_list, conn->fd) == 0)
+        conn->closing = true;
+}
+
+/*
+ *  a detached player (NULL) gets what it missed when it resumes
+ */
+static void
+conn_send_msg (Server_t *server, Conn_t *conn, const Connect4_msg_t *msg)
+{
+    if (conn == NULL)
+        return;
+
+    uint8_t buf[CONNECT4_MSG_MAX];
+    int len = connect4_encode_msg(conn->proto_mode, msg, buf, sizeof(buf));
+
+    if (len < 0 || conn_send(server, conn, buf, len) < 0)
+        conn_schedule_close(server, conn);
+}
+
+static void
+conn_send_type (Server_t *server, Conn_t *conn, Connect4_msg_type_t type)
+{
+    conn_send_msg(server, conn, &(Connect4_msg_t){.type = type});
+}
+
+// </Connection management>
+// --------------------------------------------------
+// <Match management>
+
+/*
+ *  the tokens are random, so their low bits are the hash; a slot freed
+ *  pulls back the entries probed past it, and no tombstones are left
+ */
+static Session_t *
+session_find (Server_t *server, uint64_t token)
+{
+    if (server->session_cap == 0 || token == 0)
+        return NULL;
+
+    int mask = server->session_cap - 1;
+    for (int i = token & mask; server->sessions[i].token != 0; i = (i + 1) & mask)
+        if (server->sessions[i].token == token)
+            return &server->sessions[i];
+    return NULL;
+}
+
+static void
+session_insert (Session_t *sessions, int cap, uint64_t token, Match_t *match)
+{
+    int i = token & (cap - 1);
+    while (sessions[i].token != 0)
+        i = (i + 1) & (cap - 1);
+    sessions[i] = (Session_t){.token = token, .match = match};
+}
+
+static int
+session_add (Server_t *server, uint64_t token, Match_t *match)
+{
+    if (token == 0 || session_find(server, token) != NULL)
+        return -1;
+
+    if (2*(server->session_num + 1) > server->session_cap) {
+        int new_cap = server->session_cap ? server->session_cap*2 : 1024;
+        Session_t *sessions = calloc(new_cap, sizeof(Session_t));
+        if (sessions == NULL) {
+            perror("calloc");
+            return -1;
+        }
+        for (int i = 0; i < server->session_cap; i++)
+            if (server->sessions[i].token != 0)
+                session_insert(sessions, new_cap, server->sessions[i].token,
+                                server->sessions[i].match);
+        free(server->sessions);
+        server->sessions = sessions;
+        server->session_cap = new_cap;
+    }
+
+    session_insert(server->sessions, server->session_cap, token, match);
+    server->session_num++;
+    return 0;
+}
+
+static void
+session_remove (Server_t *server, uint64_t token)
+{
+    Session_t *session = session_find(server, token);
+    if (session == NULL)
+        return;
+
+    int mask = server->session_cap - 1;
+    int hole = session - server->sessions;
+    for (int i = (hole + 1) & mask; server->sessions[i].token != 0; i = (i + 1) & mask) {
+        // an entry may move back to the hole unless its home lies between
+        int home = server->sessions[i].token & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            server->sessions[hole] = server->sessions[i];
+            hole = i;
+        }
+    }
+    server->sessions[hole].token = 0;
+    server->session_num--;
+}
+
+static Conn_t *
+opponent_of (Conn_t *conn)
+{
+    return conn->match->players[conn->color == BLACK_MOVE ? WHITE_MOVE : BLACK_MOVE];
+}
+
+static void
+send_session (Server_t *server, Conn_t *conn)
+{
+    // no token could be drawn, the match cannot be resumed
+    if (conn->match->tokens[conn->color] == 0)
+        return;
+
+    conn_send_msg(server, conn, &(Connect4_msg_t){
+        .type = CONNECT4_MSG_SESSION,
+        .token = conn->match->tokens[conn->color]
+    });
+}
+
+static void
+start_match (Server_t *server, Conn_t *black, Conn_t *white)
+{
+    Match_t *match = malloc(sizeof(Match_t));
+    if (match == NULL) {
+        perror("malloc");
+        conn_schedule_close(server, black);
+        conn_schedule_close(server, white);
+        return;
+    }
+
+    connect4_new_game(&match->game, black->col_num, black->row_num, black->win_len);
+    match->players[BLACK_MOVE] = black;
+    match->players[WHITE_MOVE] = white;
+    match->player_ids[BLACK_MOVE] = black->id;
+    match->player_ids[WHITE_MOVE] = white->id;
+    match->detached = false;
+    match->spectators = NULL;
+    match->spectator_num = match->spectator_cap = 0;
+    match->snapshot = NULL;
+
+    // a token is all a player needs to take its seat back; 0 is never
+    // one, a match without tokens is played to the end or dropped
+    if (getrandom(match->tokens, sizeof(match->tokens), 0) != sizeof(match->tokens)) {
+        perror("getrandom");
+        match->tokens[0] = match->tokens[1] = 0;
+    }
+    if (session_add(server, match->tokens[0], match) < 0) {
+        match->tokens[0] = match->tokens[1] = 0;
+    } else if (session_add(server, match->tokens[1], match) < 0) {
+        session_remove(server, match->tokens[0]);
+        match->tokens[0] = match->tokens[1] = 0;
+    }
+
+    black->match = white->match = match;
+    black->color = BLACK_MOVE;
+    white->color = WHITE_MOVE;
+    server->match_num++;
+    match->id = server->match_num;
+    live_push(server, match);
+
+    conn_send_type(server, black, CONNECT4_MSG_YOUBLACK);
+    conn_send_type(server, white, CONNECT4_MSG_YOUWHITE);
+
+    // text players cannot resume
+    for (int i = 0; i < 2; i++)
+        if (match->players[i]->proto_mode == CONNECT4_PROTO_BINARY)
+            send_session(server, match->players[i]);
+}
+
+/*
+ *  a player that is done with the handshake is paired with the player
+ *  waiting for the same geometry, or waits itself
+ */
+static void
+player_ready (Server_t *server, Conn_t *conn)
+{
+    pending_unlink(server, conn);
+
+    Conn_t *black;
+    for (black = server->waiting_head; black != NULL; black = black->waiting_next)
+        if (black->col_num == conn->col_num && black->row_num == conn->row_num
+                && black->win_len == conn->win_len)
+            break;
+
+    if (black == NULL)
+        waiting_push(server, conn);
+    else {
+        waiting_unlink(server, black);
+        start_match(server, black, conn);
+    }
+}
+
+/*
+ *  append the match to the archive; finished or not, it is over here
+ */
+static void
+archive_match (Server_t *server, Match_t *match)
+{
+    uint8_t buf[CONNECT4_RECORD_MAX];
+
+    if (server->archive_fd < 0 || connect4_get_move_num(&match->game) == 0)
+        return;
+
+    int len = connect4_record_encode(&match->game, match->player_ids[BLACK_MOVE],
+                                    match->player_ids[WHITE_MOVE], buf, sizeof(buf));
+    // O_APPEND: a record is never split by another writer
+    if (len > 0 && write(server->archive_fd, buf, len) != len)
+        perror("write");
+}
+
+/*
+ *  detach both players and the spectators from the match and let them
+ *  close once their pending output is flushed
+ */
+static void
+end_match (Server_t *server, Match_t *match)
+{
+    archive_match(server, match);
+    detached_unlink(server, match);
+    live_unlink(server, match);
+    for (int i = 0; i < 2; i++)
+        session_remove(server, match->tokens[i]);
+    for (int i = 0; i < 2; i++) {
+        if (match->players[i] == NULL)
+            continue;
+        match->players[i]->match = NULL;
+        conn_schedule_close(server, match->players[i]);
+    }
+
+    for (int i = 0; i < match->spectator_num; i++) {
+        match->spectators[i]->watching = NULL;
+        conn_schedule_close(server, match->spectators[i]);
+    }
+    free(match->spectators);
+    if (match->snapshot != NULL)
+        connect4_shared_buf_unref(match->snapshot);
+    free(match);
+}
+
+/*
+ *  queue a shared buffer for a spectator; one that cannot keep up is
+ *  dropped with everything it has queued
+ */
+static void
+spectator_push (Server_t *server, Conn_t *conn, Connect4_shared_buf_t *buf)
+{
+    if (connect4_out_queue_push(conn->out_queue, buf) < 0) {
+        connect4_out_queue_clear(conn->out_queue);
+        unwatch(conn);
+        conn_schedule_close(server, conn);
+        return;
+    }
+
+    if (!conn->flush_queued && !conn->out_armed
+            && fd_list_push(&server->flush_list, conn->fd) == 0)
+        conn->flush_queued = true;
+}
+
+static Connect4_shared_buf_t *
+encode_shared (const Connect4_msg_t *msg)
+{
+    uint8_t buf[CONNECT4_MSG_MAX];
+    int len = connect4_encode_msg(CONNECT4_PROTO_BINARY, msg, buf, sizeof(buf));
+    if (len < 0)
+        return NULL;
+    return connect4_shared_buf_new(buf, len);
+}
+
+/*
+ *  DELTA of move seq of a match, shared by the spectators it goes to
+ */
+static Connect4_shared_buf_t *
+encode_delta (Match_t *match, int seq)
+{
+    return encode_shared(&(Connect4_msg_t){
+        .type = CONNECT4_MSG_DELTA,
+        .seq = seq,
+        .bit = match->game.history[seq]
+    });
+}
+
+/*
+ *  Function name:
+ *      fan_out_move
+ *
+ *  Description:
+ *      encode the last move of a match once and queue it for every
+ *      spectator
+ *
+ *  Input:
+ *      server  :   server
+ *      match   :   match that just got a move
+ */
+static void
+fan_out_move (Server_t *server, Match_t *match)
+{
+    if (match->spectator_num == 0)
+        return;
+
+    Connect4_shared_buf_t *delta = encode_delta(match, connect4_get_move_num(&match->game) - 1);
+    if (delta == NULL)
+        return;
+
+    // from the end, a dropped spectator is replaced by one already done
+    for (int i = match->spectator_num - 1; i >= 0; i--)
+        spectator_push(server, match->spectators[i], delta);
+    connect4_shared_buf_unref(delta);
+}
+
+/*
+ *  Function name:
+ *      watch_match
+ *
+ *  Description:
+ *      make a connection a spectator of a match and queue the snapshot
+ *      of the current position, shared with whoever joins at the same
+ *      position
+ *
+ *  Input:
+ *      server  :   server
+ *      conn    :   new connection, not paired
+ *      msg     :   WATCH with the match id, 0 for the newest match
+ */
+static void
+watch_match (Server_t *server, Conn_t *conn, const Connect4_msg_t *msg)
+{
+    Match_t *match = server->live_tail;
+    if (msg->match_id != 0)
+        for (match = server->live_head; match != NULL; match = match->live_next)
+            if (match->id == msg->match_id)
+                break;
+
+    waiting_unlink(server, conn);
+    pending_unlink(server, conn);
+    conn->proto_mode = CONNECT4_PROTO_BINARY;
+
+    if (match == NULL || conn->out_queue != NULL) {
+        conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+        conn_schedule_close(server, conn);
+        return;
+    }
+
+    if (match->spectator_num == match->spectator_cap) {
+        int new_cap = match->spectator_cap ? match->spectator_cap*2 : 16;
+        Conn_t **spectators = realloc(match->spectators, new_cap*sizeof(Conn_t*));
+        if (spectators == NULL) {
+            perror("realloc");
+            conn_schedule_close(server, conn);
+            return;
+        }
+        match->spectators = spectators;
+        match->spectator_cap = new_cap;
+    }
+
+    conn->out_queue = malloc(sizeof(Connect4_out_queue_t));
+    if (conn->out_queue == NULL) {
+        perror("malloc");
+        conn_schedule_close(server, conn);
+        return;
+    }
+    connect4_out_queue_init(conn->out_queue);
+
+    // the bitboards of a wide board do not fit SNAPSHOT: it is taken of
+    // the empty board and the moves so far follow as DELTA
+    int move_num = connect4_get_move_num(&match->game);
+    int snapshot_seq = match->game.wide ? 0 : move_num;
+    if (match->snapshot != NULL && match->snapshot_seq != snapshot_seq) {
+        connect4_shared_buf_unref(match->snapshot);
+        match->snapshot = NULL;
+    }
+    if (match->snapshot == NULL) {
+        match->snapshot = encode_shared(&(Connect4_msg_t){
+            .type = CONNECT4_MSG_SNAPSHOT,
+            .match_id = match->id,
+            .col_num = match->game.col_num,
+            .row_num = match->game.row_num,
+            .seq = snapshot_seq,
+            .black = match->game.wide ? 0 : (uint64_t)match->game.black,
+            .white = match->game.wide ? 0 : (uint64_t)match->game.white,
+            .win_len = match->game.win_len
+        });
+        match->snapshot_seq = snapshot_seq;
+    }
+    if (match->snapshot == NULL) {
+        conn_schedule_close(server, conn);
+        return;
+    }
+
+    conn->watching = match;
+    conn->spectator_index = match->spectator_num;
+    match->spectators[match->spectator_num++] = conn;
+    server->watch_num++;
+    spectator_push(server, conn, match->snapshot);
+
+    // a dropped spectator is no longer watching
+    for (int seq = snapshot_seq; seq < move_num && conn->watching == match; seq++) {
+        Connect4_shared_buf_t *delta = encode_delta(match, seq);
+        if (delta == NULL) {
+            unwatch(conn);
+            conn_schedule_close(server, conn);
+            break;
+        }
+        spectator_push(server, conn, delta);
+        connect4_shared_buf_unref(delta);
+    }
+}
+
+static void
+fan_out_result (Server_t *server, Match_t *match)
+{
+    if (match->spectator_num == 0)
+        return;
+
+    Connect4_shared_buf_t *result = encode_shared(&(Connect4_msg_t){
+        .type = CONNECT4_MSG_RESULT,
+        .result = connect4_get_game_result(&match->game)
+    });
+    if (result == NULL)
+        return;
+
+    for (int i = match->spectator_num - 1; i >= 0; i--)
+        spectator_push(server, match->spectators[i], result);
+    connect4_shared_buf_unref(result);
+}
+
+/*
+ *  an older player learns a win from YOU-WIN, a draw from ERROR and a
+ *  loss from the winning move itself
+ */
+static void
+send_result (Server_t *server, Conn_t *conn, Game_result_t result)
+{
+    if (conn->authoritative)
+        conn_send_msg(server, conn, &(Connect4_msg_t){
+            .type = CONNECT4_MSG_RESULT,
+            .result = result
+        });
+    else if (result == GAME_DRAW)
+        conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+    else if (result == connect4_get_my_win_result_value(conn->color))
+        conn_send_type(server, conn, CONNECT4_MSG_YOUWIN);
+}
+
+/*
+ *  Function name:
+ *      finish_match
+ *
+ *  Description:
+ *      tell the players and the spectators how the game came out and
+ *      end the match; with a player detached, the match waits for it
+ *      to resume and hear the result until the grace period is over
+ *
+ *  Input:
+ *      server  :   server
+ *      match   :   match whose game just ended
+ */
+static void
+finish_match (Server_t *server, Match_t *match)
+{
+    Game_result_t result = connect4_get_game_result(&match->game);
+
+    fan_out_result(server, match);
+    for (int i = 0; i < 2; i++)
+        if (match->players[i] != NULL)
+            send_result(server, match->players[i], result);
+
+    if (!match->detached) {
+        end_match(server, match);
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (match->players[i] == NULL)
+            continue;
+        match->players[i]->match = NULL;
+        conn_schedule_close(server, match->players[i]);
+        match->players[i] = NULL;
+    }
+}
+
+static void
+handle_msg (Server_t *server, Conn_t *conn, Connect4_msg_t *msg)
+{
+    Match_t *match = conn->match;
+    Conn_t *opponent = opponent_of(conn);
+    int row = -1;
+
+    switch (msg->type)
+    {
+    case CONNECT4_MSG_PLACE:
+    case CONNECT4_MSG_DROP:
+        if (connect4_get_game_state(&match->game) == conn->color) {
+            if (msg->type == CONNECT4_MSG_DROP)
+                row = connect4_drop(&match->game, msg->col);
+            else if (connect4_make_move(&match->game, msg->row, msg->col) == 0)
+                row = msg->row;
+        }
+        if (row < 0) {
+            conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+            conn_send_type(server, opponent, CONNECT4_MSG_ERROR);
+            end_match(server, match);
+            return;
+        }
+        server->move_num++;
+        fan_out_move(server, match);
+
+        // binary players get the column only, text players the cell
+        conn_send_msg(server, opponent, &(Connect4_msg_t){
+            .type = (opponent == NULL || opponent->proto_mode == CONNECT4_PROTO_BINARY)
+                    ? CONNECT4_MSG_DROP : CONNECT4_MSG_PLACE,
+            .row = row,
+            .col = msg->col
+        });
+        // the mover applies its move once it is accepted
+        if (conn->authoritative)
+            conn_send_msg(server, conn, &(Connect4_msg_t){
+                .type = CONNECT4_MSG_DROP,
+                .col = msg->col
+            });
+
+        if (connect4_get_game_state(&match->game) == GAME_OVER)
+            finish_match(server, match);
+        break;
+
+    case CONNECT4_MSG_YOUWIN:
+        // the match ends with the game, so a concession is always early
+        conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+        conn_send_type(server, opponent, CONNECT4_MSG_ERROR);
+        end_match(server, match);
+        break;
+
+    case CONNECT4_MSG_ERROR:
+    default:
+        conn_send_type(server, opponent, CONNECT4_MSG_ERROR);
+        end_match(server, match);
+        break;
+    }
+}
+
+/*
+ *  Function name:
+ *      resume_match
+ *
+ *  Description:
+ *      put a player back into its match, tell it how many moves the
+ *      server has and send the ones it missed; a seat the server still
+ *      sees held is the player's old link, half-open, which is closed
+ *      and replaced
+ *
+ *  Input:
+ *      server  :   server
+ *      conn    :   new connection of the player, not paired
+ *      msg     :   RESUME with the session token and the player's seq
+ */
+static void
+resume_match (Server_t *server, Conn_t *conn, const Connect4_msg_t *msg)
+{
+    Session_t *session = session_find(server, msg->token);
+    Match_t *match = (session != NULL) ? session->match : NULL;
+    int color = BLACK_MOVE;
+
+    // both seats are empty once the game ended without the player; only
+    // binary players got a token, a text one holding the seat is not it
+    if (match != NULL) {
+        color = (match->tokens[BLACK_MOVE] == msg->token) ? BLACK_MOVE : WHITE_MOVE;
+        Conn_t *held = match->players[color];
+        if (held != NULL && held->proto_mode != CONNECT4_PROTO_BINARY)
+            match = NULL;
+    }
+
+    waiting_unlink(server, conn);
+    pending_unlink(server, conn);
+
+    // expired or never issued; a player is at most its own lost move
+    // ahead of the server, and only if the server does not echo moves
+    int move_num = (match != NULL) ? connect4_get_move_num(&match->game) : 0;
+    if (match == NULL || msg->seq < 0
+            || msg->seq > move_num + !conn->authoritative) {
+        conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+        conn_schedule_close(server, conn);
+        return;
+    }
+
+    Conn_t *stale = match->players[color];
+    if (stale != NULL) {
+        // the match is not the old link's to drop any more
+        stale->match = NULL;
+        conn_close(server, stale);
+    } else
+        detached_unlink(server, match);
+    match->players[color] = conn;
+    conn->match = match;
+    conn->color = color;
+    conn->proto_mode = CONNECT4_PROTO_BINARY;
+    server->resume_num++;
+
+    conn_send_msg(server, conn, &(Connect4_msg_t){
+        .type = CONNECT4_MSG_RESUMED,
+        .seq = move_num
+    });
+    for (int i = msg->seq; i < move_num; i++)
+        conn_send_msg(server, conn, &(Connect4_msg_t){
+            .type = CONNECT4_MSG_DROP,
+            .col = connect4_get_move_col(&match->game, i)
+        });
+
+    // the game ended while the player was away
+    if (connect4_get_game_state(&match->game) == GAME_OVER) {
+        send_result(server, conn, connect4_get_game_result(&match->game));
+        end_match(server, match);
+    }
+}
+
+// </Match management>
+// --------------------------------------------------
+// <Event handlers>
+
+/*
+ *  how long to wait for the first write of a new client: it follows the
+ *  handshake's last ACK, so a few round trips of the link are plenty
+ */
+static long
+handshake_ms (int fd)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return HANDSHAKE_MS;
+
+    long wait_ms = HANDSHAKE_MIN_MS + 2*info.tcpi_rtt/1000;
+    return (wait_ms < HANDSHAKE_MS) ? wait_ms : HANDSHAKE_MS;
+}
+
+static void
+handle_accept (Server_t *server)
+{
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept4");
+            return;
+        }
+
+        if (fd >= server->conn_cap) {
+            int new_cap = server->conn_cap;
+            while (new_cap <= fd)
+                new_cap *= 2;
+            Conn_t **conns = realloc(server->conns, new_cap*sizeof(Conn_t*));
+            if (conns == NULL) {
+                perror("realloc");
+                close(fd);
+                continue;
+            }
+            memset(conns + server->conn_cap, 0,
+                    (new_cap - server->conn_cap)*sizeof(Conn_t*));
+            server->conns = conns;
+            server->conn_cap = new_cap;
+        }
+
+        Conn_t *conn = calloc(1, sizeof(Conn_t));
+        if (conn == NULL) {
+            perror("calloc");
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->id = ++server->conn_serial;
+        conn->color = GAME_OVER;
+        conn->proto_mode = CONNECT4_PROTO_TEXT;
+        conn->col_num = server->col_num;
+        conn->row_num = server->row_num;
+        conn->win_len = CONNECT4_DEFAULT_WIN_LEN;
+        connect4_decoder_init(&conn->decoder);
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev = {
+            .events  = EPOLLIN | EPOLLRDHUP,
+            .data.fd = fd
+        };
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        server->conns[fd] = conn;
+        pending_push(server, conn, handshake_ms(fd));
+    }
+}
+
+/*
+ *  Function name:
+ *      handle_hello
+ *
+ *  Description:
+ *      switch the player to binary frames and settle its geometry;
+ *      the answer carries the geometry it plays
+ *
+ *  Input:
+ *      server  :   server
+ *      conn    :   player
+ *      msg     :   HELLO, with or without a geometry
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the geometry is not supported
+ *                  (the player is told and closed)
+ */
+static int
+handle_hello (Server_t *server, Conn_t *conn, const Connect4_msg_t *msg)
+{
+    // paired before its HELLO came in, the player was told its color in
+    // text and may have moved as an older player; it stays one
+    conn->proto_mode = CONNECT4_PROTO_BINARY;
+    conn->authoritative = conn->match == NULL
+                            && msg->version >= CONNECT4_PROTO_AUTHORITATIVE;
+
+    // a match already has its board; the answer tells the player
+    if (msg->col_num != 0 && conn->match == NULL) {
+        if (!connect4_valid_geometry(msg->col_num, msg->row_num, msg->win_len)) {
+            conn_send_type(server, conn, CONNECT4_MSG_ERROR);
+            pending_unlink(server, conn);
+            waiting_unlink(server, conn);
+            conn_schedule_close(server, conn);
+            return -1;
+        }
+        conn->col_num = msg->col_num;
+        conn->row_num = msg->row_num;
+        conn->win_len = msg->win_len;
+    }
+
+    Connect4_t *game = (conn->match != NULL) ? &conn->match->game : NULL;
+    conn_send_msg(server, conn, &(Connect4_msg_t){
+        .type = CONNECT4_MSG_HELLO,
+        .version = conn->authoritative ? CONNECT4_PROTO_VERSION : CONNECT4_PROTO_AUTHORITATIVE - 1,
+        .col_num = game ? game->col_num : conn->col_num,
+        .row_num = game ? game->row_num : conn->row_num,
+        .win_len = game ? game->win_len : conn->win_len
+    });
+    return 0;
+}
+
+/*
+ *  a closing connection still reads what comes in, or close() would
+ *  reset the link under the output it has yet to flush; once the peer
+ *  is done sending, only that output is waited for. return -1 when
+ *  nothing is left to send
+ */
+static int
+discard_input (Server_t *server, Conn_t *conn)
+{
+    uint8_t buf[OUT_BUF_MAX];
+    for (;;) {
+        ssize_t len = read(conn->fd, buf, sizeof(buf));
+        if (len > 0 || (len < 0 && errno == EINTR))
+            continue;
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (len < 0)
+            return -1;
+        break;
+    }
+
+    if (conn->out_len == 0
+            && (conn->out_queue == NULL || connect4_out_queue_empty(conn->out_queue)))
+        return -1;
+
+    struct epoll_event ev = {
+        .events  = EPOLLOUT,
+        .data.fd = conn->fd
+    };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->out_armed = true;
+    return 0;
+}
+
+/*
+ *  return -1 when the peer is gone or violated the protocol
+ */
+static int
+handle_readable (Server_t *server, Conn_t *conn)
+{
+    // the match is over for it; ERROR or RESULT may still be queued
+    if (conn->closing)
+        return discard_input(server, conn);
+
+    for (;;) {
+        size_t avail;
+        uint8_t *space = connect4_decoder_space(&conn->decoder, &avail);
+        ssize_t len = read(conn->fd, space, avail);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        if (len == 0)
+            return -1;
+        connect4_decoder_commit(&conn->decoder, len);
+
+        int ret = 0;
+        Connect4_msg_t msg;
+        while (!conn->closing && (ret = connect4_decoder_next(&conn->decoder, &msg)) > 0) {
+            if (msg.type == CONNECT4_MSG_HELLO) {
+                if (handle_hello(server, conn, &msg) < 0)
+                    return 0;
+                // paired before its HELLO came in
+                if (conn->match != NULL
+                        && connect4_get_game_state(&conn->match->game) != GAME_OVER)
+                    send_session(server, conn);
+                continue;
+            }
+            if (msg.type == CONNECT4_MSG_RESUME && conn->match == NULL) {
+                resume_match(server, conn, &msg);
+                continue;
+            }
+            if (msg.type == CONNECT4_MSG_WATCH && conn->match == NULL) {
+                watch_match(server, conn, &msg);
+                continue;
+            }
+            // a player that speaks first is not resuming
+            if (conn->pending)
+                player_ready(server, conn);
+            // nothing but HELLO is expected before pairing or after the match
+            if (conn->match == NULL)
+                return -1;
+            handle_msg(server, conn, &msg);
+        }
+        // what follows the end of its match is not looked at
+        if (conn->closing)
+            return discard_input(server, conn);
+        if (ret < 0)
+            return -1;
+    }
+
+    // whole messages and no RESUME among them: a new player
+    if (conn->pending && conn->decoder.pos == conn->decoder.len)
+        player_ready(server, conn);
+    return 0;
+}
+
+/*
+ *  the match goes on without a binary player that may come back;
+ *  otherwise the opponent is told and the match ends
+ */
+static void
+drop_conn (Server_t *server, Conn_t *conn)
+{
+    Match_t *match = conn->match;
+    if (match != NULL) {
+        Conn_t *opponent = opponent_of(conn);
+        match->players[conn->color] = NULL;
+        conn->match = NULL;
+
+        if (server->resume_grace_ms > 0 && opponent != NULL
+                && conn->proto_mode == CONNECT4_PROTO_BINARY
+                && match->tokens[conn->color] != 0
+                && connect4_get_game_state(&match->game) != GAME_OVER)
+            detached_push(server, match);
+        else {
+            conn_send_type(server, opponent, CONNECT4_MSG_ERROR);
+            end_match(server, match);
+        }
+    }
+    conn_close(server, conn);
+}
+
+/*
+ *  pair the players that stayed silent through the handshake and end
+ *  the matches nobody resumed; return ms to the next deadline, -1 for none
+ */
+static int
+expire_timers (Server_t *server)
+{
+    long now = connect4_now_ms();
+
+    while (server->pending_head != NULL && server->pending_head->pending_ms <= now)
+        player_ready(server, server->pending_head);
+
+    while (server->detached_head != NULL && server->detached_head->detached_ms <= now) {
+        Match_t *match = server->detached_head;
+        for (int i = 0; i < 2; i++)
+            conn_send_type(server, match->players[i], CONNECT4_MSG_ERROR);
+        end_match(server, match);
+    }
+
+    long deadline = -1;
+    if (server->pending_head != NULL)
+        deadline = server->pending_head->pending_ms;
+    if (server->detached_head != NULL
+            && (deadline < 0 || server->detached_head->detached_ms < deadline))
+        deadline = server->detached_head->detached_ms;
+    return (deadline < 0) ? -1 : deadline - now;
+}
+
+static void
+flush_conns (Server_t *server)
+{
+    for (int i = 0; i < server->flush_list.num; i++) {
+        Conn_t *conn = server->conns[server->flush_list.fds[i]];
+        if (conn == NULL || !conn->flush_queued)
+            continue;
+        conn->flush_queued = false;
+        if (conn_flush(server, conn) < 0)
+            drop_conn(server, conn);
+    }
+    server->flush_list.num = 0;
+}
+
+/*
+ *  close connections whose match ended and whose output is flushed
+ */
+static void
+close_conns (Server_t *server)
+{
+    int keep = 0;
+    for (int i = 0; i < server->close_list.num; i++) {
+        Conn_t *conn = server->conns[server->close_list.fds[i]];
+        if (conn == NULL || !conn->closing)
+            continue;
+        if (conn->out_len == 0
+                && (conn->out_queue == NULL || connect4_out_queue_empty(conn->out_queue)))
+            conn_close(server, conn);
+        else
+            server->close_list.fds[keep++] = conn->fd;
+    }
+    server->close_list.num = keep;
+}
+
+// </Event handlers>
+// --------------------------------------------------
+// <Server initializer>
+
+static int
+init_server (Server_t *server, int port_no, int col_num, int row_num, int resume_grace_s,
+                const char *archive_path)
+{
+    *server = (Server_t){
+        .col_num = col_num,
+        .row_num = row_num,
+        .conn_cap = 1024,
+        .resume_grace_ms = resume_grace_s*1000L,
+        .archive_fd = -1,
+    };
+
+    if (archive_path != NULL) {
+        server->archive_fd = open(archive_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                    0644);
+        if (server->archive_fd < 0) {
+            perror("open");
+            return -1;
+        }
+    }
+
+    server->conns = calloc(server->conn_cap, sizeof(Conn_t*));
+    if (server->conns == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    server->listen_fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (server->listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int one = 1, zero = 0;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(server->listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_port   = htons(port_no),
+        .sin6_addr   = in6addr_any
+    };
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(server->listen_fd);
+        return -1;
+    }
+    if (listen(server->listen_fd, SOMAXCONN) < 0) {
+        perror("listen");
+        close(server->listen_fd);
+        return -1;
+    }
+
+    server->epoll_fd = epoll_create1(0);
+    if (server->epoll_fd < 0) {
+        perror("epoll_create1");
+        close(server->listen_fd);
+        return -1;
+    }
+
+    struct epoll_event ev = {
+        .events  = EPOLLIN,
+        .data.fd = server->listen_fd
+    };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(server->epoll_fd);
+        close(server->listen_fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+finalize_server (Server_t *server)
+{
+    // nobody can come back now
+    server->resume_grace_ms = 0;
+    for (int fd = 0; fd < server->conn_cap; fd++)
+        if (server->conns[fd] != NULL)
+            drop_conn(server, server->conns[fd]);
+
+    free(server->conns);
+    free(server->sessions);
+    free(server->flush_list.fds);
+    free(server->close_list.fds);
+    close(server->epoll_fd);
+    close(server->listen_fd);
+    if (server->archive_fd >= 0)
+        close(server->archive_fd);
+}
+
+// </Server initializer>
+// --------------------------------------------------
+
+static void
+loop (Server_t *server)
+{
+    struct epoll_event events[EVENT_MAX];
+
+    while (!quit_flg) {
+        int n = epoll_wait(server->epoll_fd, events, EVENT_MAX, expire_timers(server));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server->listen_fd) {
+                handle_accept(server);
+                continue;
+            }
+
+            Conn_t *conn = server->conns[fd];
+            if (conn == NULL)
+                continue;
+
+            bool broken = false;
+            if (events[i].events & EPOLLOUT)
+                broken = conn_flush(server, conn) < 0;
+            if (!broken && events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                broken = handle_readable(server, conn) < 0;
+
+            if (broken)
+                drop_conn(server, conn);
+        }
+
+        expire_timers(server);
+        flush_conns(server);
+        close_conns(server);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    int port_no = DEFAULT_PORT_NO;
+    int resume_grace_s = DEFAULT_RESUME_GRACE_S;
+    const char *archive_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:g:a:")) != -1) {
+        switch (opt)
+        {
+        case 'p':
+            port_no = strtol(optarg, NULL, 10);
+            break;
+        case 'g':
+            // seconds a dropped player has to resume, 0 for none
+            resume_grace_s = strtol(optarg, NULL, 10);
+            break;
+        case 'a':
+            // record file every match is appended to
+            archive_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-g grace_s] [-a archive]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    Server_t server;
+    if (init_server(&server, port_no, CONNECT4_DEFAULT_COL_NUM, CONNECT4_DEFAULT_ROW_NUM,
+                    resume_grace_s, archive_path) < 0)
+        return 1;
+
+    printf("Listening on port %d\n", port_no);
+    loop(&server);
+
+    printf("%lu matches, %lu moves, %lu resumed, %lu spectators\n",
+            server.match_num, server.move_num, server.resume_num, server.watch_num);
+    finalize_server(&server);
+
+    return 0;
+}
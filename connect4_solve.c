@@ -0,0 +1,457 @@
+/*
+ *  Connect four solver
+ *
+ *  Negamax with alpha-beta pruning, center-first move ordering and
+ *  iterative deepening on the score window (null window searches).
+ *
+ *  With more than one thread the solver runs lazy SMP: every thread
+ *  solves the same root and all of them share one lock-free
+ *  transposition table, so each thread mostly finds the subtrees the
+ *  others already searched. Helper threads try the columns in a
+ *  slightly different order to spread out. The first thread to finish
+ *  gives the result and stops the others.
+ *
+ *
+ *  <<Search position>>
+ *
+ *  The search works on the engine's column-major bitboards with one
+ *  spare bit on top of every column (see connect4.c), so dropping a
+ *  disk is one addition and alignments never wrap from one column into
+ *  the next.
+ *
+ *  current :   disks of the side to move
+ *  mask    :   all disks
+ *
+ *  current + mask is unique for every position (the addition sets the
+ *  bit above the top disk of every column), so it is the key of the
+ *  transposition table.
+ */
+
+#include "connect4_solve.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define COL_MAX 16
+
+typedef struct Position {
+    uint64_t current;
+    uint64_t mask;
+    int moves;
+} Position_t;
+
+typedef struct Shared {
+    Connect4_tt_t *tt;
+    atomic_bool stop;               // a thread has the result
+    Connect4_solve_result_t result;
+} Shared_t;
+
+typedef struct Search {
+    Shared_t *shared;
+    uint64_t node_count;
+    Connect4_tt_stats_t tt_stats;
+    int col_num, row_num;
+    int cell_num;
+    uint64_t bottom_mask;           // bottom cell of every column
+    uint64_t column_mask[COL_MAX];
+    int col_order[COL_MAX];         // center columns first
+    uint8_t win_shifts[DIR_NUM][2]; // s and 2s of every direction, capped as the engine's
+} Search_t;
+
+static uint64_t
+bottom_mask_col (const Search_t *search, int col)
+{
+    return (uint64_t)1<<col*(search->row_num + 1);
+}
+
+static uint64_t
+top_mask_col (const Search_t *search, int col)
+{
+    return (uint64_t)1<<(search->row_num - 1 + col*(search->row_num + 1));
+}
+
+static bool
+can_play (const Search_t *search, const Position_t *pos, int col)
+{
+    return (pos->mask & top_mask_col(search, col)) == 0;
+}
+
+static void
+play (const Search_t *search, Position_t *pos, int col)
+{
+    pos->current ^= pos->mask;
+    pos->mask |= pos->mask + bottom_mask_col(search, col);
+    pos->moves++;
+}
+
+/*
+ *  return true when disks contain four in a row
+ */
+static bool
+alignment (const Search_t *search, uint64_t disks)
+{
+    for (int dir = 0; dir < DIR_NUM; dir++) {
+        uint64_t m = disks & disks>>search->win_shifts[dir][0];
+        if (m & m>>search->win_shifts[dir][1])
+            return true;
+    }
+    return false;
+}
+
+static uint64_t
+position_key (const Position_t *pos)
+{
+    return pos->current + pos->mask;
+}
+
+static bool
+is_winning_move (const Search_t *search, const Position_t *pos, int col)
+{
+    uint64_t disks = pos->current;
+    disks |= (pos->mask + bottom_mask_col(search, col)) & search->column_mask[col];
+    return alignment(search, disks);
+}
+
+/*
+ *  true once another thread has the result; the search unwinds then
+ */
+static bool
+stopped (const Search_t *search)
+{
+    return atomic_load_explicit(&search->shared->stop, memory_order_relaxed);
+}
+
+/*
+ *  Function name:
+ *      negamax
+ *
+ *  Description:
+ *      alpha-beta search of a position; results are kept in the
+ *      transposition table as exact scores or bounds
+ *
+ *  Output:
+ *      return  :   exact score when alpha < score < beta,
+ *                  an upper bound when score <= alpha,
+ *                  a lower bound when beta <= score
+ */
+static int
+negamax (Search_t *search, const Position_t *pos, int alpha, int beta)
+{
+    Connect4_tt_t *tt = search->shared->tt;
+
+    search->node_count++;
+    if (stopped(search))
+        return 0;
+
+    if (pos->moves == search->cell_num)
+        return 0;
+
+    for (int col = 0; col < search->col_num; col++)
+        if (can_play(search, pos, col) && is_winning_move(search, pos, col))
+            return (search->cell_num + 1 - pos->moves)/2;
+
+    // we can not win with the next disk, so at best with the one after
+    int max = (search->cell_num - 1 - pos->moves)/2;
+    if (beta > max) {
+        beta = max;
+        if (alpha >= beta)
+            return beta;
+    }
+
+    uint64_t key = position_key(pos);
+    int value;
+    Connect4_tt_bound_t bound;
+    if (connect4_tt_probe(tt, &search->tt_stats, key, &value, &bound)) {
+        if (bound == CONNECT4_TT_EXACT)
+            return value;
+        if (bound == CONNECT4_TT_LOWER && value > alpha) {
+            alpha = value;
+            if (alpha >= beta)
+                return alpha;
+        }
+        if (bound == CONNECT4_TT_UPPER && value < beta) {
+            beta = value;
+            if (alpha >= beta)
+                return beta;
+        }
+    }
+
+    int alpha_in = alpha;
+    int best = INT_MIN;
+    for (int i = 0; i < search->col_num; i++) {
+        int col = search->col_order[i];
+        if (!can_play(search, pos, col))
+            continue;
+
+        Position_t child = *pos;
+        play(search, &child, col);
+        int score = -negamax(search, &child, -beta, -alpha);
+
+        if (score > best)
+            best = score;
+        if (score > alpha)
+            alpha = score;
+        if (alpha >= beta)
+            break;
+    }
+
+    // the scores of an aborted search are garbage
+    if (stopped(search))
+        return 0;
+
+    if (best >= beta)
+        bound = CONNECT4_TT_LOWER;
+    else if (best <= alpha_in)
+        bound = CONNECT4_TT_UPPER;
+    else
+        bound = CONNECT4_TT_EXACT;
+    connect4_tt_store(tt, &search->tt_stats, key, best, bound, pos->moves);
+
+    return best;
+}
+
+/*
+ *  narrow the score window with null window searches; wins and losses
+ *  close to the current position are found first
+ */
+static int
+solve_position (Search_t *search, const Position_t *pos)
+{
+    int min = -(search->cell_num - pos->moves)/2;
+    int max = (search->cell_num + 1 - pos->moves)/2;
+
+    while (min < max && !stopped(search)) {
+        int med = min + (max - min)/2;
+        if (med <= 0 && min/2 < med)
+            med = min/2;
+        else if (med >= 0 && max/2 > med)
+            med = max/2;
+
+        int score = negamax(search, pos, med, med + 1);
+        if (score <= med)
+            max = score;
+        else
+            min = score;
+    }
+
+    return min;
+}
+
+static int
+init_search (Search_t *search, Shared_t *shared,
+                Connect4_t *game, Position_t *pos)
+{
+    // the search detects four in a row only, on one word
+    if (game->col_num > COL_MAX || game->wide || game->win_len != CONNECT4_WIN_LEN)
+        return -1;
+
+    search->shared = shared;
+    search->node_count = 0;
+    search->tt_stats = (Connect4_tt_stats_t){0};
+    search->col_num = game->col_num;
+    search->row_num = game->row_num;
+    search->cell_num = game->col_num*game->row_num;
+
+    uint64_t column = ((uint64_t)1<<game->row_num) - 1;
+    search->bottom_mask = game->bottom_mask;
+    for (int col = 0; col < game->col_num; col++) {
+        search->column_mask[col] = column<<col*(game->row_num + 1);
+        search->col_order[col] = game->col_num/2 + (1 - 2*(col%2))*(col + 1)/2;
+    }
+
+    // s or 2s may not fit the word on a board one or two columns wide
+    for (int dir = 0; dir < DIR_NUM; dir++) {
+        search->win_shifts[dir][0] = game->win_shifts[dir][0];
+        search->win_shifts[dir][1] = game->win_shifts[dir][1];
+    }
+
+    // the engine uses the same layout, so its bitboards are taken as they are
+    uint64_t black = game->black, white = game->white;
+    pos->mask = black | white;
+    pos->current = (connect4_get_game_state(game) == BLACK_MOVE) ? black : white;
+    pos->moves = __builtin_popcountll(pos->mask);
+
+    return 0;
+}
+
+/*
+ *  Function name:
+ *      connect4_solver_init
+ *
+ *  Description:
+ *      set up a solver with a transposition table of about tt_bytes
+ *      (rounded down to a power of two)
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the table can not be allocated
+ */
+int
+connect4_solver_init (Connect4_solver_t *solver, size_t tt_bytes)
+{
+    solver->node_count = 0;
+    solver->tt_stats = (Connect4_tt_stats_t){0};
+    solver->thread_num = 1;
+    solver->book = NULL;
+    solver->col_num = solver->row_num = 0;
+    return connect4_tt_init(&solver->tt, tt_bytes);
+}
+
+void
+connect4_solver_finalize (Connect4_solver_t *solver)
+{
+    connect4_tt_finalize(&solver->tt);
+}
+
+void
+connect4_solver_set_thread_num (Connect4_solver_t *solver, int thread_num)
+{
+    if (thread_num < 1)
+        thread_num = 1;
+    if (thread_num > CONNECT4_SOLVER_THREAD_MAX)
+        thread_num = CONNECT4_SOLVER_THREAD_MAX;
+    solver->thread_num = thread_num;
+}
+
+/*
+ *  the book is not owned by the solver and must stay open while it is set
+ */
+void
+connect4_solver_set_book (Connect4_solver_t *solver, const Connect4_book_t *book)
+{
+    solver->book = book;
+}
+
+/*
+ *  solve the root and pick the best column; the result is dropped
+ *  when another thread finished first
+ */
+static void
+solve_root (Search_t *search, const Position_t *pos)
+{
+    Connect4_solve_result_t result = {.col = -1};
+
+    for (int i = 0; i < search->col_num; i++) {
+        int col = search->col_order[i];
+        if (can_play(search, pos, col) && is_winning_move(search, pos, col)) {
+            result.col = col;
+            result.score = (search->cell_num + 1 - pos->moves)/2;
+            break;
+        }
+    }
+
+    if (result.col < 0) {
+        result.score = solve_position(search, pos);
+
+        // the first column (center first) whose reply can not do better than -score
+        for (int i = 0; i < search->col_num && !stopped(search); i++) {
+            int col = search->col_order[i];
+            if (!can_play(search, pos, col))
+                continue;
+
+            Position_t child = *pos;
+            play(search, &child, col);
+            if (negamax(search, &child, -result.score, -result.score + 1) <= -result.score) {
+                result.col = col;
+                break;
+            }
+        }
+    }
+
+    if (!atomic_exchange(&search->shared->stop, true))
+        search->shared->result = result;
+}
+
+typedef struct Worker {
+    Search_t search;
+    Position_t pos;
+    pthread_t thread;
+} Worker_t;
+
+static void *
+worker_main (void *arg)
+{
+    Worker_t *worker = arg;
+    solve_root(&worker->search, &worker->pos);
+    return NULL;
+}
+
+/*
+ *  Function name:
+ *      connect4_solve
+ *
+ *  Description:
+ *      solve the position to the end of the game and pick a move that
+ *      keeps its score; positions in the opening book are looked up
+ *      instead
+ *
+ *  Input:
+ *      solver  :   solver (table, thread number, statistics)
+ *      game    :   position to solve
+ *      result  :   best column and score (output)
+ *
+ *  Output:
+ *      return  :   0 on success, -1 when the game is over, the board
+ *                  does not fit the search bitboards or the game is not
+ *                  four in a row
+ */
+int
+connect4_solve (Connect4_solver_t *solver, Connect4_t *game,
+                Connect4_solve_result_t *result)
+{
+    Shared_t shared = {.tt = &solver->tt};
+    Worker_t workers[CONNECT4_SOLVER_THREAD_MAX];
+
+    if (connect4_get_game_state(game) == GAME_OVER)
+        return -1;
+    if (solver->book != NULL
+            && connect4_book_lookup(solver->book, game, &result->col, &result->score))
+        return 0;
+    if (init_search(&workers[0].search, &shared, game, &workers[0].pos) < 0)
+        return -1;
+    atomic_init(&shared.stop, false);
+
+    // keys are only unique within one geometry
+    if (solver->col_num != game->col_num || solver->row_num != game->row_num) {
+        if (solver->col_num != 0)
+            connect4_tt_clear(&solver->tt);
+        solver->col_num = game->col_num;
+        solver->row_num = game->row_num;
+    }
+    connect4_tt_new_search(&solver->tt);
+
+    int started = 1;
+    for (int i = 1; i < solver->thread_num; i++) {
+        Worker_t *worker = &workers[started];
+        worker->search = workers[0].search;
+        worker->pos = workers[0].pos;
+
+        // bring another column to the front for every helper
+        int *order = worker->search.col_order;
+        int swap = i % worker->search.col_num;
+        int tmp = order[0];
+        order[0] = order[swap];
+        order[swap] = tmp;
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) == 0)
+            started++;
+    }
+
+    solve_root(&workers[0].search, &workers[0].pos);
+
+    for (int i = 0; i < started; i++) {
+        if (i != 0)
+            pthread_join(workers[i].thread, NULL);
+
+        Search_t *search = &workers[i].search;
+        solver->node_count += search->node_count;
+        solver->tt_stats.probes += search->tt_stats.probes;
+        solver->tt_stats.hits += search->tt_stats.hits;
+        solver->tt_stats.misses += search->tt_stats.misses;
+        solver->tt_stats.stores += search->tt_stats.stores;
+        solver->tt_stats.replacements += search->tt_stats.replacements;
+    }
+
+    *result = shared.result;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "connect4.h"
+#include "connect4_tt.h"
+#include "connect4_book.h"
+
+/*
+ *  <<Score>>
+ *
+ *  score is seen from the side to move
+ *      0   :   draw with perfect play
+ *      > 0 :   win;  (cells + 1 - moves)/2 when winning with the very
+ *              next disk, one less for every later own disk
+ *      < 0 :   loss, same scale
+ *  where cells = col_num*row_num and moves = disks already on the board
+ */
+
+typedef struct Connect4_solve_result {
+    int col;            // best column
+    int score;
+} Connect4_solve_result_t;
+
+#define CONNECT4_SOLVER_TT_DEFAULT ((size_t)64<<20)
+#define CONNECT4_SOLVER_THREAD_MAX 64
+
+typedef struct Connect4_solver {
+    uint64_t node_count;    // positions visited since init
+    Connect4_tt_t tt;
+    Connect4_tt_stats_t tt_stats;
+    int thread_num;         // lazy SMP search threads, 1 by default
+    const Connect4_book_t *book;    // looked up before searching, may be NULL
+    int col_num, row_num;   // geometry of the positions in tt
+} Connect4_solver_t;
+
+int connect4_solver_init (Connect4_solver_t *solver, size_t tt_bytes);
+void connect4_solver_finalize (Connect4_solver_t *solver);
+void connect4_solver_set_thread_num (Connect4_solver_t *solver, int thread_num);
+void connect4_solver_set_book (Connect4_solver_t *solver, const Connect4_book_t *book);
+int connect4_solve (Connect4_solver_t *solver, Connect4_t *game,
+                    Connect4_solve_result_t *result);
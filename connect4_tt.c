@@ -0,0 +1,157 @@
+/*
+ *  Connect four transposition table
+ */
+
+#include "connect4_tt.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(Connect4_tt_bucket_t) == CONNECT4_TT_LINE_SIZE,
+                "a bucket must fill exactly one cache line");
+
+#define DATA_VALUE(data)        ((int8_t)((data) & 0xff))
+#define DATA_BOUND(data)        ((Connect4_tt_bound_t)((data)>>8 & 0xff))
+#define DATA_MOVES(data)        ((int)((data)>>16 & 0xff))
+#define DATA_GENERATION(data)   ((uint8_t)((data)>>24 & 0xff))
+
+static uint64_t
+pack_data (int value, Connect4_tt_bound_t bound, int moves, uint8_t generation)
+{
+    return (uint64_t)(uint8_t)value | (uint64_t)bound<<8
+            | (uint64_t)moves<<16 | (uint64_t)generation<<24;
+}
+
+static Connect4_tt_bucket_t *
+bucket_of (const Connect4_tt_t *tt, uint64_t key)
+{
+    // Fibonacci hashing; the top bits of the product are well mixed
+    uint64_t hash = key*UINT64_C(0x9e3779b97f4a7c15);
+    size_t index = tt->bucket_bits ? hash>>(64 - tt->bucket_bits) : 0;
+    return &tt->buckets[index];
+}
+
+/*
+ *  Function name:
+ *      connect4_tt_init
+ *
+ *  Description:
+ *      allocate the largest power of two number of buckets that fits
+ *      in mem_bytes (one bucket at least)
+ *
+ *  Input:
+ *      tt          :   table
+ *      mem_bytes   :   memory budget
+ *
+ *  Output:
+ *      return      :   0 on success, -1 when the allocation fails
+ */
+int
+connect4_tt_init (Connect4_tt_t *tt, size_t mem_bytes)
+{
+    tt->bucket_bits = 0;
+    while (((size_t)CONNECT4_TT_LINE_SIZE<<(tt->bucket_bits + 1)) <= mem_bytes)
+        tt->bucket_bits++;
+
+    tt->buckets = aligned_alloc(CONNECT4_TT_LINE_SIZE, connect4_tt_size(tt));
+    if (tt->buckets == NULL)
+        return -1;
+
+    connect4_tt_clear(tt);
+    return 0;
+}
+
+void
+connect4_tt_finalize (Connect4_tt_t *tt)
+{
+    free(tt->buckets);
+    tt->buckets = NULL;
+}
+
+/*
+ *  must not run while a search uses the table
+ */
+void
+connect4_tt_clear (Connect4_tt_t *tt)
+{
+    memset(tt->buckets, 0, connect4_tt_size(tt));
+    tt->generation = 0;
+}
+
+/*
+ *  entries stored by earlier searches stay valid, but become
+ *  the first candidates for replacement
+ */
+void
+connect4_tt_new_search (Connect4_tt_t *tt)
+{
+    tt->generation++;
+}
+
+size_t
+connect4_tt_size (const Connect4_tt_t *tt)
+{
+    return (size_t)CONNECT4_TT_LINE_SIZE<<tt->bucket_bits;
+}
+
+bool
+connect4_tt_probe (Connect4_tt_t *tt, Connect4_tt_stats_t *stats,
+                    uint64_t key, int *value, Connect4_tt_bound_t *bound)
+{
+    Connect4_tt_bucket_t *bucket = bucket_of(tt, key);
+
+    stats->probes++;
+    for (int i = 0; i < CONNECT4_TT_BUCKET_ENTRY_NUM; i++) {
+        Connect4_tt_entry_t *entry = &bucket->entry[i];
+        uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        uint64_t check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+
+        if (DATA_BOUND(data) != CONNECT4_TT_EMPTY && (check ^ data) == key) {
+            *value = DATA_VALUE(data);
+            *bound = DATA_BOUND(data);
+            stats->hits++;
+            return true;
+        }
+    }
+
+    stats->misses++;
+    return false;
+}
+
+void
+connect4_tt_store (Connect4_tt_t *tt, Connect4_tt_stats_t *stats,
+                    uint64_t key, int value,
+                    Connect4_tt_bound_t bound, int moves)
+{
+    Connect4_tt_bucket_t *bucket = bucket_of(tt, key);
+    Connect4_tt_entry_t *victim = NULL;
+    int victim_worth = 0;
+    bool evict = true;      // a different position gets overwritten
+
+    for (int i = 0; i < CONNECT4_TT_BUCKET_ENTRY_NUM; i++) {
+        Connect4_tt_entry_t *entry = &bucket->entry[i];
+        uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        uint64_t check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+
+        if (DATA_BOUND(data) == CONNECT4_TT_EMPTY || (check ^ data) == key) {
+            victim = entry;
+            evict = false;
+            break;
+        }
+
+        // entries of the running search and near the root are worth more
+        int worth = (DATA_GENERATION(data) == tt->generation) ? 256 : 0;
+        worth += 255 - DATA_MOVES(data);
+        if (victim == NULL || worth < victim_worth) {
+            victim = entry;
+            victim_worth = worth;
+        }
+    }
+
+    if (evict)
+        stats->replacements++;
+    stats->stores++;
+
+    uint64_t data = pack_data(value, bound, moves, tt->generation);
+    __atomic_store_n(&victim->data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->check, key ^ data, __ATOMIC_RELAXED);
+}
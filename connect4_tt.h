@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *  <<Transposition table>>
+ *
+ *  A power of two number of 64-byte buckets, each bucket holding
+ *  CONNECT4_TT_BUCKET_ENTRY_NUM entries and sitting on its own cache
+ *  line, so a probe touches exactly one line.
+ *
+ *  The key must identify the position uniquely; the solver uses
+ *  current + mask of its column-major bitboards.
+ *
+ *  Replacement inside a full bucket: an entry of an older search
+ *  goes first, then the entry with the most disks on the board (the
+ *  smallest subtree, the cheapest to search again).
+ *
+ *  The table is shared by all search threads without locks. An entry
+ *  is two words, data and key ^ data, each read and written atomically;
+ *  a probe accepts the entry only when the two words give back its key,
+ *  so an entry torn by two concurrent stores reads as a miss.
+ *
+ *  Counters are kept by the caller (one set per thread) and passed in.
+ */
+
+#define CONNECT4_TT_LINE_SIZE 64
+#define CONNECT4_TT_BUCKET_ENTRY_NUM 4
+
+typedef enum {
+    CONNECT4_TT_EMPTY,
+    CONNECT4_TT_LOWER,      // score >= value
+    CONNECT4_TT_UPPER,      // score <= value
+    CONNECT4_TT_EXACT
+} Connect4_tt_bound_t;
+
+typedef struct Connect4_tt_entry {
+    uint64_t check;         // key ^ data
+    uint64_t data;          // value | bound<<8 | moves<<16 | generation<<24
+} Connect4_tt_entry_t;
+
+typedef struct Connect4_tt_bucket {
+    _Alignas(CONNECT4_TT_LINE_SIZE)
+    Connect4_tt_entry_t entry[CONNECT4_TT_BUCKET_ENTRY_NUM];
+} Connect4_tt_bucket_t;
+
+typedef struct Connect4_tt_stats {
+    uint64_t probes, hits, misses;
+    uint64_t stores, replacements;  // replacements: a different key was evicted
+} Connect4_tt_stats_t;
+
+typedef struct Connect4_tt {
+    Connect4_tt_bucket_t *buckets;
+    int bucket_bits;
+    uint8_t generation;
+} Connect4_tt_t;
+
+int connect4_tt_init (Connect4_tt_t *tt, size_t mem_bytes);
+void connect4_tt_finalize (Connect4_tt_t *tt);
+void connect4_tt_clear (Connect4_tt_t *tt);
+void connect4_tt_new_search (Connect4_tt_t *tt);
+size_t connect4_tt_size (const Connect4_tt_t *tt);
+bool connect4_tt_probe (Connect4_tt_t *tt, Connect4_tt_stats_t *stats,
+                        uint64_t key, int *value, Connect4_tt_bound_t *bound);
+void connect4_tt_store (Connect4_tt_t *tt, Connect4_tt_stats_t *stats,
+                        uint64_t key, int value,
+                        Connect4_tt_bound_t bound, int moves);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ *  <<Clocks and random numbers>>
+ *
+ *  Shared by the front end and the tools. The clocks are monotonic, for
+ *  timeouts and measurements only. connect4_rand_next() is xorshift64*:
+ *  fast and good enough to pick random moves and jitter, not for
+ *  anything that must not be guessed (the server's tokens come from
+ *  getrandom()). A state must not be 0.
+ */
+
+static inline double
+connect4_now_sec (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static inline long
+connect4_now_ms (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000L + ts.tv_nsec/1000000;
+}
+
+static inline long
+connect4_now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000L + ts.tv_nsec;
+}
+
+static inline uint64_t
+connect4_rand_next (uint64_t *state)
+{
+    *state ^= *state>>12;
+    *state ^= *state<<25;
+    *state ^= *state>>27;
+    return *state*UINT64_C(0x2545f4914f6cdd1d);
+}